@@ -0,0 +1,462 @@
+/**
+ * @file: batch.c
+ *
+ * @description: Batch (array) versions of the unit operations, with SIMD
+ * kernels picked at runtime.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdatomic.h> // for the kernel selection
+
+#include "batch.h"
+
+// SIMD kernels are only built for x86 with GCC-compatible compilers, since
+// they rely on target attributes and __builtin_cpu_supports. Define
+// ACY_NO_SIMD to disable them entirely.
+#if (defined(__x86_64__) || defined(__i386__)) \
+ && defined(__GNUC__) \
+ && !defined(ACY_NO_SIMD)
+  #define ACY_BATCH_X86
+  #include <immintrin.h>
+#endif
+
+/*********
+ * Types *
+ *********/
+
+typedef void (*acy_batch_fn)(id const *in, id *out, size_t n, id seed);
+
+// Arguments for running a batch function over part of its input on a pool.
+struct acy_batch_job_s {
+  acy_batch_fn fn;
+  id const *in;
+  id *out;
+  id seed;
+};
+typedef struct acy_batch_job_s acy_batch_job;
+
+/******************
+ * Scalar Kernels *
+ ******************/
+
+static void acy_prng_batch_scalar(id const *in, id *out, size_t n, id seed) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = acy_prng_keyed(in[i], &key);
+  }
+}
+
+static void acy_rev_prng_batch_scalar(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed
+) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = acy_rev_prng_keyed(in[i], &key);
+  }
+}
+
+/****************
+ * SIMD Kernels *
+ ****************/
+
+// Every stage of the PRNG shifts all lanes by the same seed-dependent amount,
+// so the kernels build an acy_prng_key once up front and use the uniform
+// (non-variable) shift instructions. Shifting a lane by 64 or more yields
+// zero, which matches the scalar code for a swirl distance of zero.
+
+#ifdef ACY_BATCH_X86
+
+__attribute__((target("avx2")))
+static inline __m256i acy_fold_avx2(__m256i x, __m128i shift_by) {
+  return _mm256_xor_si256(x, _mm256_sll_epi64(x, shift_by));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i acy_flop_avx2(__m256i x) {
+  __m256i mask = _mm256_set1_epi64x((long long) FLOP_MASK);
+  __m256i left = _mm256_and_si256(x, mask);
+  __m256i right = _mm256_andnot_si256(mask, x);
+  return _mm256_or_si256(
+    _mm256_slli_epi64(right, 4),
+    _mm256_srli_epi64(left, 4)
+  );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i acy_swirl_avx2(
+  __m256i x,
+  __m128i distance,
+  __m128i shift_by
+) {
+  return _mm256_or_si256(
+    _mm256_srl_epi64(x, distance),
+    _mm256_sll_epi64(x, shift_by)
+  );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i acy_rev_swirl_avx2(
+  __m256i x,
+  __m128i distance,
+  __m128i shift_by
+) {
+  return _mm256_or_si256(
+    _mm256_sll_epi64(x, distance),
+    _mm256_srl_epi64(x, shift_by)
+  );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i acy_scramble_avx2(__m256i x) {
+  __m256i trigger_mask = _mm256_set1_epi64x(0x80200003);
+  __m256i untriggered = _mm256_cmpeq_epi64(
+    _mm256_and_si256(x, trigger_mask),
+    _mm256_setzero_si256()
+  );
+  x = _mm256_or_si256(_mm256_srli_epi64(x, 1), _mm256_slli_epi64(x, 63));
+  return _mm256_xor_si256(
+    x,
+    _mm256_andnot_si256(untriggered, _mm256_set1_epi64x(0x03040610))
+  );
+}
+
+__attribute__((target("avx2")))
+static inline __m256i acy_rev_scramble_avx2(__m256i x) {
+  __m256i trigger_mask = _mm256_set1_epi64x(0x80200003);
+  x = _mm256_or_si256(_mm256_slli_epi64(x, 1), _mm256_srli_epi64(x, 63));
+  __m256i untriggered = _mm256_cmpeq_epi64(
+    _mm256_and_si256(x, trigger_mask),
+    _mm256_setzero_si256()
+  );
+  return _mm256_xor_si256(
+    x,
+    _mm256_andnot_si256(untriggered, _mm256_set1_epi64x(0x06080c20))
+  );
+}
+
+__attribute__((target("avx2")))
+static void acy_prng_batch_avx2(id const *in, id *out, size_t n, id seed) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  __m128i fold1_by = _mm_cvtsi64_si128((long long) key.fold_first);
+  __m128i swirl1_d = _mm_cvtsi64_si128((long long) key.swirl_first);
+  __m128i swirl1_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_first)
+  );
+  __m128i fold2_by = _mm_cvtsi64_si128((long long) key.fold_second);
+  __m128i swirl2_d = _mm_cvtsi64_si128((long long) key.swirl_second);
+  __m128i swirl2_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_second)
+  );
+  __m256i thirteen = _mm256_set1_epi64x(13);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *) (in + i));
+    x = _mm256_add_epi64(x, thirteen);
+    x = acy_fold_avx2(x, fold1_by);
+    x = acy_flop_avx2(x);
+    x = acy_swirl_avx2(x, swirl1_d, swirl1_by);
+    x = acy_fold_avx2(x, fold2_by);
+    x = acy_swirl_avx2(x, swirl2_d, swirl2_by);
+    x = acy_scramble_avx2(x);
+    _mm256_storeu_si256((__m256i *) (out + i), x);
+  }
+  acy_prng_batch_scalar(in + i, out + i, n - i, seed);
+}
+
+__attribute__((target("avx2")))
+static void acy_rev_prng_batch_avx2(id const *in, id *out, size_t n, id seed) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  __m128i fold1_by = _mm_cvtsi64_si128((long long) key.fold_first);
+  __m128i swirl1_d = _mm_cvtsi64_si128((long long) key.swirl_first);
+  __m128i swirl1_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_first)
+  );
+  __m128i fold2_by = _mm_cvtsi64_si128((long long) key.fold_second);
+  __m128i swirl2_d = _mm_cvtsi64_si128((long long) key.swirl_second);
+  __m128i swirl2_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_second)
+  );
+  __m256i thirteen = _mm256_set1_epi64x(13);
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = _mm256_loadu_si256((__m256i const *) (in + i));
+    x = acy_rev_scramble_avx2(x);
+    x = acy_rev_swirl_avx2(x, swirl2_d, swirl2_by);
+    x = acy_fold_avx2(x, fold2_by);
+    x = acy_rev_swirl_avx2(x, swirl1_d, swirl1_by);
+    x = acy_flop_avx2(x);
+    x = acy_fold_avx2(x, fold1_by);
+    x = _mm256_sub_epi64(x, thirteen);
+    _mm256_storeu_si256((__m256i *) (out + i), x);
+  }
+  acy_rev_prng_batch_scalar(in + i, out + i, n - i, seed);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_fold_avx512(__m512i x, __m128i shift_by) {
+  return _mm512_xor_si512(x, _mm512_sll_epi64(x, shift_by));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_flop_avx512(__m512i x) {
+  __m512i mask = _mm512_set1_epi64((long long) FLOP_MASK);
+  __m512i left = _mm512_and_si512(x, mask);
+  __m512i right = _mm512_andnot_si512(mask, x);
+  return _mm512_or_si512(
+    _mm512_slli_epi64(right, 4),
+    _mm512_srli_epi64(left, 4)
+  );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_swirl_avx512(
+  __m512i x,
+  __m128i distance,
+  __m128i shift_by
+) {
+  return _mm512_or_si512(
+    _mm512_srl_epi64(x, distance),
+    _mm512_sll_epi64(x, shift_by)
+  );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_rev_swirl_avx512(
+  __m512i x,
+  __m128i distance,
+  __m128i shift_by
+) {
+  return _mm512_or_si512(
+    _mm512_sll_epi64(x, distance),
+    _mm512_srl_epi64(x, shift_by)
+  );
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_scramble_avx512(__m512i x) {
+  __mmask8 trigger = _mm512_test_epi64_mask(x, _mm512_set1_epi64(0x80200003));
+  x = _mm512_ror_epi64(x, 1);
+  return _mm512_mask_xor_epi64(x, trigger, x, _mm512_set1_epi64(0x03040610));
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i acy_rev_scramble_avx512(__m512i x) {
+  x = _mm512_rol_epi64(x, 1);
+  __mmask8 trigger = _mm512_test_epi64_mask(x, _mm512_set1_epi64(0x80200003));
+  return _mm512_mask_xor_epi64(x, trigger, x, _mm512_set1_epi64(0x06080c20));
+}
+
+__attribute__((target("avx512f")))
+static void acy_prng_batch_avx512(id const *in, id *out, size_t n, id seed) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  __m128i fold1_by = _mm_cvtsi64_si128((long long) key.fold_first);
+  __m128i swirl1_d = _mm_cvtsi64_si128((long long) key.swirl_first);
+  __m128i swirl1_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_first)
+  );
+  __m128i fold2_by = _mm_cvtsi64_si128((long long) key.fold_second);
+  __m128i swirl2_d = _mm_cvtsi64_si128((long long) key.swirl_second);
+  __m128i swirl2_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_second)
+  );
+  __m512i thirteen = _mm512_set1_epi64(13);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i x = _mm512_loadu_si512((void const *) (in + i));
+    x = _mm512_add_epi64(x, thirteen);
+    x = acy_fold_avx512(x, fold1_by);
+    x = acy_flop_avx512(x);
+    x = acy_swirl_avx512(x, swirl1_d, swirl1_by);
+    x = acy_fold_avx512(x, fold2_by);
+    x = acy_swirl_avx512(x, swirl2_d, swirl2_by);
+    x = acy_scramble_avx512(x);
+    _mm512_storeu_si512((void *) (out + i), x);
+  }
+  acy_prng_batch_scalar(in + i, out + i, n - i, seed);
+}
+
+__attribute__((target("avx512f")))
+static void acy_rev_prng_batch_avx512(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed
+) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, seed);
+  __m128i fold1_by = _mm_cvtsi64_si128((long long) key.fold_first);
+  __m128i swirl1_d = _mm_cvtsi64_si128((long long) key.swirl_first);
+  __m128i swirl1_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_first)
+  );
+  __m128i fold2_by = _mm_cvtsi64_si128((long long) key.fold_second);
+  __m128i swirl2_d = _mm_cvtsi64_si128((long long) key.swirl_second);
+  __m128i swirl2_by = _mm_cvtsi64_si128(
+    (long long) (ID_BITS - key.swirl_second)
+  );
+  __m512i thirteen = _mm512_set1_epi64(13);
+
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m512i x = _mm512_loadu_si512((void const *) (in + i));
+    x = acy_rev_scramble_avx512(x);
+    x = acy_rev_swirl_avx512(x, swirl2_d, swirl2_by);
+    x = acy_fold_avx512(x, fold2_by);
+    x = acy_rev_swirl_avx512(x, swirl1_d, swirl1_by);
+    x = acy_flop_avx512(x);
+    x = acy_fold_avx512(x, fold1_by);
+    x = _mm512_sub_epi64(x, thirteen);
+    _mm512_storeu_si512((void *) (out + i), x);
+  }
+  acy_rev_prng_batch_scalar(in + i, out + i, n - i, seed);
+}
+
+#endif // ACY_BATCH_X86
+
+/************
+ * Dispatch *
+ ************/
+
+// The selected kernel. These are atomic because the batch functions may be
+// called from several threads at once (e.g., by a pool; see pool.h) while
+// the first call selects a kernel. Selection is idempotent, so a race
+// between threads on the first call just picks the same kernel twice, and
+// any mix of old and new pointers seen in between gives the same results.
+static _Atomic acy_batch_kernel acy_current_kernel = ACY_BATCH_KERNEL_AUTO;
+static acy_batch_fn _Atomic acy_prng_batch_impl = NULL;
+static acy_batch_fn _Atomic acy_rev_prng_batch_impl = NULL;
+
+static int acy_batch_kernel_supported(acy_batch_kernel kernel) {
+  switch (kernel) {
+    case ACY_BATCH_KERNEL_SCALAR:
+      return 1;
+#ifdef ACY_BATCH_X86
+    case ACY_BATCH_KERNEL_AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+    case ACY_BATCH_KERNEL_AVX512:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+      return 0;
+  }
+}
+
+int acy_set_batch_kernel(acy_batch_kernel kernel) {
+  if (kernel == ACY_BATCH_KERNEL_AUTO) {
+    if (acy_batch_kernel_supported(ACY_BATCH_KERNEL_AVX512)) {
+      kernel = ACY_BATCH_KERNEL_AVX512;
+    } else if (acy_batch_kernel_supported(ACY_BATCH_KERNEL_AVX2)) {
+      kernel = ACY_BATCH_KERNEL_AVX2;
+    } else {
+      kernel = ACY_BATCH_KERNEL_SCALAR;
+    }
+  }
+  if (!acy_batch_kernel_supported(kernel)) {
+    return 0;
+  }
+  switch (kernel) {
+    default:
+    case ACY_BATCH_KERNEL_SCALAR:
+      acy_prng_batch_impl = &acy_prng_batch_scalar;
+      acy_rev_prng_batch_impl = &acy_rev_prng_batch_scalar;
+      break;
+#ifdef ACY_BATCH_X86
+    case ACY_BATCH_KERNEL_AVX2:
+      acy_prng_batch_impl = &acy_prng_batch_avx2;
+      acy_rev_prng_batch_impl = &acy_rev_prng_batch_avx2;
+      break;
+    case ACY_BATCH_KERNEL_AVX512:
+      acy_prng_batch_impl = &acy_prng_batch_avx512;
+      acy_rev_prng_batch_impl = &acy_rev_prng_batch_avx512;
+      break;
+#endif
+  }
+  acy_current_kernel = kernel;
+  return 1;
+}
+
+acy_batch_kernel acy_get_batch_kernel(void) {
+  if (acy_current_kernel == ACY_BATCH_KERNEL_AUTO) {
+    acy_set_batch_kernel(ACY_BATCH_KERNEL_AUTO);
+  }
+  return acy_current_kernel;
+}
+
+char const * acy_batch_kernel_name(acy_batch_kernel kernel) {
+  switch (kernel) {
+    case ACY_BATCH_KERNEL_AUTO: return "auto";
+    case ACY_BATCH_KERNEL_SCALAR: return "scalar";
+    case ACY_BATCH_KERNEL_AVX2: return "avx2";
+    case ACY_BATCH_KERNEL_AVX512: return "avx512";
+    default: return "unknown";
+  }
+}
+
+/*************
+ * Functions *
+ *************/
+
+void acy_prng_batch(id const *in, id *out, size_t n, id seed) {
+  acy_batch_fn impl = atomic_load(&acy_prng_batch_impl);
+  if (impl == NULL) {
+    acy_set_batch_kernel(ACY_BATCH_KERNEL_AUTO);
+    impl = atomic_load(&acy_prng_batch_impl);
+  }
+  impl(in, out, n, seed);
+}
+
+void acy_rev_prng_batch(id const *in, id *out, size_t n, id seed) {
+  acy_batch_fn impl = atomic_load(&acy_rev_prng_batch_impl);
+  if (impl == NULL) {
+    acy_set_batch_kernel(ACY_BATCH_KERNEL_AUTO);
+    impl = atomic_load(&acy_rev_prng_batch_impl);
+  }
+  impl(in, out, n, seed);
+}
+
+static void acy_batch_range(id start, id end, id worker, void *context) {
+  acy_batch_job const *job = (acy_batch_job const *) context;
+  job->fn(job->in + start, job->out + start, end - start, job->seed);
+}
+
+void acy_prng_batch_pool(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed,
+  acy_pool *pool
+) {
+  if (acy_prng_batch_impl == NULL) {
+    acy_set_batch_kernel(ACY_BATCH_KERNEL_AUTO);
+  }
+  acy_batch_job job = { acy_prng_batch_impl, in, out, seed };
+  acy_parallel_for(pool, 0, n, 0, &acy_batch_range, &job);
+}
+
+void acy_rev_prng_batch_pool(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed,
+  acy_pool *pool
+) {
+  if (acy_rev_prng_batch_impl == NULL) {
+    acy_set_batch_kernel(ACY_BATCH_KERNEL_AUTO);
+  }
+  acy_batch_job job = { acy_rev_prng_batch_impl, in, out, seed };
+  acy_parallel_for(pool, 0, n, 0, &acy_batch_range, &job);
+}
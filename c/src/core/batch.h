@@ -0,0 +1,77 @@
+/**
+ * @file: batch.h
+ *
+ * @description: Batch (array) versions of the unit operations, with SIMD
+ * kernels picked at runtime.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_BATCH_H
+#define INCLUDE_BATCH_H
+
+#include <stddef.h> // for size_t
+
+#include "core/unit.h" // for "id" and unit operations
+#include "core/pool.h" // for acy_pool
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Which kernel the batch functions use. ACY_BATCH_KERNEL_AUTO picks the best
+// kernel that the current CPU supports.
+enum acy_batch_kernel_e {
+  ACY_BATCH_KERNEL_AUTO = 0,
+  ACY_BATCH_KERNEL_SCALAR = 1,
+  ACY_BATCH_KERNEL_AVX2 = 2,
+  ACY_BATCH_KERNEL_AVX512 = 3
+};
+typedef enum acy_batch_kernel_e acy_batch_kernel;
+
+/*************
+ * Functions *
+ *************/
+
+// Applies acy_prng to each of the n ids in 'in' using the given seed, writing
+// results to 'out'. The results are identical to calling acy_prng on each id
+// individually. 'in' and 'out' may be the same array, but must not otherwise
+// overlap.
+void acy_prng_batch(id const *in, id *out, size_t n, id seed);
+
+// Reverse
+void acy_rev_prng_batch(id const *in, id *out, size_t n, id seed);
+
+// Work like acy_prng_batch and acy_rev_prng_batch, but split the ids among
+// the threads of a pool (see pool.h). A NULL pool runs them on the calling
+// thread.
+void acy_prng_batch_pool(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed,
+  acy_pool *pool
+);
+
+void acy_rev_prng_batch_pool(
+  id const *in,
+  id *out,
+  size_t n,
+  id seed,
+  acy_pool *pool
+);
+
+// Forces the batch functions to use a specific kernel (mostly useful for
+// testing and benchmarking). Returns 1 on success, or 0 if the requested
+// kernel isn't supported by this build or CPU, in which case the current
+// kernel is left alone.
+int acy_set_batch_kernel(acy_batch_kernel kernel);
+
+// Returns the kernel currently in use by the batch functions (never
+// ACY_BATCH_KERNEL_AUTO).
+acy_batch_kernel acy_get_batch_kernel(void);
+
+// Returns a short name for the given kernel, for reporting.
+char const * acy_batch_kernel_name(acy_batch_kernel kernel);
+
+#endif // INCLUDE_BATCH_H
@@ -8,6 +8,226 @@
 
 #include "cohort.h"
 
+// Fills in a spin plan; see acy_spin_plan for the wrap-around handling.
+static void acy_spin_plan_init(acy_spin_plan *plan, id cohort_size, id seed) {
+  plan->cohort_size = cohort_size;
+  plan->offset = seed % cohort_size;
+  plan->rev_offset = cohort_size - plan->offset;
+  // inner + seed overflows iff inner >= 2^64 - seed:
+  plan->wrap_at = (seed == 0 || -seed >= cohort_size) ? cohort_size : -seed;
+  // Overflow drops 2^64 from the sum, which is this much mod cohort_size:
+  id lost = ((~((id) 0)) % cohort_size + 1) % cohort_size;
+  plan->wrap_offset = (plan->offset + cohort_size - lost) % cohort_size;
+}
+
+static void acy_mix_plan_init(acy_mix_plan *plan, id cohort_size, id seed) {
+  acy_spin_plan_init(&plan->odd, cohort_size/2, seed + 464185);
+  acy_spin_plan_init(&plan->even, (cohort_size+1)/2, seed + 1048239);
+}
+
+static void acy_fold_plan_init(acy_fold_plan *plan, id cohort_size, id seed) {
+  id half = cohort_size >> 1;
+  id quarter = cohort_size >> 2;
+  id split = half + (seed % quarter);
+  id after = (cohort_size - split);
+  split += (after + 1) % 2; // force an odd split point
+  after = (cohort_size - split);
+
+  plan->after = after;
+  plan->split = split;
+  plan->first_end = half - after/2;
+  plan->second_end = half + after/2;
+}
+
+static void acy_region_plan_init(
+  acy_region_plan *plan,
+  id cohort_size,
+  id seed
+) {
+  id min_regions = 2 - (cohort_size < 2 * MIN_REGION_SIZE);
+  id max_regions = 1 + cohort_size / MIN_REGION_SIZE;
+  plan->regions = (
+    min_regions
+  + (
+      (seed % (1 + (max_regions - min_regions)))
+    % MAX_REGION_COUNT
+    )
+  );
+  plan->region_size = cohort_size / plan->regions;
+  plan->leftovers = cohort_size - plan->regions * plan->region_size;
+  acy_divisor_init(&plan->regions_div, plan->regions);
+  acy_divisor_init(&plan->region_size_div, plan->region_size);
+}
+
+static void acy_flop_plan_init(acy_divisor *size, id cohort_size, id seed) {
+  id limit = cohort_size >> 3;
+  limit += (limit < 4) * 4;
+  acy_divisor_init(size, (seed % limit) + 2);
+}
+
+void acy_shuffle_plan_init(
+  acy_shuffle_plan *plan,
+  id cohort_size,
+  id seed
+) {
+  plan->cohort_size = cohort_size;
+  plan->identity = cohort_size < MIN_COHORT_SIZE;
+  plan->interleave_half = (cohort_size + 1) / 2;
+  if (plan->identity) {
+    return;
+  }
+  seed ^= cohort_size;
+  acy_region_plan_init(&plan->spread_first, cohort_size, seed + 457);
+  acy_mix_plan_init(&plan->mix_first, cohort_size, seed + 2897);
+  acy_spin_plan_init(&plan->spin_first, cohort_size, seed + 1987);
+  acy_region_plan_init(&plan->upend_first, cohort_size, seed + 47);
+  acy_fold_plan_init(&plan->fold_first, cohort_size, seed + 839);
+  acy_flop_plan_init(&plan->flop_first, cohort_size, seed + 53);
+  acy_fold_plan_init(&plan->fold_second, cohort_size, seed + 211);
+  acy_mix_plan_init(&plan->mix_second, cohort_size, seed + 733);
+  acy_region_plan_init(&plan->spread_second, cohort_size, seed + 881);
+  acy_flop_plan_init(&plan->flop_second, cohort_size, seed + 193);
+  acy_region_plan_init(&plan->upend_second, cohort_size, seed + 794641);
+  acy_spin_plan_init(&plan->spin_second, cohort_size, seed + 19);
+}
+
+// Whole-array passes for each planned shuffle stage. Each loop applies a
+// single branch-light stage to every element, so the compiler can vectorize
+// it.
+static void acy_spin_pass(id *arr, id n, acy_spin_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_spin(arr[i], plan);
+  }
+}
+
+static void acy_rev_spin_pass(id *arr, id n, acy_spin_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_rev_cohort_spin(arr[i], plan);
+  }
+}
+
+static void acy_mix_pass(id *arr, id n, acy_mix_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_mix(arr[i], plan);
+  }
+}
+
+static void acy_rev_mix_pass(id *arr, id n, acy_mix_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_rev_cohort_mix(arr[i], plan);
+  }
+}
+
+static void acy_interleave_pass(id *arr, id n, id half) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_interleave(arr[i], n, half);
+  }
+}
+
+static void acy_rev_interleave_pass(id *arr, id n) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_rev_cohort_interleave(arr[i], n);
+  }
+}
+
+static void acy_fold_pass(id *arr, id n, acy_fold_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_fold(arr[i], plan);
+  }
+}
+
+static void acy_rev_fold_pass(id *arr, id n, acy_fold_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_rev_cohort_fold(arr[i], plan);
+  }
+}
+
+static void acy_flop_pass(id *arr, id n, acy_divisor const * const size) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_flop(arr[i], n, size);
+  }
+}
+
+static void acy_spread_pass(
+  id *arr,
+  id n,
+  acy_region_plan const * const plan
+) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_spread(arr[i], plan);
+  }
+}
+
+static void acy_rev_spread_pass(
+  id *arr,
+  id n,
+  acy_region_plan const * const plan
+) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_rev_cohort_spread(arr[i], plan);
+  }
+}
+
+static void acy_upend_pass(id *arr, id n, acy_region_plan const * const plan) {
+  for (id i = 0; i < n; ++i) {
+    arr[i] = acy_planned_cohort_upend(arr[i], n, plan);
+  }
+}
+
+void acy_cohort_permutation(id cohort_size, id seed, id *out) {
+  acy_shuffle_plan plan;
+  acy_shuffle_plan_init(&plan, cohort_size, seed);
+  for (id i = 0; i < cohort_size; ++i) {
+    out[i] = i;
+  }
+  if (plan.identity) {
+    return;
+  }
+  id n = cohort_size;
+  acy_spread_pass(out, n, &plan.spread_first);
+  acy_mix_pass(out, n, &plan.mix_first);
+  acy_interleave_pass(out, n, plan.interleave_half);
+  acy_spin_pass(out, n, &plan.spin_first);
+  acy_upend_pass(out, n, &plan.upend_first);
+  acy_fold_pass(out, n, &plan.fold_first);
+  acy_interleave_pass(out, n, plan.interleave_half);
+  acy_flop_pass(out, n, &plan.flop_first);
+  acy_fold_pass(out, n, &plan.fold_second);
+  acy_mix_pass(out, n, &plan.mix_second);
+  acy_spread_pass(out, n, &plan.spread_second);
+  acy_interleave_pass(out, n, plan.interleave_half);
+  acy_flop_pass(out, n, &plan.flop_second);
+  acy_upend_pass(out, n, &plan.upend_second);
+  acy_spin_pass(out, n, &plan.spin_second);
+}
+
+void acy_cohort_inverse_permutation(id cohort_size, id seed, id *out) {
+  acy_shuffle_plan plan;
+  acy_shuffle_plan_init(&plan, cohort_size, seed);
+  for (id i = 0; i < cohort_size; ++i) {
+    out[i] = i;
+  }
+  if (plan.identity) {
+    return;
+  }
+  id n = cohort_size;
+  acy_rev_spin_pass(out, n, &plan.spin_second);
+  acy_upend_pass(out, n, &plan.upend_second);
+  acy_flop_pass(out, n, &plan.flop_second);
+  acy_rev_interleave_pass(out, n);
+  acy_rev_spread_pass(out, n, &plan.spread_second);
+  acy_rev_mix_pass(out, n, &plan.mix_second);
+  acy_rev_fold_pass(out, n, &plan.fold_second);
+  acy_flop_pass(out, n, &plan.flop_first);
+  acy_rev_interleave_pass(out, n);
+  acy_rev_fold_pass(out, n, &plan.fold_first);
+  acy_upend_pass(out, n, &plan.upend_first);
+  acy_rev_spin_pass(out, n, &plan.spin_first);
+  acy_rev_interleave_pass(out, n);
+  acy_rev_mix_pass(out, n, &plan.mix_first);
+  acy_rev_spread_pass(out, n, &plan.spread_first);
+}
+
 void acy_create_sumtable(
   id *disttable,
   id table_size,
@@ -26,6 +246,83 @@ void acy_cleanup_sumtable(id *sumtable) {
   free(sumtable);
 }
 
+int acy_create_tablesum_index(
+  id const * const sumtable,
+  id sumtable_size,
+  id multiplier,
+  acy_tablesum_index *r_index
+) {
+  id count = sumtable_size + 1;
+  r_index->count = count;
+  r_index->depth = 0;
+  while ((((id) 1) << r_index->depth) <= count) {
+    r_index->depth += 1;
+  }
+  r_index->multiplier = multiplier;
+  r_index->values = (id*) malloc(sizeof(id) * count);
+  r_index->indices = (id*) malloc(sizeof(id) * count);
+  if (r_index->values == NULL || r_index->indices == NULL) {
+    acy_cleanup_tablesum_index(r_index);
+    return 0;
+  }
+
+  // An in-order walk of the tree visits entries in sorted order:
+  id idx = acy_tree_first(count);
+  for (id i = 0; i < count; ++i) {
+    r_index->values[idx] = sumtable[i] * multiplier;
+    r_index->indices[idx] = i;
+    idx = acy_tree_next_index(idx, count);
+  }
+  return 1;
+}
+
+void acy_cleanup_tablesum_index(acy_tablesum_index *index) {
+  free(index->values);
+  free(index->indices);
+  index->values = NULL;
+  index->indices = NULL;
+}
+
+// Number of items handled together by the batch functions below.
+#define ACY_BATCH_CHUNK 64
+
+void acy_indexed_inv_tablesum_batch(
+  id const * const sums,
+  id n,
+  acy_tablesum_index const * const index,
+  id *r_results
+) {
+  id const * const values = index->values;
+  id count = index->count;
+  id idx[ACY_BATCH_CHUNK];
+  id first_greater[ACY_BATCH_CHUNK];
+  for (id base = 0; base < n; base += ACY_BATCH_CHUNK) {
+    id m = acy_min(ACY_BATCH_CHUNK, n - base);
+    id const * const chunk = sums + base;
+    for (id j = 0; j < m; ++j) {
+      idx[j] = 0;
+      first_greater[j] = count;
+    }
+    for (id level = 0; level < index->depth; ++level) {
+      for (id j = 0; j < m; ++j) {
+        if (idx[j] < count) {
+          id go_right = values[idx[j]] <= chunk[j];
+          first_greater[j] = go_right ? first_greater[j] : idx[j];
+          idx[j] = acy_tree_left(idx[j]) + go_right;
+        }
+      }
+    }
+    for (id j = 0; j < m; ++j) {
+      if (first_greater[j] == count) {
+        r_results[base + j] = count - 1;
+      } else {
+        id sorted = index->indices[first_greater[j]];
+        r_results[base + j] = sorted - (sorted > 0);
+      }
+    }
+  }
+}
+
 void acy_tabulated_cohort_and_inner(
   id outer,
   id const * const sumtable,
@@ -313,3 +610,311 @@ id acy_tabulated_outer_min(
 
   return result;
 }
+
+int acy_create_tabulated_ctx(
+  id const * const sumtable,
+  id sumtable_size,
+  id multiplier,
+  id seed,
+  acy_tabulated_ctx *r_ctx
+) {
+  r_ctx->sumtable = sumtable;
+  r_ctx->table_size = sumtable_size;
+  r_ctx->multiplier = multiplier;
+  r_ctx->seed = seed;
+  r_ctx->cohort_size = acy_table_total(sumtable_size, sumtable) * multiplier;
+  r_ctx->super_size = r_ctx->cohort_size * sumtable_size;
+  acy_divisor_init(&r_ctx->cohort_div, r_ctx->cohort_size);
+  acy_divisor_init(&r_ctx->super_div, r_ctx->super_size);
+  acy_divisor_init(&r_ctx->table_div, sumtable_size);
+
+  r_ctx->scaled = (id*) malloc(sizeof(id) * (sumtable_size + 1));
+  r_ctx->plans = (acy_shuffle_plan*) malloc(
+    sizeof(acy_shuffle_plan) * sumtable_size
+  );
+  if (
+    r_ctx->scaled == NULL
+ || r_ctx->plans == NULL
+ || !acy_create_tablesum_index(
+      sumtable,
+      sumtable_size,
+      multiplier,
+      &r_ctx->index
+    )
+  ) {
+    free(r_ctx->scaled);
+    free(r_ctx->plans);
+    r_ctx->scaled = NULL;
+    r_ctx->plans = NULL;
+    return 0;
+  }
+
+  for (id i = 0; i <= sumtable_size; ++i) {
+    r_ctx->scaled[i] = acy_tablesum(i, sumtable) * multiplier;
+  }
+
+  for (id section = 0; section < sumtable_size; ++section) {
+    acy_shuffle_plan_init(
+      &r_ctx->plans[section],
+      r_ctx->cohort_size,
+      seed + section
+    );
+  }
+  return 1;
+}
+
+void acy_cleanup_tabulated_ctx(acy_tabulated_ctx *ctx) {
+  free(ctx->scaled);
+  free(ctx->plans);
+  acy_cleanup_tablesum_index(&ctx->index);
+  ctx->scaled = NULL;
+  ctx->plans = NULL;
+}
+
+// The part of acy_tabulated_cohort_and_inner before the table search: finds
+// the super cohort and section, and returns the shuffled index within the
+// section.
+static inline id acy_tabulated_shuffled(
+  id outer,
+  acy_tabulated_ctx const * const ctx,
+  id *r_super_cohort,
+  id *r_section
+) {
+  id super_inner, in_section;
+  acy_divmod(outer, &ctx->super_div, r_super_cohort, &super_inner);
+  acy_divmod(super_inner, &ctx->cohort_div, r_section, &in_section);
+  return acy_planned_cohort_shuffle(in_section, &ctx->plans[*r_section]);
+}
+
+// The part of acy_tabulated_cohort_and_inner after the table search.
+static inline void acy_tabulated_finish(
+  id shuf,
+  id super_cohort,
+  id section,
+  id slice,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohort,
+  id *r_inner
+) {
+  id after_slice = ctx->scaled[slice];
+  id in_slice = shuf - after_slice;
+  *r_cohort = ctx->table_size * (super_cohort - 1) + section + slice + 1;
+  *r_inner = ctx->cohort_size - 1 - after_slice - in_slice;
+}
+
+// The part of acy_tabulated_cohort_outer after the table search.
+static inline id acy_tabulated_outer_finish(
+  id cohort,
+  id inv_inner,
+  id segment,
+  acy_tabulated_ctx const * const ctx
+) {
+  id table_size = ctx->table_size;
+  id after = ctx->scaled[segment];
+  id super_cohort, section;
+  acy_divmod(cohort, &ctx->table_div, &super_cohort, &section);
+  section += (table_size - segment) - 1;
+
+  id in_segment = inv_inner - after;
+
+  if (section >= table_size) {
+    super_cohort += 1;
+    section -= table_size;
+  }
+
+  id shuf = after + in_segment;
+
+  id in_section = acy_planned_rev_cohort_shuffle(shuf, &ctx->plans[section]);
+
+  return acy_cohort_outer(
+    super_cohort,
+    section * ctx->cohort_size + in_section,
+    ctx->super_size
+  );
+}
+
+void acy_tabulated_cohort_and_inner_ctx(
+  id outer,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohort,
+  id *r_inner
+) {
+  id super_cohort, section;
+  id shuf = acy_tabulated_shuffled(outer, ctx, &super_cohort, &section);
+  id slice = acy_indexed_inv_tablesum(shuf, &ctx->index);
+  acy_tabulated_finish(
+    shuf,
+    super_cohort,
+    section,
+    slice,
+    ctx,
+    r_cohort,
+    r_inner
+  );
+}
+
+id acy_tabulated_cohort_outer_ctx(
+  id cohort,
+  id inner,
+  acy_tabulated_ctx const * const ctx
+) {
+  id inv_inner = ctx->cohort_size - 1 - inner;
+  id segment = acy_indexed_inv_tablesum(inv_inner, &ctx->index);
+  return acy_tabulated_outer_finish(cohort, inv_inner, segment, ctx);
+}
+
+void acy_tabulated_cohort_and_inner_batch(
+  id const * const outers,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohorts,
+  id *r_inners
+) {
+  id shuf[ACY_BATCH_CHUNK];
+  id super_cohort[ACY_BATCH_CHUNK];
+  id section[ACY_BATCH_CHUNK];
+  id slice[ACY_BATCH_CHUNK];
+  for (id base = 0; base < n; base += ACY_BATCH_CHUNK) {
+    id m = acy_min(ACY_BATCH_CHUNK, n - base);
+    for (id j = 0; j < m; ++j) {
+      shuf[j] = acy_tabulated_shuffled(
+        outers[base + j],
+        ctx,
+        &super_cohort[j],
+        &section[j]
+      );
+    }
+    acy_indexed_inv_tablesum_batch(shuf, m, &ctx->index, slice);
+    for (id j = 0; j < m; ++j) {
+      acy_tabulated_finish(
+        shuf[j],
+        super_cohort[j],
+        section[j],
+        slice[j],
+        ctx,
+        &r_cohorts[base + j],
+        &r_inners[base + j]
+      );
+    }
+  }
+}
+
+void acy_tabulated_cohort_outer_batch(
+  id const * const cohorts,
+  id const * const inners,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_outers
+) {
+  id inv_inner[ACY_BATCH_CHUNK];
+  id segment[ACY_BATCH_CHUNK];
+  for (id base = 0; base < n; base += ACY_BATCH_CHUNK) {
+    id m = acy_min(ACY_BATCH_CHUNK, n - base);
+    for (id j = 0; j < m; ++j) {
+      inv_inner[j] = ctx->cohort_size - 1 - inners[base + j];
+    }
+    acy_indexed_inv_tablesum_batch(inv_inner, m, &ctx->index, segment);
+    for (id j = 0; j < m; ++j) {
+      r_outers[base + j] = acy_tabulated_outer_finish(
+        cohorts[base + j],
+        inv_inner[j],
+        segment[j],
+        ctx
+      );
+    }
+  }
+}
+
+// Arguments for the _batch_pool functions below. Each uses the fields that
+// its batch function needs.
+struct acy_cohort_batch_job_s {
+  id const *first_in;
+  id const *second_in;
+  acy_tablesum_index const *index;
+  acy_tabulated_ctx const *ctx;
+  id *first_out;
+  id *second_out;
+};
+typedef struct acy_cohort_batch_job_s acy_cohort_batch_job;
+
+static void acy_inv_tablesum_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_cohort_batch_job const *job = (acy_cohort_batch_job const *) context;
+  acy_indexed_inv_tablesum_batch(
+    job->first_in + start,
+    end - start,
+    job->index,
+    job->first_out + start
+  );
+}
+
+static void acy_cohort_and_inner_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_cohort_batch_job const *job = (acy_cohort_batch_job const *) context;
+  acy_tabulated_cohort_and_inner_batch(
+    job->first_in + start,
+    end - start,
+    job->ctx,
+    job->first_out + start,
+    job->second_out + start
+  );
+}
+
+static void acy_cohort_outer_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_cohort_batch_job const *job = (acy_cohort_batch_job const *) context;
+  acy_tabulated_cohort_outer_batch(
+    job->first_in + start,
+    job->second_in + start,
+    end - start,
+    job->ctx,
+    job->first_out + start
+  );
+}
+
+void acy_indexed_inv_tablesum_batch_pool(
+  id const * const sums,
+  id n,
+  acy_tablesum_index const * const index,
+  id *r_results,
+  acy_pool *pool
+) {
+  acy_cohort_batch_job job = { sums, NULL, index, NULL, r_results, NULL };
+  acy_parallel_for(pool, 0, n, 0, &acy_inv_tablesum_batch_range, &job);
+}
+
+void acy_tabulated_cohort_and_inner_batch_pool(
+  id const * const outers,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohorts,
+  id *r_inners,
+  acy_pool *pool
+) {
+  acy_cohort_batch_job job = { outers, NULL, NULL, ctx, r_cohorts, r_inners };
+  acy_parallel_for(pool, 0, n, 0, &acy_cohort_and_inner_batch_range, &job);
+}
+
+void acy_tabulated_cohort_outer_batch_pool(
+  id const * const cohorts,
+  id const * const inners,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_outers,
+  acy_pool *pool
+) {
+  acy_cohort_batch_job job = { cohorts, inners, NULL, ctx, r_outers, NULL };
+  acy_parallel_for(pool, 0, n, 0, &acy_cohort_outer_batch_range, &job);
+}
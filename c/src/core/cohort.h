@@ -17,6 +17,8 @@
 #endif
 
 #include "core/unit.h" // for "id" and unit operations
+#include "core/divide.h" // for precomputed divisors
+#include "core/pool.h" // for acy_pool
 
 /***********
  * Globals *
@@ -25,6 +27,108 @@
 // Minimum viable cohort size (cuts off a few edge cases)
 #define MIN_COHORT_SIZE 4
 
+/************************
+ * Types and Structures *
+ ************************/
+
+// Precomputed parameters for acy_cohort_spin and acy_rev_cohort_spin with a
+// fixed cohort size and seed. Note that acy_cohort_spin computes
+// (inner + seed) % cohort_size, and that sum wraps around for very large
+// seeds: inners at or above wrap_at use wrap_offset instead of offset.
+struct acy_spin_plan_s {
+  id cohort_size;
+  id offset; // seed % cohort_size
+  id wrap_at; // smallest inner for which inner + seed overflows
+  id wrap_offset; // offset that accounts for that overflow
+  id rev_offset; // cohort_size - offset
+};
+typedef struct acy_spin_plan_s acy_spin_plan;
+
+// Precomputed parameters for acy_cohort_mix, which spins odd and even items
+// separately.
+struct acy_mix_plan_s {
+  acy_spin_plan odd;
+  acy_spin_plan even;
+};
+typedef struct acy_mix_plan_s acy_mix_plan;
+
+// Precomputed parameters for acy_cohort_fold and acy_rev_cohort_fold.
+struct acy_fold_plan_s {
+  id after; // number of items past the split point
+  id split; // the split point
+  id first_end; // end of the unmoved first part: half - after/2
+  id second_end; // last index of the moved part: half + after/2
+};
+typedef struct acy_fold_plan_s acy_fold_plan;
+
+// Precomputed parameters for acy_cohort_spread, acy_rev_cohort_spread, and
+// acy_cohort_upend (upend just uses region_size).
+struct acy_region_plan_s {
+  id regions;
+  id region_size;
+  id leftovers;
+  acy_divisor regions_div;
+  acy_divisor region_size_div;
+};
+typedef struct acy_region_plan_s acy_region_plan;
+
+// A compiled acy_cohort_shuffle for a fixed cohort size and seed (see
+// acy_shuffle_plan_init). All 15 stages have their seed-dependent parameters
+// worked out ahead of time, so that acy_planned_cohort_shuffle and
+// acy_planned_rev_cohort_shuffle don't need any ordinary divisions: the flop,
+// spread, and upend stages use precomputed divisors.
+struct acy_shuffle_plan_s {
+  id cohort_size;
+  id identity; // set for cohorts too small to shuffle
+  id interleave_half; // (cohort_size + 1) / 2
+  acy_region_plan spread_first; // seed + 457
+  acy_mix_plan mix_first; // seed + 2897
+  acy_spin_plan spin_first; // seed + 1987
+  acy_region_plan upend_first; // seed + 47
+  acy_fold_plan fold_first; // seed + 839
+  acy_divisor flop_first; // seed + 53
+  acy_fold_plan fold_second; // seed + 211
+  acy_mix_plan mix_second; // seed + 733
+  acy_region_plan spread_second; // seed + 881
+  acy_divisor flop_second; // seed + 193
+  acy_region_plan upend_second; // seed + 794641
+  acy_spin_plan spin_second; // seed + 19
+};
+typedef struct acy_shuffle_plan_s acy_shuffle_plan;
+
+// A search index for acy_inv_tablesum (see acy_create_tablesum_index). The
+// multiplied sumtable entries are stored in Eytzinger (breadth-first) order,
+// following the acy_tree_* index helpers, along with each entry's original
+// index in the sumtable.
+struct acy_tablesum_index_s {
+  id count; // number of entries: sumtable_size + 1
+  id depth; // number of levels in the tree
+  id multiplier;
+  id *values; // sumtable[i] * multiplier, in tree order
+  id *indices; // original sumtable indices, in tree order
+};
+typedef struct acy_tablesum_index_s acy_tablesum_index;
+
+// Everything about a tabulated cohort (see acy_tabulated_cohort_and_inner)
+// that doesn't depend on the outer ID: the derived sizes, divisors for them,
+// shuffle plans for each section, and a search index for the sumtable. Set up
+// with acy_create_tabulated_ctx and free with acy_cleanup_tabulated_ctx.
+struct acy_tabulated_ctx_s {
+  id const *sumtable;
+  id table_size;
+  id multiplier;
+  id seed;
+  id cohort_size; // table total times multiplier
+  id super_size; // cohort_size * table_size
+  acy_divisor cohort_div;
+  acy_divisor super_div;
+  acy_divisor table_div;
+  id *scaled; // sumtable[i] * multiplier (in the original order)
+  acy_shuffle_plan *plans; // one per section (seed + section)
+  acy_tablesum_index index;
+};
+typedef struct acy_tabulated_ctx_s acy_tabulated_ctx;
+
 /********************
  * Inline Functions *
  ********************/
@@ -60,6 +164,31 @@ static inline id acy_cohort_outer(
   return (cohort * cohort_size) + inner;
 }
 
+// Versions of acy_cohort, acy_cohort_inner, and acy_cohort_and_inner that use
+// a precomputed divisor for the cohort size (see core/divide.h).
+static inline id acy_cohort_div(
+  id outer,
+  acy_divisor const * const cohort_div
+) {
+  return acy_div(outer, cohort_div);
+}
+
+static inline id acy_cohort_inner_div(
+  id outer,
+  acy_divisor const * const cohort_div
+) {
+  return acy_mod(outer, cohort_div);
+}
+
+static inline void acy_cohort_and_inner_div(
+  id outer,
+  acy_divisor const * const cohort_div,
+  id *r_cohort,
+  id *r_inner
+) {
+  acy_divmod(outer, cohort_div, r_cohort, r_inner);
+}
+
 // Interleaves cohort members by folding top half into bottom half.
 static inline id acy_cohort_interleave(id inner, id cohort_size) {
   id bottom = (inner < ((cohort_size+1)/2));
@@ -129,6 +258,27 @@ static inline id acy_rev_cohort_spin(id spun, id cohort_size, id seed) {
   return (spun + (cohort_size - (seed % cohort_size))) % cohort_size;
 }
 
+// Versions of acy_cohort_spin and acy_rev_cohort_spin that use a precomputed
+// divisor for the cohort size.
+static inline id acy_cohort_spin_div(
+  id inner,
+  acy_divisor const * const cohort_div,
+  id seed
+) {
+  return acy_mod(inner + seed, cohort_div);
+}
+
+static inline id acy_rev_cohort_spin_div(
+  id spun,
+  acy_divisor const * const cohort_div,
+  id seed
+) {
+  return acy_mod(
+    spun + (cohort_div->d - acy_mod(seed, cohort_div)),
+    cohort_div
+  );
+}
+
 // Flops cohort sections with their neighbors.
 static inline id acy_cohort_flop(id inner, id cohort_size, id seed) {
   id limit = cohort_size >> 3;
@@ -310,6 +460,229 @@ static inline id acy_rev_cohort_shuffle(id shuffled, id cohort_size, id seed) {
   return r;
 }
 
+// Fills in a shuffle plan for the given cohort size and seed, so that
+// acy_planned_cohort_shuffle(inner, plan) gives the same result as
+// acy_cohort_shuffle(inner, cohort_size, seed) (and likewise for the
+// reverse). Cohorts smaller than MIN_COHORT_SIZE get an identity plan.
+void acy_shuffle_plan_init(
+  acy_shuffle_plan *plan,
+  id cohort_size,
+  id seed
+);
+
+// Planned versions of the individual shuffle stages (see above for the
+// unplanned versions):
+static inline id acy_planned_cohort_spin(
+  id inner,
+  acy_spin_plan const * const plan
+) {
+  id offset = inner >= plan->wrap_at ? plan->wrap_offset : plan->offset;
+  id result = inner + offset;
+  return result - (result >= plan->cohort_size) * plan->cohort_size;
+}
+
+static inline id acy_planned_rev_cohort_spin(
+  id spun,
+  acy_spin_plan const * const plan
+) {
+  id result = spun + plan->rev_offset;
+  return result - (result >= plan->cohort_size) * plan->cohort_size;
+}
+
+static inline id acy_planned_cohort_mix(
+  id inner,
+  acy_mix_plan const * const plan
+) {
+  id half = inner >> 1;
+  if (inner & 1) {
+    return 2 * acy_planned_cohort_spin(half, &plan->odd) + 1;
+  } else {
+    return 2 * acy_planned_cohort_spin(half, &plan->even);
+  }
+}
+
+static inline id acy_planned_rev_cohort_mix(
+  id mixed,
+  acy_mix_plan const * const plan
+) {
+  id half = mixed >> 1;
+  if (mixed & 1) {
+    return 2 * acy_planned_rev_cohort_spin(half, &plan->odd) + 1;
+  } else {
+    return 2 * acy_planned_rev_cohort_spin(half, &plan->even);
+  }
+}
+
+static inline id acy_planned_cohort_interleave(
+  id inner,
+  id cohort_size,
+  id half
+) {
+  id bottom = inner < half;
+  return (
+     bottom * (inner*2) // if
+  + !bottom * ((cohort_size - 1 - inner) * 2 + 1) // else
+  );
+}
+
+static inline id acy_planned_rev_cohort_interleave(
+  id shuffled,
+  id cohort_size
+) {
+  id odd = shuffled & 1;
+  return (
+     odd * (cohort_size - 1 - (shuffled >> 1)) // if
+  + !odd * (shuffled >> 1) // else
+  );
+}
+
+static inline id acy_planned_cohort_fold(
+  id inner,
+  acy_fold_plan const * const plan
+) {
+  id first = inner < plan->first_end;
+  id third = inner >= plan->split;
+  id second = !first && !third;
+
+  return (
+    first * (inner)
+  + second * (inner + plan->after)
+  + third * (plan->first_end + (inner - plan->split))
+  );
+}
+
+static inline id acy_planned_rev_cohort_fold(
+  id folded,
+  acy_fold_plan const * const plan
+) {
+  id first = folded < plan->first_end;
+  id third = folded > plan->second_end;
+  id second = !first && !third;
+
+  return (
+    first * (folded)
+  + second * (plan->split + (folded - plan->first_end))
+  + third * (folded - plan->after)
+  );
+}
+
+// Flop is still its own inverse; 'size' is the planned section size.
+static inline id acy_planned_cohort_flop(
+  id inner,
+  id cohort_size,
+  acy_divisor const * const size
+) {
+  id odd = acy_div(inner, size) & 1;
+  id result = odd ? inner - size->d : inner + size->d;
+  return result >= cohort_size ? inner : result;
+}
+
+static inline id acy_planned_cohort_spread(
+  id inner,
+  acy_region_plan const * const plan
+) {
+  id index, region;
+  acy_divmod(inner, &plan->regions_div, &index, &region);
+  return (
+     (index < plan->region_size)
+   * (region * plan->region_size + index + plan->leftovers)
+  + !(index < plan->region_size)
+   * (inner - plan->regions * plan->region_size)
+  );
+}
+
+static inline id acy_planned_rev_cohort_spread(
+  id spread,
+  acy_region_plan const * const plan
+) {
+  if (spread < plan->leftovers) {
+    return plan->regions * plan->region_size + spread;
+  }
+  id index, region;
+  acy_divmod(spread - plan->leftovers, &plan->region_size_div, &index, &region);
+  return region * plan->regions + index;
+}
+
+// Upend is still its own inverse.
+static inline id acy_planned_cohort_upend(
+  id inner,
+  id cohort_size,
+  acy_region_plan const * const plan
+) {
+  id region, index;
+  acy_divmod(inner, &plan->region_size_div, &region, &index);
+  id result = region * plan->region_size + (plan->region_size - 1 - index);
+  return (
+     (result < cohort_size) * result
+  + !(result < cohort_size) * inner
+  );
+}
+
+// Works like acy_cohort_shuffle, using a plan from acy_shuffle_plan_init.
+static inline id acy_planned_cohort_shuffle(
+  id inner,
+  acy_shuffle_plan const * const plan
+) {
+  if (plan->identity) {
+    return inner;
+  }
+  id cohort_size = plan->cohort_size;
+  id r = inner;
+  r = acy_planned_cohort_spread(r, &plan->spread_first);
+  r = acy_planned_cohort_mix(r, &plan->mix_first);
+  r = acy_planned_cohort_interleave(r, cohort_size, plan->interleave_half);
+  r = acy_planned_cohort_spin(r, &plan->spin_first);
+  r = acy_planned_cohort_upend(r, cohort_size, &plan->upend_first);
+  r = acy_planned_cohort_fold(r, &plan->fold_first);
+  r = acy_planned_cohort_interleave(r, cohort_size, plan->interleave_half);
+  r = acy_planned_cohort_flop(r, cohort_size, &plan->flop_first);
+  r = acy_planned_cohort_fold(r, &plan->fold_second);
+  r = acy_planned_cohort_mix(r, &plan->mix_second);
+  r = acy_planned_cohort_spread(r, &plan->spread_second);
+  r = acy_planned_cohort_interleave(r, cohort_size, plan->interleave_half);
+  r = acy_planned_cohort_flop(r, cohort_size, &plan->flop_second);
+  r = acy_planned_cohort_upend(r, cohort_size, &plan->upend_second);
+  r = acy_planned_cohort_spin(r, &plan->spin_second);
+  return r;
+}
+
+// Reverse
+static inline id acy_planned_rev_cohort_shuffle(
+  id shuffled,
+  acy_shuffle_plan const * const plan
+) {
+  if (plan->identity) {
+    return shuffled;
+  }
+  id cohort_size = plan->cohort_size;
+  id r = shuffled;
+  r = acy_planned_rev_cohort_spin(r, &plan->spin_second);
+  r = acy_planned_cohort_upend(r, cohort_size, &plan->upend_second);
+  r = acy_planned_cohort_flop(r, cohort_size, &plan->flop_second);
+  r = acy_planned_rev_cohort_interleave(r, cohort_size);
+  r = acy_planned_rev_cohort_spread(r, &plan->spread_second);
+  r = acy_planned_rev_cohort_mix(r, &plan->mix_second);
+  r = acy_planned_rev_cohort_fold(r, &plan->fold_second);
+  r = acy_planned_cohort_flop(r, cohort_size, &plan->flop_first);
+  r = acy_planned_rev_cohort_interleave(r, cohort_size);
+  r = acy_planned_rev_cohort_fold(r, &plan->fold_first);
+  r = acy_planned_cohort_upend(r, cohort_size, &plan->upend_first);
+  r = acy_planned_rev_cohort_spin(r, &plan->spin_first);
+  r = acy_planned_rev_cohort_interleave(r, cohort_size);
+  r = acy_planned_rev_cohort_mix(r, &plan->mix_first);
+  r = acy_planned_rev_cohort_spread(r, &plan->spread_first);
+  return r;
+}
+
+// Fills the cohort_size-element 'out' array with the full shuffle of a cohort,
+// so that out[i] == acy_cohort_shuffle(i, cohort_size, seed). Each stage is
+// applied to the whole array at once, which is much faster than shuffling
+// each item separately.
+void acy_cohort_permutation(id cohort_size, id seed, id *out);
+
+// Reverse: out[i] == acy_rev_cohort_shuffle(i, cohort_size, seed).
+void acy_cohort_inverse_permutation(id cohort_size, id seed, id *out);
+
 // A cohort of the given size drawn from a double-wide segment of the outer
 // region with 50% representation. Note that the inner indices of mixed cohorts
 // are shuffled, but the bottom 1/2 indices always come earlier than the top
@@ -362,6 +735,51 @@ static inline void acy_mixed_cohort_and_inner(
   *r_inner = shuf;
 }
 
+static inline void acy_mixed_cohort_and_inner_div(
+  id outer,
+  acy_divisor const * const cohort_div,
+  id seed,
+  id *r_cohort,
+  id *r_inner
+) {
+  id cohort_size = cohort_div->d;
+  id strict_cohort, strict_inner;
+  acy_divmod(outer, cohort_div, &strict_cohort, &strict_inner);
+
+  id shuf = acy_cohort_shuffle(strict_inner, cohort_size, seed + strict_cohort);
+  id lower = shuf < cohort_size/2;
+
+  *r_cohort = (
+     lower * (strict_cohort + 1)
+  + !lower * (strict_cohort)
+  );
+
+  *r_inner = shuf;
+}
+
+// Versions of acy_mixed_cohort, acy_mixed_cohort_inner, and
+// acy_mixed_cohort_and_inner that use a precomputed divisor for the cohort
+// size.
+static inline id acy_mixed_cohort_div(
+  id outer,
+  acy_divisor const * const cohort_div,
+  id seed
+) {
+  id cohort, inner;
+  acy_mixed_cohort_and_inner_div(outer, cohort_div, seed, &cohort, &inner);
+  return cohort;
+}
+
+static inline id acy_mixed_cohort_inner_div(
+  id outer,
+  acy_divisor const * const cohort_div,
+  id seed
+) {
+  id strict_cohort, strict_inner;
+  acy_divmod(outer, cohort_div, &strict_cohort, &strict_inner);
+  return acy_cohort_shuffle(strict_inner, cohort_div->d, seed + strict_cohort);
+}
+
 // Reverse
 static inline id acy_mixed_cohort_outer(
   id cohort,
@@ -1480,6 +1898,55 @@ static inline id acy_inv_tablesum(
   }
 }
 
+// Builds a search index for acy_inv_tablesum over the given sumtable and
+// multiplier, storing it in r_index (use acy_cleanup_tablesum_index to free
+// it). The sumtable must be non-decreasing (as acy_fill_sumtable makes it)
+// and its total times the multiplier must fit in an id. Returns 1 on success,
+// or 0 if memory runs out (in which case nothing needs to be cleaned up).
+int acy_create_tablesum_index(
+  id const * const sumtable,
+  id sumtable_size,
+  id multiplier,
+  acy_tablesum_index *r_index
+);
+
+// Frees the memory held by a tablesum index.
+void acy_cleanup_tablesum_index(acy_tablesum_index *index);
+
+// Computes acy_indexed_inv_tablesum for each of the n given sums, storing
+// results in r_results. Walks many searches through the tree in lockstep so
+// that their memory accesses overlap.
+void acy_indexed_inv_tablesum_batch(
+  id const * const sums,
+  id n,
+  acy_tablesum_index const * const index,
+  id *r_results
+);
+
+// Works like acy_inv_tablesum with the sumtable, size, and multiplier that the
+// index was built from, and returns the same result. The search walks the
+// Eytzinger layout without branching on comparisons or multiplying, so most
+// of its probes stay in a few cache lines.
+static inline id acy_indexed_inv_tablesum(
+  id sum,
+  acy_tablesum_index const * const index
+) {
+  id const * const values = index->values;
+  id count = index->count;
+  id idx = 0;
+  id first_greater = count; // none yet
+  while (idx < count) {
+    id go_right = values[idx] <= sum;
+    first_greater = go_right ? first_greater : idx;
+    idx = acy_tree_left(idx) + go_right;
+  }
+  if (first_greater == count) { // everything is <= sum
+    return count - 1;
+  }
+  id sorted = index->indices[first_greater];
+  return sorted - (sorted > 0);
+}
+
 // According to a distribution table that specifies the relative number of
 // items found within a given number of regions, computes the cohort number and
 // inner index of the given linear outer ID.
@@ -1526,4 +1993,86 @@ id acy_tabulated_outer_min(
   id multiplier
 );
 
+// Sets up a context for the tabulated cohort functions below, which give the
+// same results as the functions above with the same sumtable, size,
+// multiplier, and seed. The context refers to the sumtable, which must stay
+// around (and unchanged) until acy_cleanup_tabulated_ctx is called. Returns 1
+// on success, or 0 if memory runs out (in which case nothing needs to be
+// cleaned up).
+int acy_create_tabulated_ctx(
+  id const * const sumtable,
+  id sumtable_size,
+  id multiplier,
+  id seed,
+  acy_tabulated_ctx *r_ctx
+);
+
+// Frees the memory held by a tabulated cohort context.
+void acy_cleanup_tabulated_ctx(acy_tabulated_ctx *ctx);
+
+// Works like acy_tabulated_cohort_and_inner using a context.
+void acy_tabulated_cohort_and_inner_ctx(
+  id outer,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohort,
+  id *r_inner
+);
+
+// Works like acy_tabulated_cohort_outer using a context.
+id acy_tabulated_cohort_outer_ctx(
+  id cohort,
+  id inner,
+  acy_tabulated_ctx const * const ctx
+);
+
+// Maps n outer IDs to cohorts and inner IDs, writing results to the r_cohorts
+// and r_inners arrays. Same results as calling
+// acy_tabulated_cohort_and_inner_ctx on each, but works in chunks so that
+// shuffles and table searches for different IDs can overlap.
+void acy_tabulated_cohort_and_inner_batch(
+  id const * const outers,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohorts,
+  id *r_inners
+);
+
+// Reverse: maps n (cohort, inner) pairs back to outer IDs.
+void acy_tabulated_cohort_outer_batch(
+  id const * const cohorts,
+  id const * const inners,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_outers
+);
+
+// Versions of the batch functions above that split the work among the
+// threads of a pool (see pool.h), with the same results. A NULL pool runs
+// them on the calling thread.
+void acy_indexed_inv_tablesum_batch_pool(
+  id const * const sums,
+  id n,
+  acy_tablesum_index const * const index,
+  id *r_results,
+  acy_pool *pool
+);
+
+void acy_tabulated_cohort_and_inner_batch_pool(
+  id const * const outers,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_cohorts,
+  id *r_inners,
+  acy_pool *pool
+);
+
+void acy_tabulated_cohort_outer_batch_pool(
+  id const * const cohorts,
+  id const * const inners,
+  id n,
+  acy_tabulated_ctx const * const ctx,
+  id *r_outers,
+  acy_pool *pool
+);
+
 #endif // INCLUDE_COHORT_H
@@ -0,0 +1,57 @@
+/**
+ * @file: divide.c
+ *
+ * @description: Precomputed divisors for fast division by runtime-constant
+ * values such as cohort sizes.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include "divide.h"
+
+void acy_divisor_init(acy_divisor *div, id d) {
+  div->d = d;
+  div->magic = 0;
+  div->shift = 0;
+  div->mode = ACY_DIVISOR_PLAIN;
+#ifdef ACY_FAST_DIVIDE
+  if (d == 0) {
+    return;
+  }
+
+  // Find floor(log2(d)):
+  id floor_log2 = 0;
+  while ((d >> floor_log2) > 1) {
+    floor_log2 += 1;
+  }
+
+  div->shift = floor_log2;
+
+  if ((d & (d - 1)) == 0) { // power of two
+    div->mode = ACY_DIVISOR_SHIFT;
+    return;
+  }
+
+  // m = floor(2^(64 + floor_log2) / d), with remainder:
+  acy_u128 numerator = ((acy_u128) 1) << (64 + floor_log2);
+  id proposed = (id) (numerator / d);
+  id remainder = (id) (numerator % d);
+
+  id error = d - remainder;
+  if (error < (((id) 1) << floor_log2)) {
+    // 2^floor_log2 works as the extra power, so the magic number fits in 64
+    // bits:
+    div->mode = ACY_DIVISOR_MULTIPLY;
+  } else {
+    // We need a 65-bit magic number; its top bit is handled by an extra add
+    // in acy_div:
+    proposed += proposed;
+    id twice_remainder = remainder + remainder;
+    if (twice_remainder >= d || twice_remainder < remainder) {
+      proposed += 1;
+    }
+    div->mode = ACY_DIVISOR_MULTIPLY_ADD;
+  }
+  div->magic = proposed + 1;
+#endif
+}
@@ -0,0 +1,99 @@
+/**
+ * @file: divide.h
+ *
+ * @description: Precomputed divisors for fast division by runtime-constant
+ * values such as cohort sizes. Uses the multiply-and-shift approach from
+ * Granlund & Montgomery (as popularized by libdivide).
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_DIVIDE_H
+#define INCLUDE_DIVIDE_H
+
+#include "core/unit.h" // for "id"
+
+// The multiply path needs a 64×64→128-bit multiply; without one, divisors
+// just fall back to plain division. Define ACY_NO_FAST_DIVIDE to force the
+// fallback.
+#if defined(__SIZEOF_INT128__) && !defined(ACY_NO_FAST_DIVIDE)
+  #define ACY_FAST_DIVIDE
+  __extension__ typedef unsigned __int128 acy_u128; // quiets -Wpedantic
+#endif
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// How a divisor computes quotients:
+enum acy_divisor_mode_e {
+  ACY_DIVISOR_PLAIN = 0, // ordinary division (divisor 0 or no 128-bit ints)
+  ACY_DIVISOR_SHIFT = 1, // power of two: just shift
+  ACY_DIVISOR_MULTIPLY = 2, // high half of n × magic, then shift
+  ACY_DIVISOR_MULTIPLY_ADD = 3, // same, with an extra add for 65-bit magic
+};
+typedef enum acy_divisor_mode_e acy_divisor_mode;
+
+// A precomputed divisor (see acy_divisor_init).
+struct acy_divisor_s {
+  id d; // the divisor itself
+  id magic;
+  id shift;
+  acy_divisor_mode mode;
+};
+typedef struct acy_divisor_s acy_divisor;
+
+/*************
+ * Functions *
+ *************/
+
+// Sets up a divisor for dividing by d. This costs about as much as a few
+// ordinary divisions, so it's only worth it when dividing by the same value
+// many times. A divisor of 0 is allowed, but dividing by it behaves just like
+// ordinary division by zero.
+void acy_divisor_init(acy_divisor *div, id d);
+
+/********************
+ * Inline Functions *
+ ********************/
+
+// Returns n / div->d.
+static inline id acy_div(id n, acy_divisor const * const div) {
+#ifdef ACY_FAST_DIVIDE
+  id q;
+  switch (div->mode) {
+    case ACY_DIVISOR_SHIFT:
+      return n >> div->shift;
+    case ACY_DIVISOR_MULTIPLY:
+      q = (id) ((((acy_u128) n) * div->magic) >> ID_BITS);
+      return q >> div->shift;
+    case ACY_DIVISOR_MULTIPLY_ADD:
+      q = (id) ((((acy_u128) n) * div->magic) >> ID_BITS);
+      return (((n - q) >> 1) + q) >> div->shift;
+    default:
+      return n / div->d;
+  }
+#else
+  return n / div->d;
+#endif
+}
+
+// Returns n % div->d.
+static inline id acy_mod(id n, acy_divisor const * const div) {
+  return n - acy_div(n, div) * div->d;
+}
+
+// Computes both n / div->d and n % div->d, returning them via the r_quotient
+// and r_remainder parameters.
+static inline void acy_divmod(
+  id n,
+  acy_divisor const * const div,
+  id *r_quotient,
+  id *r_remainder
+) {
+  id q = acy_div(n, div);
+  *r_quotient = q;
+  *r_remainder = n - q * div->d;
+}
+
+#endif // INCLUDE_DIVIDE_H
@@ -0,0 +1,336 @@
+/**
+ * @file: permcache.c
+ *
+ * @description: A bounded cache of whole cohort permutations for small
+ * cohorts, so that repeated shuffles of the same cohort become table lookups.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdlib.h>
+
+#include "permcache.h"
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// A cached pair of tables. The forward and inverse tables are allocated
+// along with the entry itself.
+struct acy_perm_entry_s;
+typedef struct acy_perm_entry_s acy_perm_entry;
+
+struct acy_perm_entry_s {
+  id cohort_size;
+  id seed;
+  id hash;
+  id bytes;
+  acy_perm_entry *bucket_next;
+  acy_perm_entry *lru_prev; // towards most-recently used
+  acy_perm_entry *lru_next; // towards least-recently used
+  uint16_t *forward;
+  uint16_t *inverse;
+};
+
+struct acy_perm_cache_s {
+  acy_perm_entry **buckets;
+  id bucket_count; // always a power of two
+  acy_perm_entry *lru_head; // most-recently used
+  acy_perm_entry *lru_tail; // least-recently used
+  id ghosts[ACY_PERM_CACHE_GHOSTS]; // tags of recently-missed keys
+  id *scratch; // for building tables
+  id scratch_size;
+  acy_perm_cache_stats stats;
+};
+
+/***********
+ * Globals *
+ ***********/
+
+_Thread_local acy_perm_cache *acy_thread_perm_cache = NULL;
+
+#define ACY_PERM_CACHE_INITIAL_BUCKETS 64
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static inline id acy_perm_cache_hash(id cohort_size, id seed) {
+  id h = seed ^ (cohort_size * 0x9e3779b97f4a7c15);
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 32;
+  return h;
+}
+
+// The value stored in a ghost slot for a key's hash. Never zero, so that an
+// empty (zero) ghost slot never matches.
+static inline id acy_perm_cache_ghost_tag(id hash) {
+  return hash | 1;
+}
+
+static void acy_perm_cache_unlink(
+  acy_perm_cache *cache,
+  acy_perm_entry *entry
+) {
+  if (entry->lru_prev != NULL) {
+    entry->lru_prev->lru_next = entry->lru_next;
+  } else {
+    cache->lru_head = entry->lru_next;
+  }
+  if (entry->lru_next != NULL) {
+    entry->lru_next->lru_prev = entry->lru_prev;
+  } else {
+    cache->lru_tail = entry->lru_prev;
+  }
+  entry->lru_prev = NULL;
+  entry->lru_next = NULL;
+}
+
+static void acy_perm_cache_push_front(
+  acy_perm_cache *cache,
+  acy_perm_entry *entry
+) {
+  entry->lru_prev = NULL;
+  entry->lru_next = cache->lru_head;
+  if (cache->lru_head != NULL) {
+    cache->lru_head->lru_prev = entry;
+  } else {
+    cache->lru_tail = entry;
+  }
+  cache->lru_head = entry;
+}
+
+// Removes an entry from its bucket and the LRU list, and frees it.
+static void acy_perm_cache_remove(
+  acy_perm_cache *cache,
+  acy_perm_entry *entry
+) {
+  acy_perm_entry **link = &cache->buckets[
+    entry->hash & (cache->bucket_count - 1)
+  ];
+  while (*link != entry) {
+    link = &(*link)->bucket_next;
+  }
+  *link = entry->bucket_next;
+  acy_perm_cache_unlink(cache, entry);
+  cache->stats.entries -= 1;
+  cache->stats.bytes_used -= entry->bytes;
+  free(entry);
+}
+
+// Evicts least-recently-used entries until the given number of additional
+// bytes would fit in the budget.
+static void acy_perm_cache_make_room(acy_perm_cache *cache, id bytes) {
+  while (
+    cache->lru_tail != NULL
+ && cache->stats.bytes_used + bytes > cache->stats.byte_budget
+  ) {
+    acy_perm_cache_remove(cache, cache->lru_tail);
+    cache->stats.evictions += 1;
+  }
+}
+
+// Doubles the bucket count once there are more entries than buckets.
+static void acy_perm_cache_grow(acy_perm_cache *cache) {
+  id new_count = cache->bucket_count * 2;
+  acy_perm_entry **new_buckets = (acy_perm_entry**) calloc(
+    new_count,
+    sizeof(acy_perm_entry*)
+  );
+  if (new_buckets == NULL) {
+    return; // just keep using longer chains
+  }
+  for (id b = 0; b < cache->bucket_count; ++b) {
+    acy_perm_entry *entry = cache->buckets[b];
+    while (entry != NULL) {
+      acy_perm_entry *next = entry->bucket_next;
+      acy_perm_entry **bucket = &new_buckets[entry->hash & (new_count - 1)];
+      entry->bucket_next = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = new_buckets;
+  cache->bucket_count = new_count;
+}
+
+// Builds and inserts tables for the given key. Returns NULL if they can't fit
+// in the budget or allocation fails.
+static acy_perm_entry * acy_perm_cache_build(
+  acy_perm_cache *cache,
+  id cohort_size,
+  id seed,
+  id hash
+) {
+  id bytes = sizeof(acy_perm_entry) + 2 * cohort_size * sizeof(uint16_t);
+  if (bytes > cache->stats.byte_budget) {
+    return NULL;
+  }
+  if (cache->scratch_size < cohort_size) {
+    id *scratch = (id*) realloc(cache->scratch, cohort_size * sizeof(id));
+    if (scratch == NULL) {
+      return NULL;
+    }
+    cache->scratch = scratch;
+    cache->scratch_size = cohort_size;
+  }
+  acy_perm_cache_make_room(cache, bytes);
+
+  acy_perm_entry *entry = (acy_perm_entry*) malloc(bytes);
+  if (entry == NULL) {
+    return NULL;
+  }
+  entry->cohort_size = cohort_size;
+  entry->seed = seed;
+  entry->hash = hash;
+  entry->bytes = bytes;
+  entry->forward = (uint16_t*) (entry + 1);
+  entry->inverse = entry->forward + cohort_size;
+
+  acy_cohort_permutation(cohort_size, seed, cache->scratch);
+  for (id i = 0; i < cohort_size; ++i) {
+    entry->forward[i] = (uint16_t) cache->scratch[i];
+  }
+  acy_cohort_inverse_permutation(cohort_size, seed, cache->scratch);
+  for (id i = 0; i < cohort_size; ++i) {
+    entry->inverse[i] = (uint16_t) cache->scratch[i];
+  }
+
+  if (cache->stats.entries >= cache->bucket_count) {
+    acy_perm_cache_grow(cache);
+  }
+  acy_perm_entry **bucket = &cache->buckets[hash & (cache->bucket_count - 1)];
+  entry->bucket_next = *bucket;
+  *bucket = entry;
+  acy_perm_cache_push_front(cache, entry);
+  cache->stats.entries += 1;
+  cache->stats.bytes_used += bytes;
+  cache->stats.builds += 1;
+  return entry;
+}
+
+/*************
+ * Functions *
+ *************/
+
+acy_perm_cache * acy_create_perm_cache(id byte_budget) {
+  acy_perm_cache *cache = (acy_perm_cache*) calloc(1, sizeof(acy_perm_cache));
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->bucket_count = ACY_PERM_CACHE_INITIAL_BUCKETS;
+  cache->buckets = (acy_perm_entry**) calloc(
+    cache->bucket_count,
+    sizeof(acy_perm_entry*)
+  );
+  if (cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+  cache->stats.byte_budget = byte_budget;
+  return cache;
+}
+
+void acy_destroy_perm_cache(acy_perm_cache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  if (acy_thread_perm_cache == cache) {
+    acy_thread_perm_cache = NULL;
+  }
+  acy_clear_perm_cache(cache);
+  free(cache->buckets);
+  free(cache->scratch);
+  free(cache);
+}
+
+void acy_clear_perm_cache(acy_perm_cache *cache) {
+  while (cache->lru_head != NULL) {
+    acy_perm_cache_remove(cache, cache->lru_head);
+  }
+  for (id g = 0; g < ACY_PERM_CACHE_GHOSTS; ++g) {
+    cache->ghosts[g] = 0;
+  }
+}
+
+void acy_set_perm_cache_budget(acy_perm_cache *cache, id byte_budget) {
+  cache->stats.byte_budget = byte_budget;
+  acy_perm_cache_make_room(cache, 0);
+}
+
+void acy_get_perm_cache_stats(
+  acy_perm_cache const * const cache,
+  acy_perm_cache_stats *r_stats
+) {
+  *r_stats = cache->stats;
+}
+
+void acy_reset_perm_cache_stats(acy_perm_cache *cache) {
+  cache->stats.hits = 0;
+  cache->stats.misses = 0;
+  cache->stats.builds = 0;
+  cache->stats.evictions = 0;
+}
+
+int acy_perm_cache_tables(
+  acy_perm_cache *cache,
+  id cohort_size,
+  id seed,
+  uint16_t const **r_forward,
+  uint16_t const **r_inverse
+) {
+  if (cohort_size < MIN_COHORT_SIZE || cohort_size > ACY_PERM_CACHE_MAX_SIZE) {
+    return 0;
+  }
+
+  // Fast path: same key as last time.
+  acy_perm_entry *entry = cache->lru_head;
+  if (
+    entry == NULL
+ || entry->cohort_size != cohort_size
+ || entry->seed != seed
+  ) {
+    id hash = acy_perm_cache_hash(cohort_size, seed);
+    entry = cache->buckets[hash & (cache->bucket_count - 1)];
+    while (
+      entry != NULL
+   && (entry->cohort_size != cohort_size || entry->seed != seed)
+    ) {
+      entry = entry->bucket_next;
+    }
+    if (entry == NULL) {
+      cache->stats.misses += 1;
+      // Only build a table if this key missed recently:
+      id *ghost = &cache->ghosts[hash % ACY_PERM_CACHE_GHOSTS];
+      id tag = acy_perm_cache_ghost_tag(hash);
+      if (*ghost != tag) {
+        *ghost = tag;
+        return 0;
+      }
+      *ghost = 0;
+      entry = acy_perm_cache_build(cache, cohort_size, seed, hash);
+      if (entry == NULL) {
+        return 0;
+      }
+    } else {
+      cache->stats.hits += 1;
+      acy_perm_cache_unlink(cache, entry);
+      acy_perm_cache_push_front(cache, entry);
+    }
+  } else {
+    cache->stats.hits += 1;
+  }
+
+  *r_forward = entry->forward;
+  *r_inverse = entry->inverse;
+  return 1;
+}
+
+void acy_set_thread_perm_cache(acy_perm_cache *cache) {
+  acy_thread_perm_cache = cache;
+}
+
+acy_perm_cache * acy_get_thread_perm_cache(void) {
+  return acy_thread_perm_cache;
+}
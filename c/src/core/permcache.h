@@ -0,0 +1,159 @@
+/**
+ * @file: permcache.h
+ *
+ * @description: A bounded cache of whole cohort permutations for small
+ * cohorts, so that repeated shuffles of the same cohort become table lookups.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_PERMCACHE_H
+#define INCLUDE_PERMCACHE_H
+
+#include <stdint.h> // for uint16_t
+
+#include "core/unit.h" // for "id"
+#include "core/cohort.h" // for acy_cohort_shuffle
+
+/***********
+ * Globals *
+ ***********/
+
+// Largest cohort size that can be cached (tables hold 16-bit indices).
+#define ACY_PERM_CACHE_MAX_SIZE 65536
+
+// Default memory budget for a new cache, in bytes.
+#define ACY_PERM_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+// Number of recently-missed keys remembered for admission (see below).
+#define ACY_PERM_CACHE_GHOSTS 256
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Opaque cache type: use acy_create_perm_cache and acy_destroy_perm_cache.
+// A cache holds forward and inverse tables for (cohort_size, seed) pairs,
+// evicting the least-recently-used tables when it exceeds its byte budget.
+//
+// Building a table costs about as much as shuffling every item in the cohort,
+// so a table is only built the second time a key misses within a short
+// window; keys that are only looked up once don't pay for a whole table. A
+// cache must only be used by one thread at a time.
+struct acy_perm_cache_s;
+typedef struct acy_perm_cache_s acy_perm_cache;
+
+// Statistics for a cache (see acy_get_perm_cache_stats).
+struct acy_perm_cache_stats_s {
+  id hits; // lookups answered from a table
+  id misses; // lookups that didn't find a table
+  id builds; // tables built (after a repeated miss)
+  id evictions; // tables evicted to stay under budget
+  id entries; // tables currently held
+  id bytes_used; // memory currently used by tables
+  id byte_budget; // the memory budget
+};
+typedef struct acy_perm_cache_stats_s acy_perm_cache_stats;
+
+/*************
+ * Functions *
+ *************/
+
+// Allocates a new empty cache with the given memory budget in bytes. Returns
+// NULL if allocation fails.
+acy_perm_cache * acy_create_perm_cache(id byte_budget);
+
+// Frees a cache and all of its tables.
+void acy_destroy_perm_cache(acy_perm_cache *cache);
+
+// Drops all tables from the cache (statistics are kept).
+void acy_clear_perm_cache(acy_perm_cache *cache);
+
+// Changes the memory budget, evicting tables as needed.
+void acy_set_perm_cache_budget(acy_perm_cache *cache, id byte_budget);
+
+// Fills in r_stats with the cache's current statistics.
+void acy_get_perm_cache_stats(
+  acy_perm_cache const * const cache,
+  acy_perm_cache_stats *r_stats
+);
+
+// Resets the hit/miss/build/eviction counters.
+void acy_reset_perm_cache_stats(acy_perm_cache *cache);
+
+// Looks up the tables for the given cohort size and seed, building them if
+// the key has recently missed. On success, returns 1 and sets r_forward and
+// r_inverse so that r_forward[i] == acy_cohort_shuffle(i, cohort_size, seed)
+// and r_inverse[i] == acy_rev_cohort_shuffle(i, cohort_size, seed). Returns 0
+// otherwise (including for cohorts smaller than MIN_COHORT_SIZE or larger
+// than ACY_PERM_CACHE_MAX_SIZE). The returned tables remain valid until the
+// next lookup or change to the cache.
+int acy_perm_cache_tables(
+  acy_perm_cache *cache,
+  id cohort_size,
+  id seed,
+  uint16_t const **r_forward,
+  uint16_t const **r_inverse
+);
+
+// Installs a cache for use by acy_cached_cohort_shuffle and
+// acy_cached_rev_cohort_shuffle in the calling thread only. Pass NULL to stop
+// using a cache. The caller still owns the cache.
+void acy_set_thread_perm_cache(acy_perm_cache *cache);
+
+// Returns the calling thread's installed cache, or NULL.
+acy_perm_cache * acy_get_thread_perm_cache(void);
+
+/********************
+ * Inline Functions *
+ ********************/
+
+// The calling thread's installed cache (use acy_set_thread_perm_cache).
+extern _Thread_local acy_perm_cache *acy_thread_perm_cache;
+
+// Works exactly like acy_cohort_shuffle, but uses the calling thread's
+// installed cache (if any) for small cohorts.
+static inline id acy_cached_cohort_shuffle(
+  id inner,
+  id cohort_size,
+  id seed
+) {
+  uint16_t const *forward, *inverse;
+  if (
+    acy_thread_perm_cache != NULL
+ && acy_perm_cache_tables(
+      acy_thread_perm_cache,
+      cohort_size,
+      seed,
+      &forward,
+      &inverse
+    )
+  ) {
+    return forward[inner];
+  }
+  return acy_cohort_shuffle(inner, cohort_size, seed);
+}
+
+// Reverse
+static inline id acy_cached_rev_cohort_shuffle(
+  id shuffled,
+  id cohort_size,
+  id seed
+) {
+  uint16_t const *forward, *inverse;
+  if (
+    acy_thread_perm_cache != NULL
+ && acy_perm_cache_tables(
+      acy_thread_perm_cache,
+      cohort_size,
+      seed,
+      &forward,
+      &inverse
+    )
+  ) {
+    return inverse[shuffled];
+  }
+  return acy_rev_cohort_shuffle(shuffled, cohort_size, seed);
+}
+
+#endif // INCLUDE_PERMCACHE_H
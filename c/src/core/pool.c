@@ -0,0 +1,342 @@
+/**
+ * @file: pool.c
+ *
+ * @description: A reusable thread pool that runs loops over id ranges in
+ * parallel, balancing uneven work by letting idle threads steal from busy
+ * ones.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h> // for sysconf
+
+#include "pool.h"
+
+/*************
+ * Constants *
+ *************/
+
+// Deques are padded out to this many bytes so that threads working on their
+// own shares don't fight over cache lines.
+#define ACY_POOL_LINE 64
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// One thread's share of the current loop: the ids from next to end. The
+// owner takes grains from next, and thieves take from end.
+struct acy_pool_deque_s {
+  pthread_mutex_t lock;
+  id next;
+  id end;
+};
+typedef struct acy_pool_deque_s acy_pool_deque;
+
+union acy_pool_slot_u {
+  acy_pool_deque deque;
+  char padding[ACY_POOL_LINE];
+};
+typedef union acy_pool_slot_u acy_pool_slot;
+
+// A worker thread's view of its pool.
+struct acy_pool_worker_s {
+  acy_pool *pool;
+  id index;
+};
+typedef struct acy_pool_worker_s acy_pool_worker;
+
+struct acy_pool_s {
+  id n_threads;
+  pthread_t *threads; // n_threads - 1 of them; the caller is worker 0
+  acy_pool_worker *workers;
+  acy_pool_slot *slots; // one per thread
+
+  pthread_mutex_t busy; // held for the duration of each loop
+
+  // The current loop (protected by lock while workers are waking up):
+  pthread_mutex_t lock;
+  pthread_cond_t loop_ready;
+  pthread_cond_t loop_done;
+  id generation; // counts loops, so that workers can tell a new one started
+  id active; // workers still running the current loop
+  int stopping;
+  id grain;
+  acy_range_fn body;
+  void *context;
+};
+
+/***********
+ * Globals *
+ ***********/
+
+// The pool whose loop the current thread is running, if any, and its index
+// there (used to run nested loops in place).
+static _Thread_local acy_pool *acy_thread_pool = NULL;
+static _Thread_local id acy_thread_pool_worker = 0;
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Takes the next grain from the front of a thread's own share. Returns 0 if
+// the share is empty.
+static int acy_pool_take(
+  acy_pool_deque *deque,
+  id grain,
+  id *r_start,
+  id *r_end
+) {
+  int found = 0;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->next < deque->end) {
+    *r_start = deque->next;
+    *r_end = deque->next + acy_min(grain, deque->end - deque->next);
+    deque->next = *r_end;
+    found = 1;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+// Steals the back half (at least one grain, if there's that much) of another
+// thread's share. Returns 0 if the share is empty.
+static int acy_pool_steal(
+  acy_pool_deque *victim,
+  id grain,
+  id *r_start,
+  id *r_end
+) {
+  int found = 0;
+  pthread_mutex_lock(&victim->lock);
+  if (victim->next < victim->end) {
+    id remaining = victim->end - victim->next;
+    id stolen = acy_min(remaining, acy_max(remaining / 2, grain));
+    *r_end = victim->end;
+    *r_start = victim->end - stolen;
+    victim->end = *r_start;
+    found = 1;
+  }
+  pthread_mutex_unlock(&victim->lock);
+  return found;
+}
+
+// Runs the current loop as the given worker until no work is left anywhere.
+static void acy_pool_run(acy_pool *pool, id worker) {
+  acy_pool_deque *own = &pool->slots[worker].deque;
+  id grain = pool->grain;
+  acy_range_fn body = pool->body;
+  void *context = pool->context;
+  acy_thread_pool = pool;
+  acy_thread_pool_worker = worker;
+  id start, end;
+  while (1) {
+    while (acy_pool_take(own, grain, &start, &end)) {
+      body(start, end, worker, context);
+    }
+    // Look for a victim, starting with our neighbor so that thieves spread
+    // out:
+    int stole = 0;
+    for (id i = 1; i < pool->n_threads; ++i) {
+      id victim = (worker + i) % pool->n_threads;
+      if (acy_pool_steal(&pool->slots[victim].deque, grain, &start, &end)) {
+        stole = 1;
+        break;
+      }
+    }
+    if (!stole) {
+      break; // everything has been handed out
+    }
+    // Put the stolen range in our own share so that others can steal from
+    // it in turn:
+    pthread_mutex_lock(&own->lock);
+    own->next = start;
+    own->end = end;
+    pthread_mutex_unlock(&own->lock);
+  }
+  acy_thread_pool = NULL;
+  acy_thread_pool_worker = 0;
+}
+
+static void *acy_pool_worker_main(void *arg) {
+  acy_pool_worker *self = (acy_pool_worker*) arg;
+  acy_pool *pool = self->pool;
+  id seen = 0;
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (pool->generation == seen && !pool->stopping) {
+      pthread_cond_wait(&pool->loop_ready, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    acy_pool_run(pool, self->index);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active -= 1;
+    if (pool->active == 0) {
+      pthread_cond_signal(&pool->loop_done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+// Runs a whole range on the calling thread, one grain at a time.
+static void acy_serial_for(
+  id start,
+  id end,
+  id grain,
+  id worker,
+  acy_range_fn body,
+  void *context
+) {
+  while (start < end) {
+    id stop = start + acy_min(grain, end - start);
+    body(start, stop, worker, context);
+    start = stop;
+  }
+}
+
+/*************
+ * Functions *
+ *************/
+
+acy_pool * acy_create_pool(id n_threads) {
+  if (n_threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = online > 0 ? (id) online : 1;
+  }
+  acy_pool *pool = (acy_pool*) calloc(1, sizeof(acy_pool));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->n_threads = n_threads;
+  pool->threads = (pthread_t*) malloc(n_threads * sizeof(pthread_t));
+  pool->workers = (acy_pool_worker*) malloc(
+    n_threads * sizeof(acy_pool_worker)
+  );
+  pool->slots = (acy_pool_slot*) calloc(n_threads, sizeof(acy_pool_slot));
+  if (pool->threads == NULL || pool->workers == NULL || pool->slots == NULL) {
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->slots);
+    free(pool);
+    return NULL;
+  }
+  for (id i = 0; i < n_threads; ++i) {
+    pthread_mutex_init(&pool->slots[i].deque.lock, NULL);
+    pool->workers[i].pool = pool;
+    pool->workers[i].index = i;
+  }
+  pthread_mutex_init(&pool->busy, NULL);
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->loop_ready, NULL);
+  pthread_cond_init(&pool->loop_done, NULL);
+
+  // Worker 0 is whoever calls acy_parallel_for, so start the rest:
+  for (id i = 1; i < n_threads; ++i) {
+    if (
+      pthread_create(
+        &pool->threads[i],
+        NULL,
+        &acy_pool_worker_main,
+        &pool->workers[i]
+      ) != 0
+    ) {
+      pool->n_threads = i; // so that destroy only joins the ones we started
+      acy_destroy_pool(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+void acy_destroy_pool(acy_pool *pool) {
+  if (pool == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  pool->stopping = 1;
+  pthread_cond_broadcast(&pool->loop_ready);
+  pthread_mutex_unlock(&pool->lock);
+  for (id i = 1; i < pool->n_threads; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+  for (id i = 0; i < pool->n_threads; ++i) {
+    pthread_mutex_destroy(&pool->slots[i].deque.lock);
+  }
+  pthread_mutex_destroy(&pool->busy);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->loop_ready);
+  pthread_cond_destroy(&pool->loop_done);
+  free(pool->threads);
+  free(pool->workers);
+  free(pool->slots);
+  free(pool);
+}
+
+id acy_pool_threads(acy_pool const * const pool) {
+  return pool == NULL ? 1 : pool->n_threads;
+}
+
+void acy_parallel_for(
+  acy_pool *pool,
+  id start,
+  id end,
+  id grain,
+  acy_range_fn body,
+  void *context
+) {
+  if (grain == 0) {
+    grain = ACY_POOL_DEFAULT_GRAIN;
+  }
+  if (start >= end) {
+    return;
+  }
+  if (acy_thread_pool != NULL) { // nested inside another loop
+    acy_serial_for(start, end, grain, acy_thread_pool_worker, body, context);
+    return;
+  }
+  if (pool == NULL || pool->n_threads == 1 || end - start <= grain) {
+    acy_serial_for(start, end, grain, 0, body, context);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->busy);
+
+  // Deal out even shares:
+  id n = pool->n_threads;
+  id total = end - start;
+  for (id i = 0; i < n; ++i) {
+    acy_pool_deque *deque = &pool->slots[i].deque;
+    pthread_mutex_lock(&deque->lock);
+    deque->next = start + (total / n) * i + acy_min(i, total % n);
+    deque->end = deque->next + total / n + (i < total % n);
+    pthread_mutex_unlock(&deque->lock);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->grain = grain;
+  pool->body = body;
+  pool->context = context;
+  pool->active = n - 1;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->loop_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  acy_pool_run(pool, 0);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0) {
+    pthread_cond_wait(&pool->loop_done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  pthread_mutex_unlock(&pool->busy);
+}
@@ -0,0 +1,83 @@
+/**
+ * @file: pool.h
+ *
+ * @description: A reusable thread pool that runs loops over id ranges in
+ * parallel, balancing uneven work by letting idle threads steal from busy
+ * ones.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_POOL_H
+#define INCLUDE_POOL_H
+
+#include "core/unit.h" // for "id"
+
+/*************
+ * Constants *
+ *************/
+
+// Grain size used when acy_parallel_for is given a grain of 0. Large enough
+// that the batch functions work in whole chunks and the cost of handing out
+// grains doesn't show.
+#define ACY_POOL_DEFAULT_GRAIN 4096
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Opaque pool type: use acy_create_pool and acy_destroy_pool. A pool owns
+// its worker threads, which sleep between loops.
+//
+// Each thread (including the one that calls acy_parallel_for) starts a loop
+// with an even share of the range, held as a deque of grains: it takes
+// grains from the front of its own share, and once that runs out it steals
+// the back half of someone else's remaining share. So threads that draw the
+// expensive part of a range (e.g., family queries for non-child-bearers)
+// get help instead of holding everyone up.
+struct acy_pool_s;
+typedef struct acy_pool_s acy_pool;
+
+// The body of a parallel loop: handles the ids from start (inclusive) to end
+// (exclusive). The worker argument is the index of the calling thread within
+// the pool (less than acy_pool_threads), for bodies that need scratch space
+// per thread; calls with the same worker index never overlap.
+typedef void (*acy_range_fn)(id start, id end, id worker, void *context);
+
+/*************
+ * Functions *
+ *************/
+
+// Creates a pool that runs loops on n_threads threads in total, counting the
+// caller of acy_parallel_for, so n_threads - 1 threads are started. If
+// n_threads is 0, uses one thread per online CPU. Returns NULL if the
+// threads can't be started.
+acy_pool * acy_create_pool(id n_threads);
+
+// Stops and joins a pool's threads and frees it. Must not be called during a
+// loop. NULL is ignored.
+void acy_destroy_pool(acy_pool *pool);
+
+// Returns the number of threads that a pool runs loops on (1 for a NULL
+// pool).
+id acy_pool_threads(acy_pool const * const pool);
+
+// Calls body on disjoint sub-ranges that together cover start through end
+// (exclusive), each at most grain ids long (ACY_POOL_DEFAULT_GRAIN if grain
+// is 0), and returns once every call has finished. Which thread handles each
+// sub-range varies from run to run, so results should be written by id (e.g.,
+// to out[i - start]) to come out the same regardless of scheduling.
+//
+// With a NULL pool, or when called from inside another loop's body, the
+// whole range runs on the calling thread, in order. Only one loop runs on a
+// pool at a time: concurrent calls from different threads wait their turn.
+void acy_parallel_for(
+  acy_pool *pool,
+  id start,
+  id end,
+  id grain,
+  acy_range_fn body,
+  void *context
+);
+
+#endif // INCLUDE_POOL_H
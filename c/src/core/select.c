@@ -9,48 +9,49 @@
 
 #include <assert.h> // for assert
 #include <math.h> // for log2
+#include <stdlib.h> // for malloc
 #ifdef DEBUG_SELECT
   #include <stdio.h>
 #endif
 
 #include "core/cohort.h" // for cohort operations
+#include "core/permcache.h" // for cached shuffles
 
 #include "select.h"
 
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct acy_select_ctx_s {
+  id parent_cohort_size;
+  id child_cohort_size;
+  id seed;
+  id sub_cohorts; // sub-cohorts per super-cohort (table total × multiplier)
+  id parent_super_cohort_size;
+  id child_super_cohort_size;
+  acy_divisor parent_div;
+  acy_divisor child_div;
+  acy_divisor parent_super_div;
+  acy_divisor sub_cohorts_div;
+  acy_tabulated_ctx tabulated; // for the child super-cohorts
+};
+
 /*************
  * Functions *
  *************/
 
-void acy_select_parent_and_index(
-  id child,
-  id avg_arity,
+// The division loop for acy_select_parent_and_index: repeatedly splits the
+// parents and children of a cohort in two until just one parent is left.
+// Returns that parent's (shuffled) index within its cohort and updates
+// *shuf to be the child's index among that parent's children.
+static inline id acy_select_divide_to_parent(
+  id cohort,
+  id *shuf,
+  id upper_cohort_size,
   id max_arity,
-  id seed,
-  id *r_parent,
-  id *r_index
+  id seed
 ) {
-  // NONE is its own parent and is the NONEth child of that parent:
-  if (child == NONE) {
-    *r_parent = NONE;
-    *r_index = NONE;
-    return;
-  }
-
-  // Un-correct child indices since they're >= parent indices:
-  child -= max_arity;
-
-  // Otherwise we have just one parent per child cohort
-  assert(avg_arity < (max_arity/2));
-  id upper_cohort_size = max_arity / avg_arity; // at least 2, ideally 8+ or so
-
-  // Get from absolute-child to child-within-cohort. Note that children in xth
-  // child cohort have parents in the xth parent cohort.
-  id cohort, inner;
-  acy_mixed_cohort_and_inner(child, max_arity, seed, &cohort, &inner);
-
-  // Shuffle child ID within children cohort:
-  id shuf = acy_cohort_shuffle(inner, max_arity, seed);
-
   id from_upper = 0;
   id to_upper = upper_cohort_size;
   id parents_left = upper_cohort_size;
@@ -72,8 +73,8 @@ void acy_select_parent_and_index(
       seed
     );
 
-    if (shuf >= divide_at) {
-      shuf -= divide_at;
+    if (*shuf >= divide_at) {
+      *shuf -= divide_at;
       from_lower += divide_at;
       from_upper += half_remaining;
     } else {
@@ -84,33 +85,23 @@ void acy_select_parent_and_index(
     children_left = to_lower - from_lower;
   }
 
-  // At this point, we know the child's index within its parent's children:
-  *r_index = shuf;
-
-  // Unshuffle the parent's index (from_upper)
-  id unshuf = acy_rev_cohort_shuffle(from_upper, upper_cohort_size, seed);
-
-  // Escape the cohort to get the parent:
-  *r_parent = acy_mixed_cohort_outer(cohort, unshuf, upper_cohort_size, seed);
+  return from_upper;
 }
 
-id acy_select_nth_child(
-  id parent,
-  id nth,
-  id avg_arity,
+// The division loop for acy_select_nth_child and acy_count_select_children:
+// follows the given (shuffled) parent down through the same splits as
+// acy_select_divide_to_parent. Returns the parent's first (shuffled) child
+// index within the child cohort via r_first, and the number of children it
+// has via r_count.
+static inline void acy_select_divide_to_children(
+  id cohort,
+  id shuf,
+  id upper_cohort_size,
   id max_arity,
-  id seed
+  id seed,
+  id *r_first,
+  id *r_count
 ) {
-  // Otherwise we have just one parent per child cohort
-  assert(avg_arity < (max_arity/2));
-  id cohort;
-  id inner;
-  id upper_cohort_size = max_arity / avg_arity; // at least 2, ideally 8+ or so
-
-  acy_mixed_cohort_and_inner(parent, upper_cohort_size, seed, &cohort, &inner);
-
-  id shuf = acy_cohort_shuffle(inner, upper_cohort_size, seed);
-
   id from_upper = 0;
   id to_upper = upper_cohort_size;
   id parents_left = upper_cohort_size;
@@ -144,12 +135,209 @@ id acy_select_nth_child(
     children_left = to_lower - from_lower;
   }
 
+  *r_first = from_lower;
+  *r_count = children_left;
+}
+
+// The division loop for a whole upper cohort at once: visits every branch of
+// the splits that acy_select_divide_to_children follows for a single parent,
+// writing each (shuffled) parent's first child index into r_offsets. Since
+// each split hands the lower children to the lower parents, the parents'
+// child ranges are contiguous and in order, so parent i's children are
+// r_offsets[i] up to (but not including) r_offsets[i+1].
+static void acy_select_sweep_divisions(
+  id from_upper,
+  id parents_left,
+  id from_lower,
+  id children_left,
+  id divide_at,
+  id seed,
+  id *r_offsets
+) {
+  if (parents_left <= 1 || children_left == 0) {
+    for (id i = 0; i < parents_left; ++i) {
+      r_offsets[from_upper + i] = from_lower;
+    }
+    return;
+  }
+
+  id half_remaining = parents_left/2;
+  divide_at = acy_irrev_smooth_prng(
+    divide_at,
+    children_left,
+    acy_min(2, parents_left),
+    seed
+  );
+
+  acy_select_sweep_divisions(
+    from_upper,
+    half_remaining,
+    from_lower,
+    divide_at,
+    divide_at,
+    seed,
+    r_offsets
+  );
+  acy_select_sweep_divisions(
+    from_upper + half_remaining,
+    parents_left - half_remaining,
+    from_lower + divide_at,
+    children_left - divide_at,
+    divide_at,
+    seed,
+    r_offsets
+  );
+}
+
+// Fills in the CSR offsets for a whole cohort (see acy_select_sweep_divisions).
+static inline void acy_select_cohort_offsets(
+  id cohort,
+  id upper_cohort_size,
+  id max_arity,
+  id seed,
+  id *r_offsets
+) {
+  acy_select_sweep_divisions(
+    0,
+    upper_cohort_size,
+    0,
+    max_arity,
+    cohort + seed,
+    seed,
+    r_offsets
+  );
+  r_offsets[upper_cohort_size] = max_arity;
+}
+
+// Fills in r_outers[i] with the outer ID (plus adjust) of shuffled index i
+// within the given mixed cohort, so that
+//
+//   r_outers[i] == adjust + acy_mixed_cohort_outer(
+//     cohort,
+//     acy_rev_cohort_shuffle(i, cohort_size, seed),
+//     cohort_size,
+//     seed
+//   )
+//
+// A mixed cohort only ever unshuffles with one of two seeds, so three plans
+// cover the whole cohort.
+static void acy_select_mixed_outers(
+  id cohort,
+  id cohort_size,
+  id seed,
+  id adjust,
+  id *r_outers
+) {
+  acy_shuffle_plan plan, lower_plan, upper_plan;
+  acy_shuffle_plan_init(&plan, cohort_size, seed);
+  acy_shuffle_plan_init(&lower_plan, cohort_size, seed + cohort - 1);
+  acy_shuffle_plan_init(&upper_plan, cohort_size, seed + cohort);
+  for (id i = 0; i < cohort_size; ++i) {
+    id inner = acy_planned_rev_cohort_shuffle(i, &plan);
+    id outer;
+    if (inner < cohort_size/2) {
+      outer = acy_cohort_outer(
+        cohort - 1,
+        acy_planned_rev_cohort_shuffle(inner, &lower_plan),
+        cohort_size
+      );
+    } else {
+      outer = acy_cohort_outer(
+        cohort,
+        acy_planned_rev_cohort_shuffle(inner, &upper_plan),
+        cohort_size
+      );
+    }
+    r_outers[i] = outer + adjust;
+  }
+}
+
+void acy_select_parent_and_index(
+  id child,
+  id avg_arity,
+  id max_arity,
+  id seed,
+  id *r_parent,
+  id *r_index
+) {
+  // NONE is its own parent and is the NONEth child of that parent:
+  if (child == NONE) {
+    *r_parent = NONE;
+    *r_index = NONE;
+    return;
+  }
+
+  // Un-correct child indices since they're >= parent indices:
+  child -= max_arity;
+
+  // Otherwise we have just one parent per child cohort
+  assert(avg_arity < (max_arity/2));
+  id upper_cohort_size = max_arity / avg_arity; // at least 2, ideally 8+ or so
+
+  // Get from absolute-child to child-within-cohort. Note that children in xth
+  // child cohort have parents in the xth parent cohort.
+  id cohort, inner;
+  acy_mixed_cohort_and_inner(child, max_arity, seed, &cohort, &inner);
+
+  // Shuffle child ID within children cohort:
+  id shuf = acy_cached_cohort_shuffle(inner, max_arity, seed);
+
+  id from_upper = acy_select_divide_to_parent(
+    cohort,
+    &shuf,
+    upper_cohort_size,
+    max_arity,
+    seed
+  );
+
+  // At this point, we know the child's index within its parent's children:
+  *r_index = shuf;
+
+  // Unshuffle the parent's index (from_upper)
+  id unshuf = acy_cached_rev_cohort_shuffle(
+    from_upper,
+    upper_cohort_size,
+    seed
+  );
+
+  // Escape the cohort to get the parent:
+  *r_parent = acy_mixed_cohort_outer(cohort, unshuf, upper_cohort_size, seed);
+}
+
+id acy_select_nth_child(
+  id parent,
+  id nth,
+  id avg_arity,
+  id max_arity,
+  id seed
+) {
+  // Otherwise we have just one parent per child cohort
+  assert(avg_arity < (max_arity/2));
+  id cohort;
+  id inner;
+  id upper_cohort_size = max_arity / avg_arity; // at least 2, ideally 8+ or so
+
+  acy_mixed_cohort_and_inner(parent, upper_cohort_size, seed, &cohort, &inner);
+
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    cohort,
+    shuf,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
   if (nth >= children_left) {
     return NONE;
   }
 
   // Unshuffle child ID within children cohort:
-  id unshuf = acy_rev_cohort_shuffle(from_lower + nth, max_arity, seed);
+  id unshuf = acy_cached_rev_cohort_shuffle(from_lower + nth, max_arity, seed);
 
   // Get back from child-within-cohort to absolute-child. Note that children of
   // parents in the xth parent cohort are assigned to the xth child cohort.
@@ -173,44 +361,210 @@ id acy_count_select_children(
 
   acy_mixed_cohort_and_inner(parent, upper_cohort_size, seed, &cohort, &inner);
 
-  id shuf = acy_cohort_shuffle(inner, upper_cohort_size, seed);
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
 
-  id from_upper = 0;
-  id to_upper = upper_cohort_size;
-  id parents_left = upper_cohort_size;
-  id half_remaining;
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    cohort,
+    shuf,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    &from_lower,
+    &children_left
+  );
 
-  id from_lower = 0;
-  id to_lower = max_arity;
-  id children_left = max_arity;
+  return children_left;
+}
 
-  id divide_at = cohort + seed;
+id acy_select_children(
+  id parent,
+  id avg_arity,
+  id max_arity,
+  id seed,
+  id *out,
+  id cap
+) {
+  assert(avg_arity < (max_arity/2));
+  id cohort;
+  id inner;
+  id upper_cohort_size = max_arity / avg_arity;
 
-  while (parents_left > 1 && children_left > 0) {
+  acy_mixed_cohort_and_inner(parent, upper_cohort_size, seed, &cohort, &inner);
 
-    half_remaining = parents_left/2;
-    divide_at = acy_irrev_smooth_prng(
-      divide_at,
-      children_left,
-      acy_min(2, parents_left),
-      seed
-    );
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
 
-    if (shuf >= half_remaining) {
-      shuf -= half_remaining;
-      from_lower += divide_at;
-      from_upper += half_remaining;
-    } else {
-      to_lower -= (children_left - divide_at);
-      to_upper -= (parents_left - half_remaining);
-    }
-    parents_left = to_upper - from_upper;
-    children_left = to_lower - from_lower;
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    cohort,
+    shuf,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  id n = acy_min(children_left, cap);
+  if (n == 0) {
+    return children_left;
+  }
+
+  // All children are unshuffled within the same child cohort:
+  acy_shuffle_plan plan;
+  acy_shuffle_plan_init(&plan, max_arity, seed);
+  for (id nth = 0; nth < n; ++nth) {
+    id unshuf = acy_planned_rev_cohort_shuffle(from_lower + nth, &plan);
+    out[nth] = acy_mixed_cohort_outer(cohort, unshuf, max_arity, seed);
+    out[nth] += max_arity;
   }
 
   return children_left;
 }
 
+void acy_select_cohort_children(
+  id cohort,
+  id avg_arity,
+  id max_arity,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+) {
+  assert(avg_arity < (max_arity/2));
+  id upper_cohort_size = max_arity / avg_arity;
+
+  acy_select_cohort_offsets(
+    cohort,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    r_offsets
+  );
+
+  if (r_parents != NULL) {
+    acy_select_mixed_outers(cohort, upper_cohort_size, seed, 0, r_parents);
+  }
+  if (r_children != NULL) {
+    acy_select_mixed_outers(cohort, max_arity, seed, max_arity, r_children);
+  }
+}
+
+void acy_select_init_divisors(
+  id avg_arity,
+  id max_arity,
+  acy_divisor *r_upper_div,
+  acy_divisor *r_max_div
+) {
+  assert(avg_arity < (max_arity/2));
+  acy_divisor_init(r_upper_div, max_arity / avg_arity);
+  acy_divisor_init(r_max_div, max_arity);
+}
+
+void acy_select_parent_and_index_div(
+  id child,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed,
+  id *r_parent,
+  id *r_index
+) {
+  if (child == NONE) {
+    *r_parent = NONE;
+    *r_index = NONE;
+    return;
+  }
+
+  id max_arity = max_div->d;
+  id upper_cohort_size = upper_div->d;
+  child -= max_arity;
+
+  id cohort, inner;
+  acy_mixed_cohort_and_inner_div(child, max_div, seed, &cohort, &inner);
+
+  id shuf = acy_cached_cohort_shuffle(inner, max_arity, seed);
+
+  id from_upper = acy_select_divide_to_parent(
+    cohort,
+    &shuf,
+    upper_cohort_size,
+    max_arity,
+    seed
+  );
+
+  *r_index = shuf;
+
+  id unshuf = acy_cached_rev_cohort_shuffle(
+    from_upper,
+    upper_cohort_size,
+    seed
+  );
+
+  *r_parent = acy_mixed_cohort_outer(cohort, unshuf, upper_cohort_size, seed);
+}
+
+id acy_select_nth_child_div(
+  id parent,
+  id nth,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed
+) {
+  id max_arity = max_div->d;
+  id upper_cohort_size = upper_div->d;
+
+  id cohort, inner;
+  acy_mixed_cohort_and_inner_div(parent, upper_div, seed, &cohort, &inner);
+
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    cohort,
+    shuf,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  if (nth >= children_left) {
+    return NONE;
+  }
+
+  id unshuf = acy_cached_rev_cohort_shuffle(from_lower + nth, max_arity, seed);
+
+  id child = acy_mixed_cohort_outer(cohort, unshuf, max_arity, seed);
+
+  return child + max_arity;
+}
+
+id acy_count_select_children_div(
+  id parent,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed
+) {
+  id cohort, inner;
+  acy_mixed_cohort_and_inner_div(parent, upper_div, seed, &cohort, &inner);
+
+  id shuf = acy_cached_cohort_shuffle(inner, upper_div->d, seed);
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    cohort,
+    shuf,
+    upper_div->d,
+    max_div->d,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  return children_left;
+}
+
 id acy_select_exp_earliest_possible_child(
   id parent,
   id avg_arity,
@@ -348,7 +702,7 @@ void acy_select_exp_parent_and_index(
 #endif
 
   // shuffle within the exponential cohort:
-  inner = acy_cohort_shuffle(inner, lower_cohort_size, seed);
+  inner = acy_cached_cohort_shuffle(inner, lower_cohort_size, seed);
 
 #ifdef DEBUG_SELECT
   fprintf(stderr, "select_exp_parent_and_index::shuffled_inner::%lu\n", inner);
@@ -379,7 +733,7 @@ void acy_select_exp_parent_and_index(
 #endif
 
   // Shuffle child ID within children cohort:
-  id shuf = acy_cohort_shuffle(inner, max_arity, seed);
+  id shuf = acy_cached_cohort_shuffle(inner, max_arity, seed);
 
 #ifdef DEBUG_SELECT
   fprintf(stderr, "select_exp_parent_and_index::child_shuf::%lu\n", shuf);
@@ -425,7 +779,11 @@ void acy_select_exp_parent_and_index(
   *r_index = shuf;
 
   // Unshuffle the parent's index (from_upper)
-  id unshuf = acy_rev_cohort_shuffle(from_upper, upper_cohort_size, seed);
+  id unshuf = acy_cached_rev_cohort_shuffle(
+    from_upper,
+    upper_cohort_size,
+    seed
+  );
 
 #ifdef DEBUG_SELECT
   fprintf(stderr, "select_exp_parent_and_index::parent_unshuf::%lu\n", unshuf);
@@ -479,7 +837,7 @@ id acy_select_exp_nth_child(
 #endif
 
   acy_cohort_and_inner(parent, upper_cohort_size, &parent_cohort, &inner);
-  id shuf = acy_cohort_shuffle(inner, upper_cohort_size, seed);
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
 
 #ifdef DEBUG_SELECT
   fprintf(
@@ -537,7 +895,7 @@ id acy_select_exp_nth_child(
 #endif
 
   // Unshuffle child ID within children cohort:
-  id unshuf = acy_rev_cohort_shuffle(from_lower + nth, max_arity, seed);
+  id unshuf = acy_cached_rev_cohort_shuffle(from_lower + nth, max_arity, seed);
 
 #ifdef DEBUG_SELECT
   fprintf(
@@ -567,7 +925,7 @@ id acy_select_exp_nth_child(
 #endif
 
   // Unshuffle within exponential cohort
-  unshuf = acy_rev_cohort_shuffle(outer, lower_cohort_size, seed);
+  unshuf = acy_cached_rev_cohort_shuffle(outer, lower_cohort_size, seed);
 
 #ifdef DEBUG_SELECT
   fprintf(
@@ -616,6 +974,119 @@ id acy_select_exp_nth_child(
   return adjusted;
 }
 
+id acy_select_exp_children(
+  id parent,
+  id avg_arity,
+  id max_arity,
+  double exp_cohort_shape,
+  id exp_cohort_size,
+  id exp_cohort_layers,
+  id seed,
+  id *out,
+  id cap
+) {
+  assert(avg_arity < (max_arity/2));
+  id parent_cohort;
+  id inner;
+  id upper_cohort_size = max_arity / avg_arity;
+  id lower_cohort_size = max_arity * exp_cohort_size;
+
+  acy_cohort_and_inner(parent, upper_cohort_size, &parent_cohort, &inner);
+  id shuf = acy_cached_cohort_shuffle(inner, upper_cohort_size, seed);
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    parent_cohort,
+    shuf,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  id n = acy_min(children_left, cap);
+  if (n == 0) {
+    return children_left;
+  }
+
+  // Every child goes through the same pair of unshuffles, and lands in the
+  // same sub-cohort of the same exponential super-cohort:
+  acy_shuffle_plan sub_plan, super_plan;
+  acy_shuffle_plan_init(&sub_plan, max_arity, seed);
+  acy_shuffle_plan_init(&super_plan, lower_cohort_size, seed);
+  id sub_cohort = parent_cohort % exp_cohort_size;
+  id super_cohort = parent_cohort / exp_cohort_size;
+  for (id nth = 0; nth < n; ++nth) {
+    id unshuf = acy_planned_rev_cohort_shuffle(from_lower + nth, &sub_plan);
+    id outer = acy_cohort_outer(sub_cohort, unshuf, max_arity);
+    unshuf = acy_planned_rev_cohort_shuffle(outer, &super_plan);
+    out[nth] = acy_multiexp_cohort_outer(
+      super_cohort,
+      unshuf,
+      exp_cohort_shape,
+      lower_cohort_size,
+      exp_cohort_layers,
+      seed
+    );
+  }
+
+  return children_left;
+}
+
+void acy_select_exp_cohort_children(
+  id parent_cohort,
+  id avg_arity,
+  id max_arity,
+  double exp_cohort_shape,
+  id exp_cohort_size,
+  id exp_cohort_layers,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+) {
+  assert(avg_arity < (max_arity/2));
+  id upper_cohort_size = max_arity / avg_arity;
+  id lower_cohort_size = max_arity * exp_cohort_size;
+
+  acy_select_cohort_offsets(
+    parent_cohort,
+    upper_cohort_size,
+    max_arity,
+    seed,
+    r_offsets
+  );
+
+  acy_shuffle_plan plan, super_plan;
+  if (r_parents != NULL) {
+    acy_shuffle_plan_init(&plan, upper_cohort_size, seed);
+    for (id i = 0; i < upper_cohort_size; ++i) {
+      id unshuf = acy_planned_rev_cohort_shuffle(i, &plan);
+      r_parents[i] = acy_cohort_outer(parent_cohort, unshuf, upper_cohort_size);
+    }
+  }
+  if (r_children != NULL) {
+    acy_shuffle_plan_init(&plan, max_arity, seed);
+    acy_shuffle_plan_init(&super_plan, lower_cohort_size, seed);
+    id sub_cohort = parent_cohort % exp_cohort_size;
+    id super_cohort = parent_cohort / exp_cohort_size;
+    for (id i = 0; i < max_arity; ++i) {
+      id unshuf = acy_planned_rev_cohort_shuffle(i, &plan);
+      id outer = acy_cohort_outer(sub_cohort, unshuf, max_arity);
+      unshuf = acy_planned_rev_cohort_shuffle(outer, &super_plan);
+      r_children[i] = acy_multiexp_cohort_outer(
+        super_cohort,
+        unshuf,
+        exp_cohort_shape,
+        lower_cohort_size,
+        exp_cohort_layers,
+        seed
+      );
+    }
+  }
+}
+
 id acy_select_poly_earliest_possible_child(
   id parent,
   id parent_cohort_size,
@@ -775,7 +1246,7 @@ void acy_select_poly_parent_and_index(
 #endif
 
   // reverse shuffle within cohort
-  id shuf = acy_rev_cohort_shuffle(
+  id shuf = acy_cached_rev_cohort_shuffle(
     super_inner,
     child_super_cohort_size,
     seed + super_cohort
@@ -806,7 +1277,7 @@ void acy_select_poly_parent_and_index(
 #endif
 
   // Shuffle child ID within children cohort:
-  id inner_shuf = acy_cohort_shuffle(
+  id inner_shuf = acy_cached_cohort_shuffle(
     sub_inner,
     child_cohort_size,
     seed + sub_cohort
@@ -1030,7 +1501,7 @@ id acy_select_poly_nth_child(
 #endif
 
   // Unshuffle child ID within children cohort:
-  id child_sub_inner = acy_rev_cohort_shuffle(
+  id child_sub_inner = acy_cached_rev_cohort_shuffle(
     from_lower + nth,
     child_cohort_size,
     seed + parent_sub_cohort
@@ -1054,7 +1525,7 @@ id acy_select_poly_nth_child(
   );
 
   // shuffle within child super cohort:
-  id shuf = acy_cohort_shuffle(
+  id shuf = acy_cached_cohort_shuffle(
     child_super_inner,
     child_super_cohort_size,
     seed + parent_super_cohort
@@ -1085,6 +1556,157 @@ id acy_select_poly_nth_child(
   return adjusted;
 }
 
+id acy_select_poly_children(
+  id parent,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id poly_cohort_base,
+  id poly_cohort_shape,
+  id seed,
+  id *out,
+  id cap
+) {
+  // Cohort sizes (see acy_select_poly_nth_child):
+  id child_super_cohort_size = acy_quadsum(poly_cohort_base, poly_cohort_shape);
+  id parent_super_cohort_size = (
+    parent_cohort_size
+  * (child_super_cohort_size / child_cohort_size)
+  );
+  if (child_super_cohort_size % child_cohort_size > 0) {
+    parent_super_cohort_size += parent_cohort_size;
+  }
+
+  id parent_super_cohort, parent_super_inner;
+  acy_cohort_and_inner(
+    parent,
+    parent_super_cohort_size,
+    &parent_super_cohort,
+    &parent_super_inner
+  );
+
+  id parent_sub_cohort, parent_sub_inner;
+  acy_cohort_and_inner(
+    parent_super_inner,
+    parent_cohort_size,
+    &parent_sub_cohort,
+    &parent_sub_inner
+  );
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    parent_sub_cohort,
+    parent_sub_inner,
+    parent_cohort_size,
+    child_cohort_size,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  id n = acy_min(children_left, cap);
+  if (n == 0) {
+    return children_left;
+  }
+
+  acy_shuffle_plan sub_plan, super_plan;
+  acy_shuffle_plan_init(&sub_plan, child_cohort_size, seed + parent_sub_cohort);
+  acy_shuffle_plan_init(
+    &super_plan,
+    child_super_cohort_size,
+    seed + parent_super_cohort
+  );
+  for (id nth = 0; nth < n; ++nth) {
+    id child_sub_inner = acy_planned_rev_cohort_shuffle(
+      from_lower + nth,
+      &sub_plan
+    );
+    id child_super_inner = acy_cohort_outer(
+      parent_sub_cohort,
+      child_sub_inner,
+      child_cohort_size
+    );
+    id shuf = acy_planned_cohort_shuffle(child_super_inner, &super_plan);
+    out[nth] = acy_multipoly_cohort_outer(
+      parent_super_cohort,
+      shuf,
+      poly_cohort_base,
+      poly_cohort_shape,
+      seed
+    );
+  }
+
+  return children_left;
+}
+
+void acy_select_poly_cohort_children(
+  id parent_cohort,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id poly_cohort_base,
+  id poly_cohort_shape,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+) {
+  id child_super_cohort_size = acy_quadsum(poly_cohort_base, poly_cohort_shape);
+  id sub_cohorts = child_super_cohort_size / child_cohort_size;
+  if (child_super_cohort_size % child_cohort_size > 0) {
+    sub_cohorts += 1;
+  }
+  id parent_super_cohort_size = parent_cohort_size * sub_cohorts;
+  id parent_super_cohort = parent_cohort / sub_cohorts;
+  id parent_sub_cohort = parent_cohort % sub_cohorts;
+
+  // Parents aren't shuffled within their sub-cohort here:
+  acy_select_cohort_offsets(
+    parent_sub_cohort,
+    parent_cohort_size,
+    child_cohort_size,
+    seed,
+    r_offsets
+  );
+
+  if (r_parents != NULL) {
+    for (id i = 0; i < parent_cohort_size; ++i) {
+      r_parents[i] = acy_cohort_outer(
+        parent_super_cohort,
+        acy_cohort_outer(parent_sub_cohort, i, parent_cohort_size),
+        parent_super_cohort_size
+      );
+    }
+  }
+  if (r_children != NULL) {
+    acy_shuffle_plan sub_plan, super_plan;
+    acy_shuffle_plan_init(
+      &sub_plan,
+      child_cohort_size,
+      seed + parent_sub_cohort
+    );
+    acy_shuffle_plan_init(
+      &super_plan,
+      child_super_cohort_size,
+      seed + parent_super_cohort
+    );
+    for (id i = 0; i < child_cohort_size; ++i) {
+      id child_sub_inner = acy_planned_rev_cohort_shuffle(i, &sub_plan);
+      id child_super_inner = acy_cohort_outer(
+        parent_sub_cohort,
+        child_sub_inner,
+        child_cohort_size
+      );
+      id shuf = acy_planned_cohort_shuffle(child_super_inner, &super_plan);
+      r_children[i] = acy_multipoly_cohort_outer(
+        parent_super_cohort,
+        shuf,
+        poly_cohort_base,
+        poly_cohort_shape,
+        seed
+      );
+    }
+  }
+}
+
 
 // Inverse of acy_select_table_nth_child
 void acy_select_table_parent_and_index(
@@ -1169,7 +1791,7 @@ void acy_select_table_parent_and_index(
 #endif
 
   // reverse shuffle within cohort
-  id shuf = acy_rev_cohort_shuffle(
+  id shuf = acy_cached_rev_cohort_shuffle(
     super_inner,
     child_super_cohort_size,
     seed + super_cohort
@@ -1261,7 +1883,7 @@ void acy_select_table_parent_and_index(
   );
 
   // Unshuffle in parent super cohort:
-  id parent_super_unshuf = acy_rev_cohort_shuffle(
+  id parent_super_unshuf = acy_cached_rev_cohort_shuffle(
     parent_super_inner,
     parent_super_cohort_size,
     seed + super_cohort
@@ -1355,7 +1977,7 @@ id acy_select_table_nth_child(
   );
 
   // Shuffle parent within parent super cohort:
-  id parent_super_inner_shuf = acy_cohort_shuffle(
+  id parent_super_inner_shuf = acy_cached_cohort_shuffle(
     parent_super_inner,
     parent_super_cohort_size,
     seed + parent_super_cohort
@@ -1457,7 +2079,7 @@ id acy_select_table_nth_child(
   );
 
   // shuffle within child super cohort:
-  id shuf = acy_cohort_shuffle(
+  id shuf = acy_cached_cohort_shuffle(
     child_super_inner,
     child_super_cohort_size,
     seed + parent_super_cohort
@@ -1545,7 +2167,7 @@ id acy_count_select_table_children(
   );
 
   // Shuffle parent within parent super cohort:
-  id parent_super_inner_shuf = acy_cohort_shuffle(
+  id parent_super_inner_shuf = acy_cached_cohort_shuffle(
     parent_super_inner,
     parent_super_cohort_size,
     seed + parent_super_cohort
@@ -1617,6 +2239,169 @@ id acy_count_select_table_children(
   return children_left;
 }
 
+id acy_select_table_children(
+  id parent,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed,
+  id *out,
+  id cap
+) {
+  // Super-cohort sizes (same # of sub-cohorts in each):
+  id sumtable_total = acy_table_total(
+    children_sumtable_size,
+    children_sumtable
+  );
+  id child_super_cohort_size = (
+    sumtable_total
+  * table_extra_multiplier
+  * child_cohort_size
+  );
+  id parent_super_cohort_size = (
+    sumtable_total
+  * table_extra_multiplier
+  * parent_cohort_size
+  );
+
+  id parent_super_cohort, parent_super_inner;
+  acy_cohort_and_inner(
+    parent,
+    parent_super_cohort_size,
+    &parent_super_cohort,
+    &parent_super_inner
+  );
+
+  id parent_super_inner_shuf = acy_cached_cohort_shuffle(
+    parent_super_inner,
+    parent_super_cohort_size,
+    seed + parent_super_cohort
+  );
+
+  id parent_sub_cohort, parent_sub_inner;
+  acy_cohort_and_inner(
+    parent_super_inner_shuf,
+    parent_cohort_size,
+    &parent_sub_cohort,
+    &parent_sub_inner
+  );
+
+  id from_lower, children_left;
+  acy_select_divide_to_children(
+    parent_sub_cohort,
+    parent_sub_inner,
+    parent_cohort_size,
+    child_cohort_size,
+    seed,
+    &from_lower,
+    &children_left
+  );
+
+  id n = acy_min(children_left, cap);
+  if (n == 0) {
+    return children_left;
+  }
+
+  // All children share a super-cohort shuffle:
+  acy_shuffle_plan super_plan;
+  acy_shuffle_plan_init(
+    &super_plan,
+    child_super_cohort_size,
+    seed + parent_super_cohort
+  );
+  for (id nth = 0; nth < n; ++nth) {
+    id child_super_inner = acy_cohort_outer(
+      parent_sub_cohort,
+      from_lower + nth,
+      child_cohort_size
+    );
+    id shuf = acy_planned_cohort_shuffle(child_super_inner, &super_plan);
+    out[nth] = acy_tabulated_cohort_outer(
+      parent_super_cohort,
+      shuf,
+      children_sumtable,
+      children_sumtable_size,
+      child_cohort_size * table_extra_multiplier,
+      seed
+    );
+  }
+
+  return children_left;
+}
+
+void acy_select_table_cohort_children(
+  id parent_cohort,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+) {
+  id sub_cohorts = (
+    acy_table_total(children_sumtable_size, children_sumtable)
+  * table_extra_multiplier
+  );
+  id child_super_cohort_size = sub_cohorts * child_cohort_size;
+  id parent_super_cohort_size = sub_cohorts * parent_cohort_size;
+  id parent_super_cohort = parent_cohort / sub_cohorts;
+  id parent_sub_cohort = parent_cohort % sub_cohorts;
+
+  acy_select_cohort_offsets(
+    parent_sub_cohort,
+    parent_cohort_size,
+    child_cohort_size,
+    seed,
+    r_offsets
+  );
+
+  acy_shuffle_plan plan;
+  if (r_parents != NULL) {
+    acy_shuffle_plan_init(
+      &plan,
+      parent_super_cohort_size,
+      seed + parent_super_cohort
+    );
+    for (id i = 0; i < parent_cohort_size; ++i) {
+      id unshuf = acy_planned_rev_cohort_shuffle(
+        acy_cohort_outer(parent_sub_cohort, i, parent_cohort_size),
+        &plan
+      );
+      r_parents[i] = acy_cohort_outer(
+        parent_super_cohort,
+        unshuf,
+        parent_super_cohort_size
+      );
+    }
+  }
+  if (r_children != NULL) {
+    acy_shuffle_plan_init(
+      &plan,
+      child_super_cohort_size,
+      seed + parent_super_cohort
+    );
+    for (id i = 0; i < child_cohort_size; ++i) {
+      id shuf = acy_planned_cohort_shuffle(
+        acy_cohort_outer(parent_sub_cohort, i, child_cohort_size),
+        &plan
+      );
+      r_children[i] = acy_tabulated_cohort_outer(
+        parent_super_cohort,
+        shuf,
+        children_sumtable,
+        children_sumtable_size,
+        child_cohort_size * table_extra_multiplier,
+        seed
+      );
+    }
+  }
+}
+
 
 id acy_select_table_earliest_possible_child(
   id parent,
@@ -1704,3 +2489,452 @@ id acy_select_table_child_cohort_start(
     child_super_cohort_size
   );
 }
+
+/*********************
+ * Context Functions *
+ *********************/
+
+acy_select_ctx * acy_create_select_ctx(
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed
+) {
+  acy_select_ctx *ctx = (acy_select_ctx*) malloc(sizeof(acy_select_ctx));
+  if (ctx == NULL) {
+    return NULL;
+  }
+  ctx->parent_cohort_size = parent_cohort_size;
+  ctx->child_cohort_size = child_cohort_size;
+  ctx->seed = seed;
+  ctx->sub_cohorts = (
+    acy_table_total(children_sumtable_size, children_sumtable)
+  * table_extra_multiplier
+  );
+  ctx->parent_super_cohort_size = ctx->sub_cohorts * parent_cohort_size;
+  ctx->child_super_cohort_size = ctx->sub_cohorts * child_cohort_size;
+  acy_divisor_init(&ctx->parent_div, parent_cohort_size);
+  acy_divisor_init(&ctx->child_div, child_cohort_size);
+  acy_divisor_init(&ctx->parent_super_div, ctx->parent_super_cohort_size);
+  acy_divisor_init(&ctx->sub_cohorts_div, ctx->sub_cohorts);
+  if (
+    !acy_create_tabulated_ctx(
+      children_sumtable,
+      children_sumtable_size,
+      child_cohort_size * table_extra_multiplier,
+      seed,
+      &ctx->tabulated
+    )
+  ) {
+    free(ctx);
+    return NULL;
+  }
+  return ctx;
+}
+
+void acy_destroy_select_ctx(acy_select_ctx *ctx) {
+  if (ctx == NULL) {
+    return;
+  }
+  acy_cleanup_tabulated_ctx(&ctx->tabulated);
+  free(ctx);
+}
+
+// The part of acy_select_table_nth_child that's shared by the _ctx functions:
+// finds the parent's super- and sub-cohorts and runs the division loop.
+static inline void acy_select_table_locate_ctx(
+  id parent,
+  acy_select_ctx const * const ctx,
+  id *r_super_cohort,
+  id *r_sub_cohort,
+  id *r_first,
+  id *r_count
+) {
+  id parent_super_inner, parent_sub_inner;
+  acy_divmod(
+    parent,
+    &ctx->parent_super_div,
+    r_super_cohort,
+    &parent_super_inner
+  );
+
+  id shuf = acy_cached_cohort_shuffle(
+    parent_super_inner,
+    ctx->parent_super_cohort_size,
+    ctx->seed + *r_super_cohort
+  );
+
+  acy_divmod(shuf, &ctx->parent_div, r_sub_cohort, &parent_sub_inner);
+
+  acy_select_divide_to_children(
+    *r_sub_cohort,
+    parent_sub_inner,
+    ctx->parent_cohort_size,
+    ctx->child_cohort_size,
+    ctx->seed,
+    r_first,
+    r_count
+  );
+}
+
+void acy_select_table_parent_and_index_ctx(
+  id child,
+  acy_select_ctx const * const ctx,
+  id *r_parent,
+  id *r_index
+) {
+  if (child == NONE) {
+    *r_parent = NONE;
+    *r_index = NONE;
+    return;
+  }
+
+  id super_cohort, super_inner;
+  acy_tabulated_cohort_and_inner_ctx(
+    child,
+    &ctx->tabulated,
+    &super_cohort,
+    &super_inner
+  );
+
+  id shuf = acy_cached_rev_cohort_shuffle(
+    super_inner,
+    ctx->child_super_cohort_size,
+    ctx->seed + super_cohort
+  );
+
+  id sub_cohort, sub_inner;
+  acy_divmod(shuf, &ctx->child_div, &sub_cohort, &sub_inner);
+
+  id from_upper = acy_select_divide_to_parent(
+    sub_cohort,
+    &sub_inner,
+    ctx->parent_cohort_size,
+    ctx->child_cohort_size,
+    ctx->seed
+  );
+
+  *r_index = sub_inner;
+
+  id parent_super_unshuf = acy_cached_rev_cohort_shuffle(
+    acy_cohort_outer(sub_cohort, from_upper, ctx->parent_cohort_size),
+    ctx->parent_super_cohort_size,
+    ctx->seed + super_cohort
+  );
+
+  *r_parent = acy_cohort_outer(
+    super_cohort,
+    parent_super_unshuf,
+    ctx->parent_super_cohort_size
+  );
+}
+
+void acy_select_table_parent_and_index_batch(
+  id const * const children,
+  id n,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_indices
+) {
+  // The output arrays hold super-cohorts and super-inners until each entry
+  // is finished:
+  acy_tabulated_cohort_and_inner_batch(
+    children,
+    n,
+    &ctx->tabulated,
+    r_parents,
+    r_indices
+  );
+
+  acy_shuffle_plan child_plan, parent_plan;
+  // Super-cohort 0 is valid, so NONE can't mark "no plans yet":
+  int have_plans = 0;
+  id planned = 0; // super-cohort that the plans are for (if have_plans)
+  for (id i = 0; i < n; ++i) {
+    if (children[i] == NONE) {
+      r_parents[i] = NONE;
+      r_indices[i] = NONE;
+      continue;
+    }
+    id super_cohort = r_parents[i];
+    id super_inner = r_indices[i];
+
+    // Only plan for runs of at least two children:
+    int have_match = have_plans && super_cohort == planned;
+    int use_plans = (
+      have_match
+   || (i + 1 < n && r_parents[i + 1] == super_cohort)
+    );
+    if (use_plans && !have_match) {
+      acy_shuffle_plan_init(
+        &child_plan,
+        ctx->child_super_cohort_size,
+        ctx->seed + super_cohort
+      );
+      acy_shuffle_plan_init(
+        &parent_plan,
+        ctx->parent_super_cohort_size,
+        ctx->seed + super_cohort
+      );
+      planned = super_cohort;
+      have_plans = 1;
+    }
+
+    id shuf;
+    if (use_plans) {
+      shuf = acy_planned_rev_cohort_shuffle(super_inner, &child_plan);
+    } else {
+      shuf = acy_cached_rev_cohort_shuffle(
+        super_inner,
+        ctx->child_super_cohort_size,
+        ctx->seed + super_cohort
+      );
+    }
+
+    id sub_cohort, sub_inner;
+    acy_divmod(shuf, &ctx->child_div, &sub_cohort, &sub_inner);
+
+    id from_upper = acy_select_divide_to_parent(
+      sub_cohort,
+      &sub_inner,
+      ctx->parent_cohort_size,
+      ctx->child_cohort_size,
+      ctx->seed
+    );
+
+    id parent_super_inner = acy_cohort_outer(
+      sub_cohort,
+      from_upper,
+      ctx->parent_cohort_size
+    );
+    id unshuf;
+    if (use_plans) {
+      unshuf = acy_planned_rev_cohort_shuffle(parent_super_inner, &parent_plan);
+    } else {
+      unshuf = acy_cached_rev_cohort_shuffle(
+        parent_super_inner,
+        ctx->parent_super_cohort_size,
+        ctx->seed + super_cohort
+      );
+    }
+
+    r_indices[i] = sub_inner;
+    r_parents[i] = acy_cohort_outer(
+      super_cohort,
+      unshuf,
+      ctx->parent_super_cohort_size
+    );
+  }
+}
+
+// Arguments for acy_select_table_parent_and_index_batch_pool.
+struct acy_select_batch_job_s {
+  id const *children;
+  acy_select_ctx const *ctx;
+  id *r_parents;
+  id *r_indices;
+};
+typedef struct acy_select_batch_job_s acy_select_batch_job;
+
+static void acy_select_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_select_batch_job const *job = (acy_select_batch_job const *) context;
+  acy_select_table_parent_and_index_batch(
+    job->children + start,
+    end - start,
+    job->ctx,
+    job->r_parents + start,
+    job->r_indices + start
+  );
+}
+
+void acy_select_table_parent_and_index_batch_pool(
+  id const * const children,
+  id n,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_indices,
+  acy_pool *pool
+) {
+  acy_select_batch_job job = { children, ctx, r_parents, r_indices };
+  acy_parallel_for(pool, 0, n, 0, &acy_select_batch_range, &job);
+}
+
+id acy_select_table_nth_child_ctx(
+  id parent,
+  id nth,
+  acy_select_ctx const * const ctx
+) {
+  id super_cohort, sub_cohort, from_lower, children_left;
+  acy_select_table_locate_ctx(
+    parent,
+    ctx,
+    &super_cohort,
+    &sub_cohort,
+    &from_lower,
+    &children_left
+  );
+
+  if (nth >= children_left) {
+    return NONE;
+  }
+
+  id shuf = acy_cached_cohort_shuffle(
+    acy_cohort_outer(sub_cohort, from_lower + nth, ctx->child_cohort_size),
+    ctx->child_super_cohort_size,
+    ctx->seed + super_cohort
+  );
+
+  return acy_tabulated_cohort_outer_ctx(super_cohort, shuf, &ctx->tabulated);
+}
+
+id acy_count_select_table_children_ctx(
+  id parent,
+  acy_select_ctx const * const ctx
+) {
+  id super_cohort, sub_cohort, from_lower, children_left;
+  acy_select_table_locate_ctx(
+    parent,
+    ctx,
+    &super_cohort,
+    &sub_cohort,
+    &from_lower,
+    &children_left
+  );
+  return children_left;
+}
+
+id acy_select_table_children_ctx(
+  id parent,
+  acy_select_ctx const * const ctx,
+  id *out,
+  id cap
+) {
+  id super_cohort, sub_cohort, from_lower, children_left;
+  acy_select_table_locate_ctx(
+    parent,
+    ctx,
+    &super_cohort,
+    &sub_cohort,
+    &from_lower,
+    &children_left
+  );
+
+  id n = acy_min(children_left, cap);
+  if (n == 0) {
+    return children_left;
+  }
+
+  acy_shuffle_plan super_plan;
+  acy_shuffle_plan_init(
+    &super_plan,
+    ctx->child_super_cohort_size,
+    ctx->seed + super_cohort
+  );
+  for (id nth = 0; nth < n; ++nth) {
+    id shuf = acy_planned_cohort_shuffle(
+      acy_cohort_outer(sub_cohort, from_lower + nth, ctx->child_cohort_size),
+      &super_plan
+    );
+    out[nth] = acy_tabulated_cohort_outer_ctx(
+      super_cohort,
+      shuf,
+      &ctx->tabulated
+    );
+  }
+
+  return children_left;
+}
+
+void acy_select_table_cohort_children_ctx(
+  id parent_cohort,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+) {
+  id parent_super_cohort, parent_sub_cohort;
+  acy_divmod(
+    parent_cohort,
+    &ctx->sub_cohorts_div,
+    &parent_super_cohort,
+    &parent_sub_cohort
+  );
+
+  acy_select_cohort_offsets(
+    parent_sub_cohort,
+    ctx->parent_cohort_size,
+    ctx->child_cohort_size,
+    ctx->seed,
+    r_offsets
+  );
+
+  acy_shuffle_plan plan;
+  if (r_parents != NULL) {
+    acy_shuffle_plan_init(
+      &plan,
+      ctx->parent_super_cohort_size,
+      ctx->seed + parent_super_cohort
+    );
+    for (id i = 0; i < ctx->parent_cohort_size; ++i) {
+      id unshuf = acy_planned_rev_cohort_shuffle(
+        acy_cohort_outer(parent_sub_cohort, i, ctx->parent_cohort_size),
+        &plan
+      );
+      r_parents[i] = acy_cohort_outer(
+        parent_super_cohort,
+        unshuf,
+        ctx->parent_super_cohort_size
+      );
+    }
+  }
+  if (r_children != NULL) {
+    acy_shuffle_plan_init(
+      &plan,
+      ctx->child_super_cohort_size,
+      ctx->seed + parent_super_cohort
+    );
+    for (id i = 0; i < ctx->child_cohort_size; ++i) {
+      id shuf = acy_planned_cohort_shuffle(
+        acy_cohort_outer(parent_sub_cohort, i, ctx->child_cohort_size),
+        &plan
+      );
+      r_children[i] = acy_tabulated_cohort_outer_ctx(
+        parent_super_cohort,
+        shuf,
+        &ctx->tabulated
+      );
+    }
+  }
+}
+
+id acy_select_table_earliest_possible_child_ctx(
+  id parent,
+  acy_select_ctx const * const ctx
+) {
+  return acy_cohort_outer(
+    acy_div(parent, &ctx->parent_super_div),
+    0,
+    ctx->child_super_cohort_size
+  );
+}
+
+id acy_select_table_child_cohort_start_ctx(
+  id child,
+  acy_select_ctx const * const ctx
+) {
+  id super_cohort, super_inner;
+  acy_tabulated_cohort_and_inner_ctx(
+    child,
+    &ctx->tabulated,
+    &super_cohort,
+    &super_inner
+  );
+  return acy_cohort_outer(super_cohort, 0, ctx->child_super_cohort_size);
+}
@@ -11,6 +11,21 @@
 #define INCLUDE_SELECT_H
 
 #include "core/unit.h" // for "id" and unit operations
+#include "core/divide.h" // for precomputed divisors
+#include "core/pool.h" // for acy_pool
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Opaque context type for table-based selection: use acy_create_select_ctx
+// and acy_destroy_select_ctx. A context holds the parameters for the
+// acy_select_table_* functions along with everything that can be worked out
+// from them ahead of time (super-cohort sizes, divisors, and a tabulated
+// cohort context with its search index and shuffle plans). It isn't changed
+// by the _ctx functions, so one context may be shared between threads.
+struct acy_select_ctx_s;
+typedef struct acy_select_ctx_s acy_select_ctx;
 
 /*************
  * Functions *
@@ -49,6 +64,80 @@ id acy_count_select_children(
   id seed
 );
 
+// Lists all of the children of the given parent at once, writing up to cap
+// of them into out so that out[n] == acy_select_nth_child(parent, n, ...).
+// Returns the total number of children (which may be more than cap). Much
+// faster than calling acy_select_nth_child for each child, since the division
+// loop runs only once and the child cohort's shuffle is set up just once.
+id acy_select_children(
+  id parent,
+  id avg_arity,
+  id max_arity,
+  id seed,
+  id *out,
+  id cap
+);
+
+// Works out the children of every parent in a cohort in a single sweep,
+// rather than repeating the division loop for each parent. The cohort is the
+// one that acy_mixed_cohort_and_inner assigns to a parent using a cohort size
+// of max_arity / avg_arity (call that N). The results are written in CSR
+// form, in shuffled parent order: r_parents[i] is the ith parent (N entries),
+// and its children are r_children[r_offsets[i]] up to but not including
+// r_children[r_offsets[i+1]] (r_offsets gets N+1 entries, r_children gets
+// max_arity entries), in the same order as acy_select_nth_child gives them.
+// Either r_parents or r_children may be NULL if they aren't needed: the
+// offsets alone give each parent's child count. The arrays don't depend on
+// anything but the arguments, so they can be kept around and reused.
+void acy_select_cohort_children(
+  id cohort,
+  id avg_arity,
+  id max_arity,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+);
+
+// Sets up the two divisors used by the _div versions of the functions above:
+// r_upper_div divides by the parent cohort size (max_arity / avg_arity) and
+// r_max_div divides by max_arity. Worth it when making many selections with
+// the same arity values.
+void acy_select_init_divisors(
+  id avg_arity,
+  id max_arity,
+  acy_divisor *r_upper_div,
+  acy_divisor *r_max_div
+);
+
+// Versions of acy_select_parent_and_index, acy_select_nth_child, and
+// acy_count_select_children that use divisors from acy_select_init_divisors
+// in place of the avg_arity and max_arity arguments. They give the same
+// results.
+void acy_select_parent_and_index_div(
+  id child,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed,
+  id *r_parent,
+  id *r_index
+);
+
+id acy_select_nth_child_div(
+  id parent,
+  id nth,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed
+);
+
+id acy_count_select_children_div(
+  id parent,
+  acy_divisor const * const upper_div,
+  acy_divisor const * const max_div,
+  id seed
+);
+
 // For exponential cohort selection (see below) returns the earliest possible
 // child of the given parent.
 id acy_select_exp_earliest_possible_child(
@@ -98,6 +187,34 @@ id acy_select_exp_nth_child(
   id seed
 );
 
+// Works like acy_select_children for exponential cohort selection.
+id acy_select_exp_children(
+  id parent,
+  id avg_arity,
+  id max_arity,
+  double exp_cohort_shape,
+  id exp_cohort_size,
+  id exp_cohort_layers,
+  id seed,
+  id *out,
+  id cap
+);
+
+// Works like acy_select_cohort_children for exponential cohort selection.
+// Here parent_cohort is the parent divided by (max_arity / avg_arity).
+void acy_select_exp_cohort_children(
+  id parent_cohort,
+  id avg_arity,
+  id max_arity,
+  double exp_cohort_shape,
+  id exp_cohort_size,
+  id exp_cohort_layers,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+);
+
 // For polynomial cohort selection (see below) returns the earliest possible
 // child of the given parent.
 id acy_select_poly_earliest_possible_child(
@@ -145,6 +262,34 @@ id acy_select_poly_nth_child(
   id seed
 );
 
+// Works like acy_select_children for polynomial cohort selection.
+id acy_select_poly_children(
+  id parent,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id poly_cohort_base,
+  id poly_cohort_shape,
+  id seed,
+  id *out,
+  id cap
+);
+
+// Works like acy_select_cohort_children for polynomial cohort selection. Here
+// parent_cohort is the parent divided by parent_cohort_size, and the offsets
+// and children arrays need parent_cohort_size + 1 and child_cohort_size
+// entries.
+void acy_select_poly_cohort_children(
+  id parent_cohort,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id poly_cohort_base,
+  id poly_cohort_shape,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+);
+
 // Works like acy_select_parent_and_index, but uses the given tables for child
 // selection. The multiplier parameter controls how large the cohort is, along
 // with the table given (it is multiplied by child_cohort_size as well).
@@ -189,6 +334,39 @@ id acy_count_select_table_children(
   id seed
 );
 
+// Works like acy_select_children for table-based cohort selection.
+id acy_select_table_children(
+  id parent,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed,
+  id *out,
+  id cap
+);
+
+// Works like acy_select_cohort_children for table-based cohort selection.
+// Parents are shuffled within their super-cohort before being divided into
+// cohorts of parent_cohort_size, and parent_cohort counts those shuffled
+// cohorts, so that cohorts 0 through k × T - 1 cover the first k
+// super-cohorts (where T is the table total times table_extra_multiplier).
+// The offsets and children arrays need parent_cohort_size + 1 and
+// child_cohort_size entries.
+void acy_select_table_cohort_children(
+  id parent_cohort,
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+);
+
 // For table-based cohort selection (see above) returns the earliest possible
 // child of the given parent.
 id acy_select_table_earliest_possible_child(
@@ -213,4 +391,93 @@ id acy_select_table_child_cohort_start(
   id seed
 );
 
+// Creates a context for table-based selection with the given parameters (see
+// acy_select_table_parent_and_index). The sumtable is not copied, so it must
+// stay around (and unchanged) until the context is destroyed. Returns NULL if
+// allocation fails.
+acy_select_ctx * acy_create_select_ctx(
+  id parent_cohort_size,
+  id child_cohort_size,
+  id const * const children_sumtable,
+  id children_sumtable_size,
+  id table_extra_multiplier,
+  id seed
+);
+
+// Frees a selection context.
+void acy_destroy_select_ctx(acy_select_ctx *ctx);
+
+// Versions of the acy_select_table_* functions above that take their
+// parameters from a context. Each gives the same results as the original
+// function called with the parameters the context was created with.
+void acy_select_table_parent_and_index_ctx(
+  id child,
+  acy_select_ctx const * const ctx,
+  id *r_parent,
+  id *r_index
+);
+
+// Finds the parents and indices of n children at once, writing results to
+// the r_parents and r_indices arrays (each must have room for n entries).
+// Same results as calling acy_select_table_parent_and_index_ctx on each
+// child, but the table searches are batched, and the super-cohort shuffles
+// are planned once for each run of children that share a super-cohort, so
+// sorting the children first makes this faster.
+void acy_select_table_parent_and_index_batch(
+  id const * const children,
+  id n,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_indices
+);
+
+// Works like acy_select_table_parent_and_index_batch, but splits the children
+// among the threads of a pool (see pool.h). Each thread's share is a
+// contiguous run of the children, so sorting them still helps. A NULL pool
+// runs on the calling thread.
+void acy_select_table_parent_and_index_batch_pool(
+  id const * const children,
+  id n,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_indices,
+  acy_pool *pool
+);
+
+id acy_select_table_nth_child_ctx(
+  id parent,
+  id nth,
+  acy_select_ctx const * const ctx
+);
+
+id acy_count_select_table_children_ctx(
+  id parent,
+  acy_select_ctx const * const ctx
+);
+
+id acy_select_table_children_ctx(
+  id parent,
+  acy_select_ctx const * const ctx,
+  id *out,
+  id cap
+);
+
+void acy_select_table_cohort_children_ctx(
+  id parent_cohort,
+  acy_select_ctx const * const ctx,
+  id *r_parents,
+  id *r_offsets,
+  id *r_children
+);
+
+id acy_select_table_earliest_possible_child_ctx(
+  id parent,
+  acy_select_ctx const * const ctx
+);
+
+id acy_select_table_child_cohort_start_ctx(
+  id child,
+  acy_select_ctx const * const ctx
+);
+
 #endif // INCLUDE_SELECT_H
@@ -23,6 +23,17 @@ typedef uint64_t id;
 // Mask containing every-other byte.
 #define FLOP_MASK 0xf0f0f0f0f0f0f0f0
 
+// Seed-dependent shift amounts for acy_prng (see acy_prng_key_init below).
+// Building one of these once per seed lets acy_prng_keyed skip the seed
+// arithmetic and the modulus reductions in acy_fold and acy_swirl.
+struct acy_prng_key_s {
+  id fold_first; // left shift used by acy_fold(x, seed + 17)
+  id swirl_first; // distance used by acy_swirl(x, seed + 37)
+  id fold_second; // left shift used by acy_fold(x, seed + 89)
+  id swirl_second; // distance used by acy_swirl(x, seed + 107)
+};
+typedef struct acy_prng_key_s acy_prng_key;
+
 // An ID to be used for out-of-band purposes. Note that it's often not strictly
 // out-of-band, however.
 #define NONE 0
@@ -130,6 +141,56 @@ static inline id acy_rev_prng(id x, id seed) {
   return x;
 }
 
+// Circular bit shifts by a distance that has already been reduced below
+// ID_BITS. Unlike acy_swirl these don't take a modulus, and a distance of zero
+// is fine.
+static inline id acy_rotate_right(id x, id distance) {
+  return (x >> distance) | (x << ((ID_BITS - distance) & (ID_BITS - 1)));
+}
+
+static inline id acy_rotate_left(id x, id distance) {
+  return (x << distance) | (x >> ((ID_BITS - distance) & (ID_BITS - 1)));
+}
+
+// Precomputes the shift amounts that acy_prng derives from the given seed.
+// Note that acy_fold doesn't need its mask: the bits it masks off are shifted
+// out of the top anyway, so a fold is just x ^ (x << shift).
+static inline void acy_prng_key_init(acy_prng_key *key, id seed) {
+  key->fold_first = ID_BITS - ((seed + 17) % (ID_BITS >> 2) + (ID_BITS >> 2));
+  key->swirl_first = (seed + 37) % (((ID_BITS << 1) + ID_BITS) >> 2);
+  key->fold_second = ID_BITS - ((seed + 89) % (ID_BITS >> 2) + (ID_BITS >> 2));
+  key->swirl_second = (seed + 107) % (((ID_BITS << 1) + ID_BITS) >> 2);
+}
+
+// Works like acy_prng, but uses a precomputed key instead of a seed. The
+// results are identical to acy_prng with the seed used to build the key.
+static inline id acy_prng_keyed(id x, acy_prng_key const * const key) {
+  x += 13;
+  x ^= x << key->fold_first;
+  x = acy_flop(x);
+  x = acy_rotate_right(x, key->swirl_first);
+  x ^= x << key->fold_second;
+  x = acy_rotate_right(x, key->swirl_second);
+  id trigger = !!(x & 0x80200003); // scramble, as above
+  x = acy_rotate_right(x, 1);
+  x ^= trigger * 0x03040610;
+  return x;
+}
+
+// Reverse
+static inline id acy_rev_prng_keyed(id x, acy_prng_key const * const key) {
+  x = acy_rotate_left(x, 1); // reverse scramble, as above
+  id trigger = !!(x & 0x80200003);
+  x ^= trigger * 0x06080c20;
+  x = acy_rotate_left(x, key->swirl_second);
+  x ^= x << key->fold_second;
+  x = acy_rotate_left(x, key->swirl_first);
+  x = acy_flop(x);
+  x ^= x << key->fold_first;
+  x -= 13;
+  return x;
+}
+
 // A smoothed prng with an integer limit. This is non-reversible for several
 // reasons, including the modulus to fit within the limit and the averaging. If
 // smoothness is set to zero, this is the same as just prng with a modulus.
@@ -0,0 +1,127 @@
+/**
+ * @file: census.h
+ *
+ * @description: Layout of census files, which hold precomputed family
+ * information for a range of people in a form that can be memory-mapped and
+ * used in place (see src/heads/census.c, which writes them).
+ *
+ * A census file is a header followed by a series of columns, each starting
+ * at a multiple of ACY_CENSUS_ALIGNMENT bytes. All values are ids in the
+ * byte order of the machine that wrote the file. For the count people
+ * starting with person first, the columns hold:
+ *
+ *   birthdate            acy_birthdate of each person
+ *   mother               acy_mother of each person
+ *   mother_index         their index among their mother's children (see
+ *                        acy_mother_and_index)
+ *   num_direct_children  acy_num_direct_children of each person
+ *   num_partners         acy_num_partners of each person
+ *   partner_offsets      count + 1 offsets into partners: the partners of
+ *                        the ith person are partners[partner_offsets[i]]
+ *                        through partners[partner_offsets[i + 1] - 1]
+ *   partners             for child-bearers, the partner for each
+ *                        which_partner value (see acy_nth_partner); for
+ *                        non-child-bearers, acy_nth_partner(person, n + 1)
+ *                        for each n
+ *   child_offsets        count + 1 offsets into children, as above
+ *   children             acy_child(person, n) for each n less than
+ *                        acy_num_children(person)
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_CENSUS_H
+#define INCLUDE_CENSUS_H
+
+#include "core/unit.h" // for "id"
+#include "family.h" // for ACY_FAMILY_PARAM_COUNT
+
+/*************
+ * Constants *
+ *************/
+
+// Identifies census files (the bytes "ACYCNSUS" in file order).
+#define ACY_CENSUS_MAGIC "ACYCNSUS"
+
+// Version of the layout described above.
+#define ACY_CENSUS_VERSION 1
+
+// Written as an id so that readers can detect a different byte order.
+#define ACY_CENSUS_BYTE_ORDER 0x0102030405060708
+
+// Alignment of each column, in bytes.
+#define ACY_CENSUS_ALIGNMENT 64
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Indices of the columns in acy_census_header.columns:
+enum acy_census_column_e {
+  ACY_CENSUS_BIRTHDATE = 0,
+  ACY_CENSUS_MOTHER = 1,
+  ACY_CENSUS_MOTHER_INDEX = 2,
+  ACY_CENSUS_NUM_DIRECT_CHILDREN = 3,
+  ACY_CENSUS_NUM_PARTNERS = 4,
+  ACY_CENSUS_PARTNER_OFFSETS = 5,
+  ACY_CENSUS_PARTNERS = 6,
+  ACY_CENSUS_CHILD_OFFSETS = 7,
+  ACY_CENSUS_CHILDREN = 8,
+  ACY_CENSUS_COLUMNS = 9
+};
+typedef enum acy_census_column_e acy_census_column;
+
+// The header at the start of a census file.
+struct acy_census_header_s {
+  char magic[8]; // ACY_CENSUS_MAGIC (without a terminating NUL)
+  id byte_order; // ACY_CENSUS_BYTE_ORDER
+  id version; // ACY_CENSUS_VERSION
+  id first; // the first person covered
+  id count; // the number of people covered
+  id num_partner_entries; // the length of the partners column
+  id num_child_entries; // the length of the children column
+  id file_size; // in bytes
+  id params[ACY_FAMILY_PARAM_COUNT]; // see acy_get_family_params
+  id columns[ACY_CENSUS_COLUMNS]; // byte offset of each column in the file
+};
+typedef struct acy_census_header_s acy_census_header;
+
+/********************
+ * Inline Functions *
+ ********************/
+
+// Returns the number of ids in the given column.
+static inline id acy_census_column_length(
+  acy_census_header const * const header,
+  acy_census_column column
+) {
+  switch (column) {
+    case ACY_CENSUS_PARTNER_OFFSETS:
+    case ACY_CENSUS_CHILD_OFFSETS:
+      return header->count + 1;
+    case ACY_CENSUS_PARTNERS:
+      return header->num_partner_entries;
+    case ACY_CENSUS_CHILDREN:
+      return header->num_child_entries;
+    default:
+      return header->count;
+  }
+}
+
+// Fills in the column offsets and file size of a header whose count and
+// entry counts are already set. The file ends with padding up to a multiple
+// of ACY_CENSUS_ALIGNMENT.
+static inline void acy_census_layout(acy_census_header *header) {
+  id offset = sizeof(acy_census_header);
+  for (id c = 0; c < ACY_CENSUS_COLUMNS; ++c) {
+    offset += (ACY_CENSUS_ALIGNMENT - offset % ACY_CENSUS_ALIGNMENT)
+      % ACY_CENSUS_ALIGNMENT;
+    header->columns[c] = offset;
+    offset += acy_census_column_length(header, c) * sizeof(id);
+  }
+  offset += (ACY_CENSUS_ALIGNMENT - offset % ACY_CENSUS_ALIGNMENT)
+    % ACY_CENSUS_ALIGNMENT;
+  header->file_size = offset;
+}
+
+#endif // INCLUDE_CENSUS_H
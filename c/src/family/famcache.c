@@ -0,0 +1,358 @@
+/**
+ * @file: famcache.c
+ *
+ * @description: A bounded per-person memo of family query intermediates
+ * (birthdates, child counts, and partner lists), so that repeated
+ * relationship queries don't redo the same partner searches.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdlib.h>
+#include <string.h> // for memcpy
+
+#include "famcache.h"
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// A cached entry along with its table and LRU links. Partner lists are
+// allocated separately.
+struct acy_family_slot_s;
+typedef struct acy_family_slot_s acy_family_slot;
+
+struct acy_family_slot_s {
+  acy_family_cache_entry entry;
+  id generation; // of the compiled family info that produced the entry
+  id hash;
+  id bytes; // including the partner lists
+  acy_family_slot *bucket_next;
+  acy_family_slot *lru_prev; // towards most-recently used
+  acy_family_slot *lru_next; // towards least-recently used
+};
+
+struct acy_family_cache_s {
+  acy_family_slot **buckets;
+  id bucket_count; // always a power of two
+  acy_family_slot *lru_head; // most-recently used
+  acy_family_slot *lru_tail; // least-recently used
+  acy_family_cache_stats stats;
+};
+
+/***********
+ * Globals *
+ ***********/
+
+_Thread_local acy_family_cache *acy_thread_family_cache = NULL;
+
+#define ACY_FAMILY_CACHE_INITIAL_BUCKETS 256
+
+/*********************
+ * Private Functions *
+ *********************/
+
+static inline id acy_family_cache_hash(id generation, id person) {
+  id h = (person ^ (generation * 0xc2b2ae3d27d4eb4f)) * 0x9e3779b97f4a7c15;
+  h ^= h >> 29;
+  return h;
+}
+
+static void acy_family_cache_unlink(
+  acy_family_cache *cache,
+  acy_family_slot *slot
+) {
+  if (slot->lru_prev != NULL) {
+    slot->lru_prev->lru_next = slot->lru_next;
+  } else {
+    cache->lru_head = slot->lru_next;
+  }
+  if (slot->lru_next != NULL) {
+    slot->lru_next->lru_prev = slot->lru_prev;
+  } else {
+    cache->lru_tail = slot->lru_prev;
+  }
+  slot->lru_prev = NULL;
+  slot->lru_next = NULL;
+}
+
+static void acy_family_cache_push_front(
+  acy_family_cache *cache,
+  acy_family_slot *slot
+) {
+  slot->lru_prev = NULL;
+  slot->lru_next = cache->lru_head;
+  if (cache->lru_head != NULL) {
+    cache->lru_head->lru_prev = slot;
+  } else {
+    cache->lru_tail = slot;
+  }
+  cache->lru_head = slot;
+}
+
+// Removes a slot from its bucket and the LRU list, and frees it.
+static void acy_family_cache_remove(
+  acy_family_cache *cache,
+  acy_family_slot *slot
+) {
+  acy_family_slot **link = &cache->buckets[
+    slot->hash & (cache->bucket_count - 1)
+  ];
+  while (*link != slot) {
+    link = &(*link)->bucket_next;
+  }
+  *link = slot->bucket_next;
+  acy_family_cache_unlink(cache, slot);
+  cache->stats.entries -= 1;
+  cache->stats.bytes_used -= slot->bytes;
+  free(slot->entry.partners);
+  free(slot);
+}
+
+// Evicts least-recently-used slots (other than 'keep') until the given number
+// of additional bytes would fit in the budget.
+static void acy_family_cache_make_room(
+  acy_family_cache *cache,
+  id bytes,
+  acy_family_slot const * const keep
+) {
+  while (
+    cache->lru_tail != NULL
+ && cache->lru_tail != keep
+ && cache->stats.bytes_used + bytes > cache->stats.byte_budget
+  ) {
+    acy_family_cache_remove(cache, cache->lru_tail);
+    cache->stats.evictions += 1;
+  }
+}
+
+// Doubles the bucket count once there are more entries than buckets.
+static void acy_family_cache_grow(acy_family_cache *cache) {
+  id new_count = cache->bucket_count * 2;
+  acy_family_slot **new_buckets = (acy_family_slot**) calloc(
+    new_count,
+    sizeof(acy_family_slot*)
+  );
+  if (new_buckets == NULL) {
+    return; // just keep using longer chains
+  }
+  for (id b = 0; b < cache->bucket_count; ++b) {
+    acy_family_slot *slot = cache->buckets[b];
+    while (slot != NULL) {
+      acy_family_slot *next = slot->bucket_next;
+      acy_family_slot **bucket = &new_buckets[slot->hash & (new_count - 1)];
+      slot->bucket_next = *bucket;
+      *bucket = slot;
+      slot = next;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = new_buckets;
+  cache->bucket_count = new_count;
+}
+
+static inline int acy_family_slot_matches(
+  acy_family_slot const * const slot,
+  id generation,
+  id person
+) {
+  return slot->entry.person == person && slot->generation == generation;
+}
+
+// Finds the slot for a person within a generation, moving it to the front of
+// the LRU list.
+static inline acy_family_slot * acy_family_cache_find(
+  acy_family_cache *cache,
+  id generation,
+  id person,
+  id hash
+) {
+  acy_family_slot *slot = cache->lru_head;
+  if (slot != NULL && acy_family_slot_matches(slot, generation, person)) {
+    return slot;
+  }
+  slot = cache->buckets[hash & (cache->bucket_count - 1)];
+  while (
+    slot != NULL
+ && !acy_family_slot_matches(slot, generation, person)
+  ) {
+    slot = slot->bucket_next;
+  }
+  if (slot != NULL) {
+    acy_family_cache_unlink(cache, slot);
+    acy_family_cache_push_front(cache, slot);
+  }
+  return slot;
+}
+
+/*************
+ * Functions *
+ *************/
+
+acy_family_cache * acy_create_family_cache(id byte_budget) {
+  acy_family_cache *cache = (acy_family_cache*) calloc(
+    1,
+    sizeof(acy_family_cache)
+  );
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->bucket_count = ACY_FAMILY_CACHE_INITIAL_BUCKETS;
+  cache->buckets = (acy_family_slot**) calloc(
+    cache->bucket_count,
+    sizeof(acy_family_slot*)
+  );
+  if (cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+  cache->stats.byte_budget = byte_budget;
+  return cache;
+}
+
+void acy_destroy_family_cache(acy_family_cache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+  if (acy_thread_family_cache == cache) {
+    acy_thread_family_cache = NULL;
+  }
+  acy_clear_family_cache(cache);
+  free(cache->buckets);
+  free(cache);
+}
+
+void acy_clear_family_cache(acy_family_cache *cache) {
+  while (cache->lru_head != NULL) {
+    acy_family_cache_remove(cache, cache->lru_head);
+  }
+}
+
+void acy_set_family_cache_budget(acy_family_cache *cache, id byte_budget) {
+  cache->stats.byte_budget = byte_budget;
+  acy_family_cache_make_room(cache, 0, NULL);
+}
+
+void acy_get_family_cache_stats(
+  acy_family_cache const * const cache,
+  acy_family_cache_stats *r_stats
+) {
+  *r_stats = cache->stats;
+}
+
+void acy_reset_family_cache_stats(acy_family_cache *cache) {
+  cache->stats.hits = 0;
+  cache->stats.misses = 0;
+  cache->stats.stores = 0;
+  cache->stats.evictions = 0;
+}
+
+acy_family_cache_entry const * acy_family_cache_lookup(
+  acy_family_cache *cache,
+  id generation,
+  id person,
+  id want
+) {
+  acy_family_slot *slot = acy_family_cache_find(
+    cache,
+    generation,
+    person,
+    acy_family_cache_hash(generation, person)
+  );
+  if (slot == NULL || (slot->entry.known & want) != want) {
+    cache->stats.misses += 1;
+    return NULL;
+  }
+  cache->stats.hits += 1;
+  return &slot->entry;
+}
+
+acy_family_cache_entry * acy_family_cache_store(
+  acy_family_cache *cache,
+  id generation,
+  id person
+) {
+  id hash = acy_family_cache_hash(generation, person);
+  acy_family_slot *slot = acy_family_cache_find(
+    cache,
+    generation,
+    person,
+    hash
+  );
+  if (slot != NULL) {
+    return &slot->entry;
+  }
+
+  id bytes = sizeof(acy_family_slot);
+  if (bytes > cache->stats.byte_budget) {
+    return NULL;
+  }
+  acy_family_cache_make_room(cache, bytes, NULL);
+  slot = (acy_family_slot*) calloc(1, bytes);
+  if (slot == NULL) {
+    return NULL;
+  }
+  slot->entry.person = person;
+  slot->generation = generation;
+  slot->hash = hash;
+  slot->bytes = bytes;
+
+  if (cache->stats.entries >= cache->bucket_count) {
+    acy_family_cache_grow(cache);
+  }
+  acy_family_slot **bucket = &cache->buckets[hash & (cache->bucket_count - 1)];
+  slot->bucket_next = *bucket;
+  *bucket = slot;
+  acy_family_cache_push_front(cache, slot);
+  cache->stats.entries += 1;
+  cache->stats.bytes_used += bytes;
+  cache->stats.stores += 1;
+  return &slot->entry;
+}
+
+int acy_family_cache_store_partners(
+  acy_family_cache *cache,
+  acy_family_cache_entry *entry,
+  id count,
+  id const *partners,
+  id const *indices
+) {
+  // The entry is the first member of its slot:
+  acy_family_slot *slot = (acy_family_slot*) entry;
+  id lists = (indices != NULL) + 1;
+  id bytes = lists * count * sizeof(id);
+  if (slot->bytes + bytes > cache->stats.byte_budget) {
+    return 0;
+  }
+  free(entry->partners);
+  cache->stats.bytes_used -= slot->bytes - sizeof(acy_family_slot);
+  slot->bytes = sizeof(acy_family_slot);
+  entry->partners = NULL;
+  entry->partner_indices = NULL;
+  entry->known &= ~ACY_FAMILY_CACHE_PARTNERS;
+
+  acy_family_cache_make_room(cache, bytes, slot);
+  id *storage = (id*) malloc(bytes + (bytes == 0)); // never malloc(0)
+  if (storage == NULL) {
+    return 0;
+  }
+  memcpy(storage, partners, count * sizeof(id));
+  if (indices != NULL) {
+    memcpy(storage + count, indices, count * sizeof(id));
+    entry->partner_indices = storage + count;
+  }
+  entry->partners = storage;
+  entry->num_partners = count;
+  entry->known |= ACY_FAMILY_CACHE_PARTNERS;
+  slot->bytes += bytes;
+  cache->stats.bytes_used += bytes;
+  return 1;
+}
+
+void acy_set_thread_family_cache(acy_family_cache *cache) {
+  acy_thread_family_cache = cache;
+}
+
+acy_family_cache * acy_get_thread_family_cache(void) {
+  return acy_thread_family_cache;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file: famcache.h
+ *
+ * @description: A bounded per-person memo of family query intermediates
+ * (birthdates, child counts, and partner lists), so that repeated
+ * relationship queries don't redo the same partner searches.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_FAMCACHE_H
+#define INCLUDE_FAMCACHE_H
+
+#include "core/unit.h" // for "id"
+
+/***********
+ * Globals *
+ ***********/
+
+// Default memory budget for a new cache, in bytes.
+#define ACY_FAMILY_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024)
+
+// Flags for which fields of an entry are known:
+#define ACY_FAMILY_CACHE_BIRTHDATE 0x1
+#define ACY_FAMILY_CACHE_DIRECT_CHILDREN 0x2
+#define ACY_FAMILY_CACHE_PARTNERS 0x4
+
+/************************
+ * Types and Structures *
+ ************************/
+
+// Opaque cache type: use acy_create_family_cache and acy_destroy_family_cache.
+// A cache holds one entry per person for each generation of compiled family
+// info that produced entries (see acy_compile_family_info), evicting the
+// least-recently-used entries when it exceeds its byte budget. Entries from
+// different generations never match each other, so one cache can serve
+// queries that alternate between several infos. A cache must only be used by
+// one thread at a time.
+struct acy_family_cache_s;
+typedef struct acy_family_cache_s acy_family_cache;
+
+// Memoized values for one person. Only the fields named by 'known' are
+// valid.
+struct acy_family_cache_entry_s {
+  id person;
+  id known; // a combination of the ACY_FAMILY_CACHE_* flags
+  id birthdate;
+  id num_direct_children;
+  // For child-bearers, the partner for each which_partner value (see
+  // acy_nth_partner). For non-child-bearers, each partner in the order they
+  // are found among potential partners, along with which partner of theirs
+  // this person is.
+  id num_partners;
+  id *partners;
+  id *partner_indices; // NULL for child-bearers
+};
+typedef struct acy_family_cache_entry_s acy_family_cache_entry;
+
+// Statistics for a cache (see acy_get_family_cache_stats).
+struct acy_family_cache_stats_s {
+  id hits; // lookups that found the requested values
+  id misses; // lookups that didn't
+  id stores; // entries created
+  id evictions; // entries evicted to stay under budget
+  id entries; // entries currently held
+  id bytes_used; // memory currently used by entries
+  id byte_budget; // the memory budget
+};
+typedef struct acy_family_cache_stats_s acy_family_cache_stats;
+
+/*************
+ * Functions *
+ *************/
+
+// Allocates a new empty cache with the given memory budget in bytes. Returns
+// NULL if allocation fails.
+acy_family_cache * acy_create_family_cache(id byte_budget);
+
+// Frees a cache and all of its entries.
+void acy_destroy_family_cache(acy_family_cache *cache);
+
+// Drops all entries from the cache (statistics are kept).
+void acy_clear_family_cache(acy_family_cache *cache);
+
+// Changes the memory budget, evicting entries as needed.
+void acy_set_family_cache_budget(acy_family_cache *cache, id byte_budget);
+
+// Fills in r_stats with the cache's current statistics.
+void acy_get_family_cache_stats(
+  acy_family_cache const * const cache,
+  acy_family_cache_stats *r_stats
+);
+
+// Resets the hit/miss/store/eviction counters.
+void acy_reset_family_cache_stats(acy_family_cache *cache);
+
+// Returns the entry for the given person and generation if it has all of the
+// fields named by 'want', or NULL otherwise. The entry remains valid until the
+// next change to the cache.
+acy_family_cache_entry const * acy_family_cache_lookup(
+  acy_family_cache *cache,
+  id generation,
+  id person,
+  id want
+);
+
+// Returns the entry for the given person and generation, creating an empty one
+// if needed, so that the caller can fill in fields and set their 'known'
+// flags. Returns NULL if the entry can't fit in the budget or allocation
+// fails. The entry remains valid until the next change to the cache.
+acy_family_cache_entry * acy_family_cache_store(
+  acy_family_cache *cache,
+  id generation,
+  id person
+);
+
+// Stores a partner list for an entry returned by acy_family_cache_store,
+// copying 'count' partners (and partner indices, unless 'indices' is NULL)
+// and marking the partners as known. Returns 0 if the list can't fit in the
+// budget or allocation fails, and 1 otherwise.
+int acy_family_cache_store_partners(
+  acy_family_cache *cache,
+  acy_family_cache_entry *entry,
+  id count,
+  id const *partners,
+  id const *indices
+);
+
+// Installs a cache for use by the family queries in the calling thread only.
+// Pass NULL to stop using a cache. The caller still owns the cache.
+void acy_set_thread_family_cache(acy_family_cache *cache);
+
+// Returns the calling thread's installed cache, or NULL.
+acy_family_cache * acy_get_thread_family_cache(void);
+
+// The calling thread's installed cache (use acy_set_thread_family_cache).
+extern _Thread_local acy_family_cache *acy_thread_family_cache;
+
+#endif // INCLUDE_FAMCACHE_H
@@ -6,12 +6,20 @@
  * @author: Peter Mawhorter (pmawhorter@gmail.com)
  */
 
+#include <pthread.h> // for releasing per-thread memos at thread exit
+#include <stdatomic.h> // for atomic_fetch_add
 #include <stdlib.h> // for malloc
+#include <string.h> // for memcmp and memcpy
 #ifdef DEBUG_FAMILY
   #include <stdio.h>
 #endif
 
+#include "core/permcache.h" // for cached shuffles
+#include "core/pool.h" // for acy_parallel_for
+
 #include "family.h"
+#include "famcache.h"
+#include "snapshot.h"
 
 /*************************
  * Structure Definitions *
@@ -45,6 +53,9 @@ struct acy_family_info_s {
   id likely_partner_likelihood; // denominator: n-1/n are likely, 1/n unlikely
   id unlikely_partner_likelihood; // as above for unlikely/full selection
   id multiple_partners_percent;
+
+  // precomputed results, if any (see acy_set_info_snapshot):
+  acy_family_snapshot const *snapshot;
 };
 typedef struct acy_family_info_s acy_family_info;
 
@@ -100,7 +111,9 @@ acy_family_info const DEFAULT_FAMILY_INFO = {
   .max_partner_age = 65 * ONE_EARTH_YEAR,
   .likely_partner_likelihood = 6, // 1/6 are unlikely or full
   .unlikely_partner_likelihood = 4, // 1/4 of that 1/6 unlikely are full
-  .multiple_partners_percent = 21 // wild guess based on cursory research
+  .multiple_partners_percent = 21, // wild guess based on cursory research
+
+  .snapshot = NULL
 };
 
 enum acy_cohort_case_e {
@@ -112,6 +125,142 @@ enum acy_cohort_case_e {
 };
 typedef enum acy_cohort_case_e acy_cohort_case;
 
+// Number of distinct partner cohort sizes (the shifted case reuses the likely
+// cohort size):
+#define ACY_PARTNER_COHORT_SIZES 3
+
+// Parameters for one partner cohort case (see acy_get_cohort_case_parameters).
+struct acy_cohort_case_params_s {
+  id cohort_size;
+  id cohort_adjust;
+  id cohort_fraction;
+  acy_divisor cohort_div;
+  // shuffle plans for seed + 28999 * which_partner, one per partner up to
+  // max_partners_per_mother (NULL for the invalid case):
+  acy_shuffle_plan const *plans;
+};
+typedef struct acy_cohort_case_params_s acy_cohort_case_params;
+
+struct acy_compiled_family_s {
+  acy_family_info info; // a copy of the info this was compiled from
+  id generation; // unique per compilation; tags cached results
+  id multiplier; // see acy_family_birth_age_table_multiplier
+  id child_id_adjust;
+  acy_divisor birth_rate_div;
+  acy_divisor max_partners_div;
+  acy_select_ctx *select; // for mother/child selection
+  acy_cohort_case_params cases[ACY_COHORT_CASE_MAX + 1]; // last is invalid
+  acy_shuffle_plan *partner_plans; // by cohort size, then which_partner
+};
+
+// Number of compiled infos each thread keeps for the uncompiled queries.
+#define ACY_FAMILY_MEMO_SIZE 8
+
+// Number of shuffle plans kept while building a partner index block.
+#define ACY_PLAN_MEMO_SIZE 4096
+
+// Initial number of buckets for partner index blocks.
+#define ACY_PARTNER_INDEX_INITIAL_BUCKETS 64
+
+// A direct-mapped memo of shuffle plans by cohort size and seed. Neighboring
+// people mostly share their cohort shuffles, so this lets partner index
+// blocks be built with planned shuffles (see acy_partner_index_build).
+struct acy_plan_memo_s {
+  id sizes[ACY_PLAN_MEMO_SIZE]; // 0 for empty slots
+  id seeds[ACY_PLAN_MEMO_SIZE];
+  acy_shuffle_plan plans[ACY_PLAN_MEMO_SIZE];
+};
+typedef struct acy_plan_memo_s acy_plan_memo;
+
+// One partner of a non-child-bearer in a partner index block, along with
+// the values needed to count and find their children together.
+struct acy_partner_entry_s {
+  id partner;
+  id index; // which partner of theirs the non-child-bearer is
+  id child_count; // the partner's number of direct children
+  id num_partners; // the partner's number of partners
+};
+typedef struct acy_partner_entry_s acy_partner_entry;
+
+// The partners of ACY_PARTNER_INDEX_BLOCK consecutive non-child-bearers (by
+// separated id), stored compactly: the partners of the ith non-child-bearer
+// are entries[offsets[i]] through entries[offsets[i+1] - 1].
+struct acy_partner_block_s;
+typedef struct acy_partner_block_s acy_partner_block;
+
+struct acy_partner_block_s {
+  id number; // separated id / ACY_PARTNER_INDEX_BLOCK
+  acy_partner_block *next; // in the same bucket
+  id offsets[ACY_PARTNER_INDEX_BLOCK + 1];
+  acy_partner_entry *entries;
+};
+
+struct acy_partner_index_s {
+  acy_compiled_family const *compiled;
+  acy_partner_block **buckets;
+  id bucket_count; // always a power of two
+  id block_count;
+  acy_plan_memo *memo; // only used while building
+};
+
+// Initial number of slots in an ancestry walk's set of found ancestors.
+#define ACY_ANCESTRY_INITIAL_SLOTS 64
+
+// A breadth-first walk up someone's pedigree. Each ancestor is recorded (and
+// has their own parents looked up) only once, no matter how many lines of
+// descent lead to them.
+struct acy_ancestry_s {
+  id person;
+  id *found; // unique ancestors, a generation at a time
+  id count;
+  id capacity; // of found
+  int growable; // whether found may be reallocated
+  int failed; // set if found couldn't grow
+  id *slots; // open-addressed set of found, or NULL to search found
+  id slot_mask;
+  id generation_start; // index in found of the latest generation
+  id depth; // generations walked so far
+};
+typedef struct acy_ancestry_s acy_ancestry;
+
+// Initial capacity of each generation in a descendant walk.
+#define ACY_DESCENDANTS_INITIAL_CAPACITY 64
+
+// A growable list of the people in one generation of a descendant walk.
+struct acy_generation_s {
+  id *people;
+  id count;
+  id capacity;
+};
+typedef struct acy_generation_s acy_generation;
+
+// A sibling along with their birthdate, for sorting (see acy_siblings).
+struct acy_sibling_key_s {
+  id birthdate;
+  id sibling;
+  id relation;
+};
+typedef struct acy_sibling_key_s acy_sibling_key;
+
+/***********
+ * Globals *
+ ***********/
+
+// The calling thread's most recently used compiled infos, most recent first
+// (see acy_family_memo). Unused entries are NULL and come last.
+static _Thread_local acy_compiled_family *acy_thread_compiled_families[
+  ACY_FAMILY_MEMO_SIZE
+] = { NULL };
+
+// A key whose destructor releases each thread's compiled infos when the
+// thread exits (see acy_family_memo_key_init).
+static pthread_once_t acy_family_memo_once = PTHREAD_ONCE_INIT;
+static pthread_key_t acy_family_memo_key;
+static int acy_family_memo_key_ok = 0;
+
+// Number of family infos compiled so far (see acy_compile_family_info).
+static _Atomic id acy_family_generations = 0;
+
 /*************
  * Functions *
  *************/
@@ -147,6 +296,8 @@ void acy_copy_family_info(
   dst->likely_partner_likelihood = src->likely_partner_likelihood;
   dst->unlikely_partner_likelihood = src->unlikely_partner_likelihood;
   dst->multiple_partners_percent = src->multiple_partners_percent;
+
+  dst->snapshot = src->snapshot;
 }
 
 void acy_set_info_seed(acy_family_info *info, id seed) {
@@ -157,28 +308,52 @@ id acy_get_info_seed(acy_family_info *info) {
   return info->seed;
 }
 
-id acy_birthdate(id person, acy_family_info const * const info) {
-  return acy_mixed_cohort(person, info->birth_rate_per_day, info->seed + 17);
+void acy_set_info_snapshot(
+  acy_family_info *info,
+  acy_family_snapshot const * const snapshot
+) {
+  info->snapshot = snapshot;
 }
 
-id acy_first_born_on(id day, acy_family_info const * const info) {
-  return acy_mixed_cohort_outer(
-    day,
-    0,
-    info->birth_rate_per_day,
-    info->seed + 17
-  );
+acy_family_snapshot const * acy_get_info_snapshot(
+  acy_family_info const * const info
+) {
+  return info->snapshot;
 }
 
-id acy_get_child_id_adjust(acy_family_info const * const info) {
-  return info->birth_rate_per_day * info->min_childbearing_age;
+void acy_get_family_params(
+  acy_family_info const * const info,
+  id *r_params
+) {
+  // Fingerprint the sum table (which has one more entry than its size):
+  id table_hash = info->birth_age_dist_sumtable_size;
+  for (id i = 0; i <= info->birth_age_dist_sumtable_size; ++i) {
+    table_hash = acy_prng(table_hash ^ info->birth_age_dist_sumtable[i], i);
+  }
+  id params[ACY_FAMILY_PARAM_COUNT] = {
+    info->seed,
+    info->birth_rate_per_day,
+    info->min_childbearing_age,
+    info->max_childbearing_age,
+    info->mother_cohort_size,
+    info->max_children_per_mother,
+    info->birth_age_dist_sumtable_size,
+    table_hash,
+    info->max_partners_per_mother,
+    info->likely_partner_age_gap,
+    info->unlikely_partner_age_gap,
+    info->min_partner_age,
+    info->max_partner_age,
+    info->likely_partner_likelihood,
+    info->unlikely_partner_likelihood,
+    info->multiple_partners_percent
+  };
+  memcpy(r_params, params, sizeof(params));
 }
 
-id acy_mother(id person, acy_family_info const * const info) {
-  id parent, index;
-  acy_mother_and_index(person, info, &parent, &index);
-  return parent;
-}
+/************************
+ * Compiled Family Info *
+ ************************/
 
 static inline id acy_family_birth_age_table_multiplier(
   acy_family_info const * const info
@@ -196,179 +371,6 @@ static inline id acy_family_birth_age_table_multiplier(
   ) * table_total; // round to nearest multiple of table_total
 }
 
-void acy_mother_and_index(
-  id person,
-  acy_family_info const * const info,
-  id *r_mother,
-  id *r_index
-) {
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "\nacy_mother_and_index::person::%lu\n", person);
-#endif
-  if (person == NONE) {
-    *r_mother = NONE;
-    *r_index = 0;
-    return;
-  }
-
-  id multiplier = acy_family_birth_age_table_multiplier(info);
-
-  // Correct age gap:
-  id adjusted = person - acy_get_child_id_adjust(info);
-  /*
-   * TODO: Check underflow!
-  if (adjusted > person) { // underflow
-    *r_mother = NONE;
-    *r_index = 0;
-    return;
-  }
-  */
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "acy_mother_and_index::adjusted::%lu\n", adjusted);
-#endif
-  id mother, index;
-  acy_select_table_parent_and_index(
-    adjusted,
-    info->mother_cohort_size,
-    info->max_children_per_mother,
-    info->birth_age_dist_sumtable,
-    info->birth_age_dist_sumtable_size,
-    multiplier,
-    info->seed,
-    &mother,
-    &index
-  );
-#ifdef DEBUG_FAMILY
-  fprintf(
-    stderr,
-    "acy_mother_and_index::mother/index::%lu/%lu\n",
-    mother,
-    index
-  );
-#endif
-
-  *r_mother = acy_child_bearer(mother);
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "acy_mother_and_index::adjusted_mother::%lu\n", *r_mother);
-#endif
-  if (mother != *r_mother) {
-    // Our final index is our index as a 'child' of our mother's duo plus the
-    // number of direct children our actual mother has:
-    index += acy_count_select_table_children(
-      *r_mother,
-      info->mother_cohort_size,
-      info->max_children_per_mother,
-      info->birth_age_dist_sumtable,
-      info->birth_age_dist_sumtable_size,
-      multiplier,
-      info->seed
-    );
-#ifdef DEBUG_FAMILY
-    fprintf(stderr, "acy_mother_and_index::adjusted_index::%lu\n", index);
-#endif
-  }
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "\n");
-#endif
-  *r_index = index;
-
-  /*
-   * TODO: Check underflow
-  if (*r_mother > person) { // underflow
-    *r_mother = NONE;
-    *r_index = 0;
-    return;
-  }
-  */
-}
-
-id acy_direct_child(id person, id nth, acy_family_info const * const info) {
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "\nacy_direct_child::person/nth::%lu/%lu\n", person, nth);
-#endif
-  if (!acy_is_child_bearer(person)) {
-    return NONE;
-  }
-  id multiplier = acy_family_birth_age_table_multiplier(info);
-  id first_count = acy_count_select_table_children(
-    person,
-    info->mother_cohort_size,
-    info->max_children_per_mother,
-    info->birth_age_dist_sumtable,
-    info->birth_age_dist_sumtable_size,
-    multiplier,
-    info->seed
-  );
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "acy_direct_child::first_count::%lu\n", first_count);
-#endif
-  id child;
-  if (nth < first_count) {
-    child = acy_select_table_nth_child(
-      person,
-      nth,
-      info->mother_cohort_size,
-      info->max_children_per_mother,
-      info->birth_age_dist_sumtable,
-      info->birth_age_dist_sumtable_size,
-      multiplier,
-      info->seed
-    );
-#ifdef DEBUG_FAMILY
-    fprintf(stderr, "acy_direct_child::child(first)::%lu\n", child);
-#endif
-  } else { // get children that would think our duo is their parent:
-    child = acy_select_table_nth_child(
-      acy_child_bearers_duo(person),
-      nth - first_count,
-      info->mother_cohort_size,
-      info->max_children_per_mother,
-      info->birth_age_dist_sumtable,
-      info->birth_age_dist_sumtable_size,
-      multiplier,
-      info->seed
-    );
-#ifdef DEBUG_FAMILY
-    fprintf(stderr, "acy_direct_child::child(second)::%lu\n", child);
-#endif
-  }
-  if (child == NONE) { return NONE; } // mother doesn't have this many children
-  // Introduce age gap:
-  id adjusted = child + acy_get_child_id_adjust(info);
-#ifdef DEBUG_FAMILY
-  fprintf(stderr, "acy_direct_child::adjusted::%lu\n\n", adjusted);
-#endif
-  /*
-   * TODO: Check overflow
-  if (adjusted < child || child < person) { return NONE; } // overflow
-  */
-  return adjusted;
-}
-
-id acy_num_direct_children(id person, acy_family_info const * const info) {
-  if (person == NONE || !acy_is_child_bearer(person)) {
-    return 0;
-  }
-  id multiplier = acy_family_birth_age_table_multiplier(info);
-  return acy_count_select_table_children(
-    person,
-    info->mother_cohort_size,
-    info->max_children_per_mother,
-    info->birth_age_dist_sumtable,
-    info->birth_age_dist_sumtable_size,
-    multiplier,
-    info->seed
-  ) + acy_count_select_table_children(
-    acy_child_bearers_duo(person),
-    info->mother_cohort_size,
-    info->max_children_per_mother,
-    info->birth_age_dist_sumtable,
-    info->birth_age_dist_sumtable_size,
-    multiplier,
-    info->seed
-  );
-}
-
 // Helpers for partner cohort sizing:
 static inline id acy_family_partner_likely_cohort_size(
   acy_family_info const * const info
@@ -467,318 +469,2556 @@ static inline void acy_get_cohort_case_parameters(
   }
 }
 
-static inline id acy_num_potential_partners(acy_family_info const * const info){
-  // there are four possible cohort cases
-  return 4 * info->max_partners_per_mother;
-}
-
-void acy_nth_potential_partner_and_index(
-  id person,
-  id nth,
-  acy_family_info const * const info,
-  id *r_partner,
-  id *r_nth
+acy_compiled_family * acy_compile_family_info(
+  acy_family_info const * const info
 ) {
-  if (acy_is_child_bearer(person)) {
-    // child-bearers only have real partners
-    *r_partner = NONE;
-    *r_nth = 0;
-    return;
+  acy_compiled_family *compiled = (acy_compiled_family*) malloc(
+    sizeof(acy_compiled_family)
+  );
+  if (compiled == NULL) {
+    return NULL;
   }
-  acy_cohort_case cohort_case = nth / info->max_partners_per_mother;
-  id which_partner = nth % info->max_partners_per_mother;
+  acy_copy_family_info(info, &compiled->info);
+  compiled->generation = atomic_fetch_add(&acy_family_generations, 1) + 1;
+  compiled->multiplier = acy_family_birth_age_table_multiplier(info);
+  compiled->child_id_adjust = acy_get_child_id_adjust(info);
+  acy_divisor_init(&compiled->birth_rate_div, info->birth_rate_per_day);
+  acy_divisor_init(&compiled->max_partners_div, info->max_partners_per_mother);
 
-  // Get case parameters:
-  id cohort_size, cohort_adjust, cohort_fraction;
-  acy_get_cohort_case_parameters(
-    cohort_case,
-    info,
-    &cohort_size,
-    &cohort_adjust,
-    &cohort_fraction
+  compiled->select = acy_create_select_ctx(
+    info->mother_cohort_size,
+    info->max_children_per_mother,
+    info->birth_age_dist_sumtable,
+    info->birth_age_dist_sumtable_size,
+    compiled->multiplier,
+    info->seed
   );
-
-  // Find match:
-  id cohort, inner;
-  acy_mixed_cohort_and_inner(
-    acy_separated(person),
-    cohort_size,
-    info->seed + (83923 * which_partner),
-    &cohort,
-    &inner
+  id max_partners = info->max_partners_per_mother;
+  compiled->partner_plans = (acy_shuffle_plan*) malloc(
+    sizeof(acy_shuffle_plan) * ACY_PARTNER_COHORT_SIZES * max_partners
   );
-  if (inner < cohort_fraction) {
-    // a fractionated partner can't be chosen
-    *r_partner = NONE;
-    *r_nth = 0;
-    return;
+  if (
+    compiled->select == NULL
+ || (compiled->partner_plans == NULL && max_partners > 0)
+  ) {
+    acy_destroy_select_ctx(compiled->select);
+    free(compiled->partner_plans);
+    free(compiled);
+    return NULL;
   }
-  cohort += cohort_adjust; // adjust cohort to correct age gap
-  id unshuf = acy_rev_cohort_shuffle(
-    inner,
-    cohort_size,
-    info->seed + (28999 * which_partner)
-  );
-  id candidate = acy_mixed_cohort_outer(
-    cohort,
-    unshuf,
-    cohort_size,
-    info->seed + (83923 * which_partner)
-  );
-  id unsep = acy_sep_child_bearer(candidate);
-  id num_actual = acy_num_partners(unsep, info);
-  if (which_partner >= num_actual) {
-    // that other person doesn't have enough partners to include us
-    *r_partner = NONE;
-    *r_nth = 0;
+
+  for (
+    acy_cohort_case cohort_case = ACY_COHORT_CASE_LIKELY;
+    cohort_case <= ACY_COHORT_CASE_MAX;
+    ++cohort_case
+  ) {
+    acy_cohort_case_params *params = &compiled->cases[cohort_case];
+    acy_get_cohort_case_parameters(
+      cohort_case,
+      info,
+      &params->cohort_size,
+      &params->cohort_adjust,
+      &params->cohort_fraction
+    );
+    acy_divisor_init(&params->cohort_div, params->cohort_size);
+    // Which set of plans to use (the shifted case shares the likely size):
+    id plan_set = cohort_case;
+    if (cohort_case == ACY_COHORT_CASE_SHIFTED) {
+      plan_set = ACY_COHORT_CASE_LIKELY;
+    }
+    if (
+      cohort_case == ACY_COHORT_CASE_MAX
+   || params->cohort_size < MIN_COHORT_SIZE // plans only match above this
+    ) {
+      params->plans = NULL;
+    } else {
+      params->plans = compiled->partner_plans + plan_set * max_partners;
+    }
+    if (plan_set == cohort_case && params->plans != NULL) {
+      for (id which = 0; which < max_partners; ++which) {
+        acy_shuffle_plan_init(
+          &compiled->partner_plans[plan_set * max_partners + which],
+          params->cohort_size,
+          info->seed + (28999 * which)
+        );
+      }
+    }
+  }
+  return compiled;
+}
+
+void acy_destroy_compiled_family(acy_compiled_family *compiled) {
+  if (compiled == NULL) {
     return;
   }
-  // which nth partner match did this parent start on:
+  for (id i = 0; i < ACY_FAMILY_MEMO_SIZE; ++i) {
+    if (acy_thread_compiled_families[i] == compiled) {
+      memmove(
+        &acy_thread_compiled_families[i],
+        &acy_thread_compiled_families[i + 1],
+        sizeof(acy_compiled_family*) * (ACY_FAMILY_MEMO_SIZE - 1 - i)
+      );
+      acy_thread_compiled_families[ACY_FAMILY_MEMO_SIZE - 1] = NULL;
+      break;
+    }
+  }
+  acy_destroy_select_ctx(compiled->select);
+  free(compiled->partner_plans);
+  free(compiled);
+}
+
+acy_family_info const * acy_compiled_family_info(
+  acy_compiled_family const * const compiled
+) {
+  return &compiled->info;
+}
+
+void acy_release_thread_family_memo(void) {
+  while (acy_thread_compiled_families[0] != NULL) {
+    // (this removes it from the memo, moving the rest up)
+    acy_destroy_compiled_family(acy_thread_compiled_families[0]);
+  }
+}
+
+static void acy_family_memo_thread_exit(void *memos) {
+  acy_release_thread_family_memo();
+}
+
+static void acy_family_memo_key_init(void) {
+  acy_family_memo_key_ok = (
+    pthread_key_create(&acy_family_memo_key, &acy_family_memo_thread_exit)
+ == 0
+  );
+}
+
+// Returns a compiled version of the given info for use by the uncompiled
+// query functions, or NULL if it can't be compiled. Each thread keeps its
+// ACY_FAMILY_MEMO_SIZE most recently used compiled infos around, so callers
+// alternating between a few infos don't recompile; on a miss, the least
+// recently used one is replaced.
+static inline acy_compiled_family const * acy_family_memo(
+  acy_family_info const * const info
+) {
+  acy_compiled_family **memos = acy_thread_compiled_families;
+  acy_compiled_family *memo = memos[0];
+  if (
+    memo != NULL
+ && memcmp(&memo->info, info, sizeof(acy_family_info)) == 0
+  ) {
+    return memo;
+  }
+  id found = 1;
+  while (
+    found < ACY_FAMILY_MEMO_SIZE
+ && memos[found] != NULL
+ && memcmp(&memos[found]->info, info, sizeof(acy_family_info)) != 0
+  ) {
+    found += 1;
+  }
+  if (found < ACY_FAMILY_MEMO_SIZE && memos[found] != NULL) {
+    memo = memos[found];
+  } else {
+    memo = acy_compile_family_info(info);
+    if (memo == NULL) {
+      return NULL;
+    }
+    // Make sure this thread's memo is released when it exits (the key's
+    // destructor only runs for threads with a non-NULL value):
+    pthread_once(&acy_family_memo_once, &acy_family_memo_key_init);
+    if (acy_family_memo_key_ok) {
+      pthread_setspecific(acy_family_memo_key, memos);
+    }
+    found = ACY_FAMILY_MEMO_SIZE - 1;
+    acy_compiled_family *evicted = memos[found];
+    memos[found] = NULL; // so destroying it doesn't shift the others
+    acy_destroy_compiled_family(evicted);
+  }
+  memmove(&memos[1], &memos[0], sizeof(acy_compiled_family*) * found);
+  memos[0] = memo;
+  return memo;
+}
+
+// Forward and reverse partner shuffles, using plans where possible (beyond
+// max_partners_per_mother they fall back to the cached shuffles).
+static inline id acy_compiled_partner_shuffle(
+  acy_cohort_case_params const * const params,
+  id inner,
+  id which_partner,
+  acy_compiled_family const * const compiled
+) {
+  if (
+    params->plans != NULL
+ && which_partner < compiled->info.max_partners_per_mother
+  ) {
+    return acy_planned_cohort_shuffle(inner, &params->plans[which_partner]);
+  }
+  return acy_cached_cohort_shuffle(
+    inner,
+    params->cohort_size,
+    compiled->info.seed + (28999 * which_partner)
+  );
+}
+
+static inline id acy_compiled_rev_partner_shuffle(
+  acy_cohort_case_params const * const params,
+  id shuffled,
+  id which_partner,
+  acy_compiled_family const * const compiled
+) {
+  if (
+    params->plans != NULL
+ && which_partner < compiled->info.max_partners_per_mother
+  ) {
+    return acy_planned_rev_cohort_shuffle(
+      shuffled,
+      &params->plans[which_partner]
+    );
+  }
+  return acy_cached_rev_cohort_shuffle(
+    shuffled,
+    params->cohort_size,
+    compiled->info.seed + (28999 * which_partner)
+  );
+}
+
+// Returns the calling thread's cache entry for a person if it holds the
+// wanted values (see famcache.h), or NULL, including when no cache is
+// installed.
+static inline acy_family_cache_entry const * acy_family_cached(
+  id person,
+  id want,
+  acy_compiled_family const * const compiled
+) {
+  if (acy_thread_family_cache == NULL) {
+    return NULL;
+  }
+  return acy_family_cache_lookup(
+    acy_thread_family_cache,
+    compiled->generation,
+    person,
+    want
+  );
+}
+
+// Returns the calling thread's cache entry for a person, creating it if
+// needed, so that values can be stored there. Returns NULL when no cache is
+// installed or the entry can't be created.
+static inline acy_family_cache_entry * acy_family_caching(
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  if (acy_thread_family_cache == NULL) {
+    return NULL;
+  }
+  return acy_family_cache_store(
+    acy_thread_family_cache,
+    compiled->generation,
+    person
+  );
+}
+
+/********************
+ * Compiled Queries *
+ ********************/
+
+id acy_compiled_birthdate(
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  id result;
+  if (
+    compiled->info.snapshot != NULL
+ && acy_snapshot_birthdate(compiled->info.snapshot, person, &result)
+  ) {
+    return result;
+  }
+  acy_family_cache_entry const *hit = acy_family_cached(
+    person,
+    ACY_FAMILY_CACHE_BIRTHDATE,
+    compiled
+  );
+  if (hit != NULL) {
+    return hit->birthdate;
+  }
+  result = acy_mixed_cohort_div(
+    person,
+    &compiled->birth_rate_div,
+    compiled->info.seed + 17
+  );
+  acy_family_cache_entry *entry = acy_family_caching(person, compiled);
+  if (entry != NULL) {
+    entry->birthdate = result;
+    entry->known |= ACY_FAMILY_CACHE_BIRTHDATE;
+  }
+  return result;
+}
+
+id acy_compiled_first_born_on(
+  id day,
+  acy_compiled_family const * const compiled
+) {
+  return acy_mixed_cohort_outer(
+    day,
+    0,
+    compiled->info.birth_rate_per_day,
+    compiled->info.seed + 17
+  );
+}
+
+id acy_compiled_mother(id person, acy_compiled_family const * const compiled) {
+  id parent, index;
+  acy_compiled_mother_and_index(person, compiled, &parent, &index);
+  return parent;
+}
+
+void acy_compiled_mother_and_index(
+  id person,
+  acy_compiled_family const * const compiled,
+  id *r_mother,
+  id *r_index
+) {
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "\nacy_mother_and_index::person::%lu\n", person);
+#endif
+  if (person == NONE) {
+    *r_mother = NONE;
+    *r_index = 0;
+    return;
+  }
+  if (
+    compiled->info.snapshot != NULL
+ && acy_snapshot_mother_and_index(
+      compiled->info.snapshot,
+      person,
+      r_mother,
+      r_index
+    )
+  ) {
+    return;
+  }
+
+  // Correct age gap:
+  id adjusted = person - compiled->child_id_adjust;
+  /*
+   * TODO: Check underflow!
+  if (adjusted > person) { // underflow
+    *r_mother = NONE;
+    *r_index = 0;
+    return;
+  }
+  */
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "acy_mother_and_index::adjusted::%lu\n", adjusted);
+#endif
+  id mother, index;
+  acy_select_table_parent_and_index_ctx(
+    adjusted,
+    compiled->select,
+    &mother,
+    &index
+  );
+#ifdef DEBUG_FAMILY
+  fprintf(
+    stderr,
+    "acy_mother_and_index::mother/index::%lu/%lu\n",
+    mother,
+    index
+  );
+#endif
+
+  *r_mother = acy_child_bearer(mother);
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "acy_mother_and_index::adjusted_mother::%lu\n", *r_mother);
+#endif
+  if (mother != *r_mother) {
+    // Our final index is our index as a 'child' of our mother's duo plus the
+    // number of direct children our actual mother has:
+    index += acy_count_select_table_children_ctx(*r_mother, compiled->select);
+#ifdef DEBUG_FAMILY
+    fprintf(stderr, "acy_mother_and_index::adjusted_index::%lu\n", index);
+#endif
+  }
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "\n");
+#endif
+  *r_index = index;
+
+  /*
+   * TODO: Check underflow
+  if (*r_mother > person) { // underflow
+    *r_mother = NONE;
+    *r_index = 0;
+    return;
+  }
+  */
+}
+
+id acy_compiled_direct_child(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+) {
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "\nacy_direct_child::person/nth::%lu/%lu\n", person, nth);
+#endif
+  if (!acy_is_child_bearer(person)) {
+    return NONE;
+  }
+  id const *listed;
+  id count;
+  if (
+    compiled->info.snapshot != NULL
+ && acy_snapshot_children(compiled->info.snapshot, person, &listed, &count)
+  ) {
+    return nth < count ? listed[nth] : NONE;
+  }
+  id first_count = acy_count_select_table_children_ctx(
+    person,
+    compiled->select
+  );
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "acy_direct_child::first_count::%lu\n", first_count);
+#endif
+  id child;
+  if (nth < first_count) {
+    child = acy_select_table_nth_child_ctx(person, nth, compiled->select);
+#ifdef DEBUG_FAMILY
+    fprintf(stderr, "acy_direct_child::child(first)::%lu\n", child);
+#endif
+  } else { // get children that would think our duo is their parent:
+    child = acy_select_table_nth_child_ctx(
+      acy_child_bearers_duo(person),
+      nth - first_count,
+      compiled->select
+    );
+#ifdef DEBUG_FAMILY
+    fprintf(stderr, "acy_direct_child::child(second)::%lu\n", child);
+#endif
+  }
+  if (child == NONE) { return NONE; } // mother doesn't have this many children
+  // Introduce age gap:
+  id adjusted = child + compiled->child_id_adjust;
+#ifdef DEBUG_FAMILY
+  fprintf(stderr, "acy_direct_child::adjusted::%lu\n\n", adjusted);
+#endif
+  /*
+   * TODO: Check overflow
+  if (adjusted < child || child < person) { return NONE; } // overflow
+  */
+  return adjusted;
+}
+
+id acy_compiled_num_direct_children(
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  if (person == NONE || !acy_is_child_bearer(person)) {
+    return 0;
+  }
+  id result;
+  if (
+    compiled->info.snapshot != NULL
+ && acy_snapshot_num_direct_children(compiled->info.snapshot, person, &result)
+  ) {
+    return result;
+  }
+  acy_family_cache_entry const *hit = acy_family_cached(
+    person,
+    ACY_FAMILY_CACHE_DIRECT_CHILDREN,
+    compiled
+  );
+  if (hit != NULL) {
+    return hit->num_direct_children;
+  }
+  result = acy_count_select_table_children_ctx(
+    person,
+    compiled->select
+  ) + acy_count_select_table_children_ctx(
+    acy_child_bearers_duo(person),
+    compiled->select
+  );
+  acy_family_cache_entry *entry = acy_family_caching(person, compiled);
+  if (entry != NULL) {
+    entry->num_direct_children = result;
+    entry->known |= ACY_FAMILY_CACHE_DIRECT_CHILDREN;
+  }
+  return result;
+}
+
+// Lists a child-bearer's direct children, writing up to cap of them into out
+// so that out[n] == acy_compiled_direct_child(person, n, compiled). Returns
+// the total number of direct children.
+static id acy_compiled_direct_children(
+  id person,
+  acy_compiled_family const * const compiled,
+  id *out,
+  id cap
+) {
+  id first = acy_select_table_children_ctx(person, compiled->select, out, cap);
+  id written = acy_min(first, cap);
+  id second = acy_select_table_children_ctx(
+    acy_child_bearers_duo(person),
+    compiled->select,
+    out + written,
+    cap - written
+  );
+  written = acy_min(first + second, cap);
+  for (id i = 0; i < written; ++i) {
+    if (out[i] != NONE) {
+      out[i] += compiled->child_id_adjust; // introduce age gap
+    }
+  }
+  return first + second;
+}
+
+static inline id acy_num_potential_partners(acy_family_info const * const info){
+  // there are four possible cohort cases
+  return 4 * info->max_partners_per_mother;
+}
+
+// Returns a plan for the given shuffle from the memo, or NULL if the memo is
+// NULL or the cohort is too small for plans to match direct shuffles.
+static inline acy_shuffle_plan const * acy_plan_memo_get(
+  acy_plan_memo *memo,
+  id cohort_size,
+  id seed
+) {
+  if (memo == NULL || cohort_size < MIN_COHORT_SIZE) {
+    return NULL;
+  }
+  id slot = (
+    (seed ^ (cohort_size * 0x9e3779b97f4a7c15)) * 0xff51afd7ed558ccd
+  ) >> 52;
+  if (memo->sizes[slot] != cohort_size || memo->seeds[slot] != seed) {
+    acy_shuffle_plan_init(&memo->plans[slot], cohort_size, seed);
+    memo->sizes[slot] = cohort_size;
+    memo->seeds[slot] = seed;
+  }
+  return &memo->plans[slot];
+}
+
+// Versions of acy_mixed_cohort_and_inner_div and acy_mixed_cohort_outer that
+// use plans from a memo (which may be NULL).
+static inline void acy_memo_mixed_cohort_and_inner(
+  acy_plan_memo *memo,
+  id outer,
+  acy_divisor const * const cohort_div,
+  id seed,
+  id *r_cohort,
+  id *r_inner
+) {
+  id cohort_size = cohort_div->d;
+  id strict_cohort, strict_inner;
+  acy_divmod(outer, cohort_div, &strict_cohort, &strict_inner);
+  acy_shuffle_plan const *plan = acy_plan_memo_get(
+    memo,
+    cohort_size,
+    seed + strict_cohort
+  );
+  if (plan == NULL) {
+    acy_mixed_cohort_and_inner_div(outer, cohort_div, seed, r_cohort, r_inner);
+    return;
+  }
+  id shuf = acy_planned_cohort_shuffle(strict_inner, plan);
+  id lower = shuf < cohort_size/2;
+  *r_cohort = (
+     lower * (strict_cohort + 1)
+  + !lower * (strict_cohort)
+  );
+  *r_inner = shuf;
+}
+
+static inline id acy_memo_mixed_cohort_outer(
+  acy_plan_memo *memo,
+  id cohort,
+  id inner,
+  id cohort_size,
+  id seed
+) {
+  id lower = inner < cohort_size/2;
+  id strict_cohort = (
+     lower * (cohort - 1)
+  + !lower * cohort
+  );
+  acy_shuffle_plan const *plan = acy_plan_memo_get(
+    memo,
+    cohort_size,
+    seed + strict_cohort
+  );
+  if (plan == NULL) {
+    return acy_mixed_cohort_outer(cohort, inner, cohort_size, seed);
+  }
+  id unshuf = acy_planned_rev_cohort_shuffle(inner, plan);
+  return acy_cohort_outer(strict_cohort, unshuf, cohort_size);
+}
+
+// Finds the child-bearer who would be a non-child-bearer's potential partner
+// for the given cohort case and which_partner value, before checking how many
+// partners they have (see acy_compiled_nth_potential_partner_and_index).
+// Returns 0 if that candidate is fractionated away, and 1 otherwise. The plan
+// memo may be NULL.
+static inline int acy_compiled_potential_candidate(
+  id person,
+  id cohort_case,
+  id which_partner,
+  acy_compiled_family const * const compiled,
+  acy_plan_memo *memo,
+  id *r_candidate
+) {
+  acy_family_info const * const info = &compiled->info;
+  if (cohort_case > ACY_COHORT_CASE_MAX) {
+    cohort_case = ACY_COHORT_CASE_MAX;
+  }
+
+  // Get case parameters:
+  acy_cohort_case_params const * const params = &compiled->cases[cohort_case];
+
+  // Find match:
+  id cohort, inner;
+  acy_memo_mixed_cohort_and_inner(
+    memo,
+    acy_separated(person),
+    &params->cohort_div,
+    info->seed + (83923 * which_partner),
+    &cohort,
+    &inner
+  );
+  if (inner < params->cohort_fraction) {
+    // a fractionated partner can't be chosen
+    return 0;
+  }
+  cohort += params->cohort_adjust; // adjust cohort to correct age gap
+  id unshuf = acy_compiled_rev_partner_shuffle(
+    params,
+    inner,
+    which_partner,
+    compiled
+  );
+  id candidate = acy_memo_mixed_cohort_outer(
+    memo,
+    cohort,
+    unshuf,
+    params->cohort_size,
+    info->seed + (83923 * which_partner)
+  );
+  *r_candidate = acy_sep_child_bearer(candidate);
+  return 1;
+}
+
+// Returns the partner that acy_compiled_bearer_partner picks for a
+// child-bearer and which_partner value, without checking any child ages.
+// That function returns the match from the last cohort case it doesn't skip,
+// and it never skips the shifted case (whose fraction is 0), so only the
+// shifted case's match matters. The plan memo may be NULL.
+static inline id acy_compiled_final_partner_match(
+  id person,
+  id which_partner,
+  acy_compiled_family const * const compiled,
+  acy_plan_memo *memo
+) {
+  acy_family_info const * const info = &compiled->info;
+  acy_cohort_case_params const * const params = (
+    &compiled->cases[ACY_COHORT_CASE_SHIFTED]
+  );
+  id cohort, inner;
+  acy_memo_mixed_cohort_and_inner(
+    memo,
+    acy_separated(person),
+    &params->cohort_div,
+    info->seed + (1827 * which_partner),
+    &cohort,
+    &inner
+  );
+  id shuf = acy_compiled_partner_shuffle(
+    params,
+    inner,
+    which_partner,
+    compiled
+  );
+  id sep_match = acy_memo_mixed_cohort_outer(
+    memo,
+    cohort,
+    shuf,
+    params->cohort_size,
+    info->seed + (83923 * which_partner)
+  );
+  return acy_sep_non_child_bearer(sep_match);
+}
+
+void acy_compiled_nth_potential_partner_and_index(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled,
+  id *r_partner,
+  id *r_nth
+) {
+  acy_family_info const * const info = &compiled->info;
+  id cohort_case, which_partner, unsep;
+  acy_divmod(nth, &compiled->max_partners_div, &cohort_case, &which_partner);
+  if (
+    acy_is_child_bearer(person) // child-bearers only have real partners
+ || !acy_compiled_potential_candidate(
+      person,
+      cohort_case,
+      which_partner,
+      compiled,
+      NULL,
+      &unsep
+    )
+  ) {
+    *r_partner = NONE;
+    *r_nth = 0;
+    return;
+  }
+  id num_actual = acy_compiled_num_partners(unsep, compiled);
+  if (which_partner >= num_actual) {
+    // that other person doesn't have enough partners to include us
+    *r_partner = NONE;
+    *r_nth = 0;
+    return;
+  }
+  // which nth partner match did this parent start on:
   id start = (unsep + info->seed) % num_actual;
   // subtract without overflow:
   id adj_which = (which_partner + num_actual - start) % num_actual;
 
-  // Set output variables:
-  *r_partner = unsep;
-  *r_nth = adj_which;
+  // Set output variables:
+  *r_partner = unsep;
+  *r_nth = adj_which;
+}
+
+// Finds every partner of a non-child-bearer, in potential partner order,
+// along with which partner of theirs this person is. r_partners and r_indices
+// must have room for acy_num_potential_partners entries. Returns the number
+// of partners found. The plan memo may be NULL.
+static id acy_compiled_find_partners(
+  id person,
+  acy_compiled_family const * const compiled,
+  acy_plan_memo *memo,
+  id *r_partners,
+  id *r_indices
+) {
+  acy_family_info const * const info = &compiled->info;
+  id partner_count = 0;
+  id num_potential = acy_num_potential_partners(info);
+  for (id nth = 0; nth < num_potential; ++nth) {
+    id cohort_case, which_partner, candidate;
+    acy_divmod(nth, &compiled->max_partners_div, &cohort_case, &which_partner);
+    if (
+      !acy_compiled_potential_candidate(
+        person,
+        cohort_case,
+        which_partner,
+        compiled,
+        memo,
+        &candidate
+      )
+   || candidate == NONE
+      // Skip the partner count and full check for candidates whose match
+      // isn't this person (almost all of them):
+   || acy_compiled_final_partner_match(
+        candidate,
+        which_partner,
+        compiled,
+        memo
+      ) != person
+    ) {
+      continue;
+    }
+    id num_actual = acy_compiled_num_partners(candidate, compiled);
+    if (which_partner >= num_actual) {
+      continue; // they don't have enough partners to include us
+    }
+    // which nth partner match did this parent start on:
+    id start = (candidate + info->seed) % num_actual;
+    // subtract without overflow:
+    id partner_index = (which_partner + num_actual - start) % num_actual;
+    id check = acy_compiled_nth_partner(candidate, partner_index, compiled);
+    if (check == person) {
+      r_partners[partner_count] = candidate;
+      r_indices[partner_count] = partner_index;
+      partner_count += 1;
+    }
+  }
+  return partner_count;
+}
+
+// Works like acy_compiled_find_partners, but uses the calling thread's cache
+// (if any) to remember the results.
+static id acy_compiled_partner_list(
+  id person,
+  acy_compiled_family const * const compiled,
+  id *r_partners,
+  id *r_indices
+) {
+  acy_family_cache_entry const *hit = acy_family_cached(
+    person,
+    ACY_FAMILY_CACHE_PARTNERS,
+    compiled
+  );
+  if (hit != NULL) {
+    memcpy(r_partners, hit->partners, hit->num_partners * sizeof(id));
+    memcpy(r_indices, hit->partner_indices, hit->num_partners * sizeof(id));
+    return hit->num_partners;
+  }
+  id count = acy_compiled_find_partners(
+    person,
+    compiled,
+    NULL,
+    r_partners,
+    r_indices
+  );
+  acy_family_cache_entry *entry = acy_family_caching(person, compiled);
+  if (entry != NULL) {
+    acy_family_cache_store_partners(
+      acy_thread_family_cache,
+      entry,
+      count,
+      r_partners,
+      r_indices
+    );
+  }
+  return count;
+}
+
+// Decides the number of partners for a child-bearer with the given number of
+// direct children (see acy_compiled_num_partners).
+static inline id acy_compiled_bearer_num_partners(
+  id person,
+  id child_count,
+  acy_compiled_family const * const compiled
+) {
+  acy_family_info const * const info = &compiled->info;
+  id num_partners = 1;
+  id random = acy_prng(person, info->seed + 48935729874918238);
+  while (
+    random % 100 < info->multiple_partners_percent
+ && num_partners < child_count
+  ) {
+    num_partners += 1;
+    random = acy_prng(random, info->seed + 48935729874918238 + num_partners);
+  }
+  return num_partners;
+}
+
+// Returns the partner that a child-bearer chose for the given which_partner
+// value (see acy_compiled_nth_partner). If children isn't NULL, it must hold
+// all of the child-bearer's direct children (see
+// acy_compiled_direct_children); they're only used to check partner ages
+// when DEBUG_FAMILY is defined.
+//
+// The partner comes from the SHIFTED cohort case: each earlier case is
+// replaced by any later one whose shuffled index isn't excluded by its
+// cohort fraction, and the SHIFTED case has no exclusion, so it always wins.
+// (The partner age checks never changed the choice, either.)
+static id acy_compiled_bearer_partner(
+  id person,
+  id which_partner,
+  id child_count,
+  id num_partners,
+  id const *children,
+  acy_compiled_family const * const compiled
+) {
+  acy_family_info const * const info = &compiled->info;
+  acy_cohort_case_params const * const params = (
+    &compiled->cases[ACY_COHORT_CASE_SHIFTED]
+  );
+  id cohort, inner;
+  acy_mixed_cohort_and_inner_div(
+    acy_separated(person),
+    &params->cohort_div,
+    info->seed + (1827 * which_partner),
+    &cohort,
+    &inner
+  );
+  id shuf = acy_compiled_partner_shuffle(
+    params,
+    inner,
+    which_partner,
+    compiled
+  );
+  id sep_match = acy_mixed_cohort_outer(
+    cohort,
+    shuf,
+    params->cohort_size,
+    info->seed + (83923 * which_partner)
+  );
+  id candidate = acy_sep_non_child_bearer(sep_match);
+
+#ifdef DEBUG_FAMILY
+  // which nth partner match did this parent start on:
+  id start = (person + info->seed) % child_count;
+
+  // check the partner/parent age gap for each child with this partner:
+  for (
+    id child_index = start;
+    child_index < child_count;
+    child_index += num_partners
+  ) {
+    id child;
+    if (children != NULL) {
+      child = children[child_index];
+    } else {
+      child = acy_compiled_direct_child(person, child_index, compiled);
+    }
+    if (
+      acy_compiled_birthdate(candidate, compiled)
+    - acy_compiled_birthdate(child, compiled)
+    < info->min_partner_age
+    ) {
+      fprintf(
+        stderr,
+        "Error; even shifting wasn't enough to ensure partner age!\n"
+        "  Child-bearer: %lu  Shifted partner: %lu  Child: %lu\n"
+        "  Birthdates:   %lu                   %lu         %lu\n",
+        person, candidate, child,
+        acy_compiled_birthdate(person, compiled),
+        acy_compiled_birthdate(candidate, compiled),
+        acy_compiled_birthdate(child, compiled)
+      );
+    }
+  }
+#endif
+
+  return candidate;
+}
+
+id acy_compiled_num_partners(
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  acy_family_info const * const info = &compiled->info;
+  id const *listed;
+  id count;
+  if (
+    info->snapshot != NULL
+ && acy_snapshot_partners(info->snapshot, person, &listed, &count)
+  ) {
+    return count;
+  }
+  if (acy_is_child_bearer(person)) {
+    return acy_compiled_bearer_num_partners(
+      person,
+      acy_compiled_num_direct_children(person, compiled),
+      compiled
+    );
+  } else {
+    id num_potential = acy_num_potential_partners(info);
+    id partners[num_potential];
+    id indices[num_potential];
+    return acy_compiled_partner_list(person, compiled, partners, indices);
+  }
+}
+
+id acy_compiled_nth_partner(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+) {
+  acy_family_info const * const info = &compiled->info;
+  id const *listed;
+  id count;
+  if (
+    info->snapshot != NULL
+ && acy_snapshot_partners(info->snapshot, person, &listed, &count)
+  ) {
+    if (acy_is_child_bearer(person)) {
+      // (see below)
+      if (nth >= acy_compiled_num_direct_children(person, compiled)) {
+        return NONE;
+      }
+      return listed[(nth + person + info->seed) % count];
+    }
+    // nth counts from 1 for non-child-bearers (see below):
+    return nth >= 1 && nth <= count ? listed[nth - 1] : NONE;
+  }
+  if (acy_is_child_bearer(person)) {
+    id child_count = acy_compiled_num_direct_children(person, compiled);
+    if (nth >= child_count) {
+      return NONE;
+    }
+    id num_partners = acy_compiled_num_partners(person, compiled);
+    // Note: child ages are unrelated to child ordering, so scrambling partners
+    // here won't hurt partner continuity. Actually improving partner
+    // continuity would be a good thing of course :) Also note: adding the
+    // person and seed ensures that non-child-bearers can have multiple single
+    // children with different mothers.
+    id which_partner = (nth + person + info->seed) % num_partners;
+    if (acy_thread_family_cache == NULL) {
+      return acy_compiled_bearer_partner(
+        person,
+        which_partner,
+        child_count,
+        num_partners,
+        NULL,
+        compiled
+      );
+    }
+    acy_family_cache_entry const *hit = acy_family_cached(
+      person,
+      ACY_FAMILY_CACHE_PARTNERS,
+      compiled
+    );
+    if (hit != NULL) {
+      return hit->partners[which_partner];
+    }
+    // Find and remember all of this person's partners at once:
+    id partners[num_partners];
+    for (id which = 0; which < num_partners; ++which) {
+      partners[which] = acy_compiled_bearer_partner(
+        person,
+        which,
+        child_count,
+        num_partners,
+        NULL,
+        compiled
+      );
+    }
+    acy_family_cache_entry *entry = acy_family_caching(person, compiled);
+    if (entry != NULL) {
+      acy_family_cache_store_partners(
+        acy_thread_family_cache,
+        entry,
+        num_partners,
+        partners,
+        NULL
+      );
+    }
+    return partners[which_partner];
+  } else if (acy_thread_family_cache != NULL) {
+    id num_potential = acy_num_potential_partners(info);
+    id partners[num_potential];
+    id indices[num_potential];
+    id count = acy_compiled_partner_list(person, compiled, partners, indices);
+    // nth counts from 1 here (see below):
+    if (nth >= 1 && nth <= count) {
+      return partners[nth - 1];
+    }
+    return NONE;
+  } else {
+    id candidate = NONE;
+    id partner_index = 0;
+    id num_potential = acy_num_potential_partners(info);
+    for (id any = 0; any < num_potential; ++any) {
+      acy_compiled_nth_potential_partner_and_index(
+        person,
+        any,
+        compiled,
+        &candidate,
+        &partner_index
+      );
+      if (candidate == NONE) {
+        continue;
+      }
+      id check = acy_compiled_nth_partner(candidate, partner_index, compiled);
+      if (check == person) {
+        nth -= 1;
+        if (nth == 0) {
+          return candidate;
+        }
+      }
+    }
+    // nth is too large or the for loop above failed somehow
+    return NONE;
+  }
+}
+
+// Finds the nth child of a non-child-bearer with the given partner (see
+// acy_compiled_child), returning 1 and setting r_child. If there aren't
+// enough children with that partner, returns 0 and reduces *nth by the
+// number there are.
+static inline int acy_compiled_child_with_partner(
+  id partner,
+  id partner_index,
+  id *nth,
+  acy_compiled_family const * const compiled,
+  id *r_child
+) {
+  id num_partners = acy_compiled_num_partners(partner, compiled);
+  id child_count = acy_compiled_num_direct_children(partner, compiled);
+  // figure out how many children we had with this partner:
+  id children_with_this_partner = child_count / num_partners;
+  // don't forget about leftovers in the mod math:
+  id leftovers = child_count - num_partners * children_with_this_partner;
+  if (partner_index < leftovers) {
+    children_with_this_partner += 1;
+  }
+  if (*nth < children_with_this_partner) { // we've found the right match:
+    *r_child = acy_compiled_direct_child(
+      partner,
+      num_partners * (*nth) + partner_index,
+      compiled
+    );
+    return 1;
+  }
+  // otherwise there weren't enough children with that partner:
+  *nth -= children_with_this_partner;
+  return 0;
+}
+
+id acy_compiled_child(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+) {
+  if (acy_is_child_bearer(person)) {
+    return acy_compiled_direct_child(person, nth, compiled);
+  }
+  id const *listed;
+  id count;
+  if (
+    compiled->info.snapshot != NULL
+ && acy_snapshot_children(compiled->info.snapshot, person, &listed, &count)
+ && nth < count
+  ) {
+    // (past the end, non-child-bearers can rarely still have a child here;
+    // see acy_compiled_person_record)
+    return listed[nth];
+  }
+  id num_potential = acy_num_potential_partners(&compiled->info);
+  id result;
+  if (acy_thread_family_cache != NULL) {
+    id partners[num_potential];
+    id indices[num_potential];
+    id count = acy_compiled_partner_list(person, compiled, partners, indices);
+    for (id i = 0; i < count; ++i) {
+      if (
+        acy_compiled_child_with_partner(
+          partners[i],
+          indices[i],
+          &nth,
+          compiled,
+          &result
+        )
+      ) {
+        return result;
+      }
+    }
+  } else {
+    id candidate = NONE;
+    id partner_index = 0;
+    for (id any = 0; any < num_potential; ++any) {
+      acy_compiled_nth_potential_partner_and_index(
+        person,
+        any,
+        compiled,
+        &candidate,
+        &partner_index
+      );
+      if (candidate == NONE) {
+        continue;
+      }
+      id check = acy_compiled_nth_partner(candidate, partner_index, compiled);
+      if (check == person) {
+        if (
+          acy_compiled_child_with_partner(
+            candidate,
+            partner_index,
+            &nth,
+            compiled,
+            &result
+          )
+        ) {
+          return result;
+        }
+      }
+    }
+  }
+  // Didn't find anyone who both selected us as their Nth partner and had at
+  // least N partners total (takes O(max_partners_per_mother) iterations).
+  return NONE;
+}
+
+id acy_compiled_num_children(
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  acy_family_info const * const info = &compiled->info;
+  id const *listed;
+  id count;
+  if (
+    info->snapshot != NULL
+ && acy_snapshot_children(info->snapshot, person, &listed, &count)
+  ) {
+    return count;
+  }
+  if (acy_is_child_bearer(person)) {
+    return acy_compiled_num_direct_children(person, compiled);
+  } else {
+    id total_children = 0;
+    id num_potential = acy_num_potential_partners(info);
+    id partners[num_potential];
+    id indices[num_potential];
+    id count = acy_compiled_partner_list(person, compiled, partners, indices);
+    for (id i = 0; i < count; ++i) {
+      id candidate = partners[i];
+      id partner_index = indices[i];
+      id child_count = acy_compiled_num_direct_children(candidate, compiled);
+      id num_partners = acy_compiled_num_partners(candidate, compiled);
+      // which nth partner match did this parent start on:
+      id start = (candidate + info->seed) % num_partners;
+      // subtract without overflow:
+      id adj_which = (partner_index + num_partners - start) % num_partners;
+      // figure out how many children we had with this partner:
+      id children_with_this_partner = child_count / num_partners;
+      // don't forget about leftovers in the mod math:
+      id leftovers = child_count - num_partners * children_with_this_partner;
+      if (adj_which < leftovers) {
+        children_with_this_partner += 1;
+      }
+      total_children += children_with_this_partner;
+    }
+    return total_children;
+  }
+}
+
+void acy_compiled_person_record(
+  id person,
+  acy_compiled_family const * const compiled,
+  acy_person_record *r_record
+) {
+  acy_family_info const * const info = &compiled->info;
+  r_record->person = person;
+  r_record->birthdate = acy_compiled_birthdate(person, compiled);
+  acy_compiled_mother_and_index(
+    person,
+    compiled,
+    &r_record->mother,
+    &r_record->index
+  );
+
+  if (acy_is_child_bearer(person)) {
+    id child_count = acy_compiled_num_direct_children(person, compiled);
+    id children[child_count + 1]; // never zero-length
+    acy_compiled_direct_children(person, compiled, children, child_count);
+    id num_partners = acy_compiled_bearer_num_partners(
+      person,
+      child_count,
+      compiled
+    );
+    r_record->num_direct_children = child_count;
+    r_record->num_children = child_count;
+    r_record->num_partners = num_partners;
+    for (id i = 0; i < acy_min(child_count, r_record->children_cap); ++i) {
+      r_record->children[i] = children[i];
+    }
+    for (id w = 0; w < acy_min(num_partners, r_record->partners_cap); ++w) {
+      if (child_count == 0) {
+        r_record->partners[w] = NONE;
+      } else {
+        r_record->partners[w] = acy_compiled_bearer_partner(
+          person,
+          w,
+          child_count,
+          num_partners,
+          children,
+          compiled
+        );
+      }
+    }
+    return;
+  }
+
+  // For non-child-bearers, find partners just once:
+  id num_potential = acy_num_potential_partners(info);
+  id partners[num_potential];
+  id indices[num_potential];
+  id count = acy_compiled_partner_list(person, compiled, partners, indices);
+  r_record->num_direct_children = 0;
+  r_record->num_partners = count;
+  for (id i = 0; i < acy_min(count, r_record->partners_cap); ++i) {
+    r_record->partners[i] = partners[i];
+  }
+
+  // Count children with each partner (see acy_compiled_num_children and
+  // acy_compiled_child, which count them slightly differently):
+  id partner_children[num_potential];
+  id partner_num_partners[num_potential];
+  id listed_children[num_potential];
+  id total_children = 0;
+  for (id i = 0; i < count; ++i) {
+    id candidate = partners[i];
+    id child_count = acy_compiled_num_direct_children(candidate, compiled);
+    id num_partners = acy_compiled_bearer_num_partners(
+      candidate,
+      child_count,
+      compiled
+    );
+    // which nth partner match did this parent start on:
+    id start = (candidate + info->seed) % num_partners;
+    // subtract without overflow:
+    id adj_which = (indices[i] + num_partners - start) % num_partners;
+    id children_with_this_partner = child_count / num_partners;
+    id leftovers = child_count - num_partners * children_with_this_partner;
+    total_children += children_with_this_partner + (adj_which < leftovers);
+    listed_children[i] = children_with_this_partner + (indices[i] < leftovers);
+    partner_children[i] = child_count;
+    partner_num_partners[i] = num_partners;
+  }
+  r_record->num_children = total_children;
+
+  // List children in acy_compiled_child order:
+  id cap = acy_min(total_children, r_record->children_cap);
+  id listed = 0;
+  for (id i = 0; i < count && listed < cap; ++i) {
+    if (listed_children[i] == 0) {
+      continue;
+    }
+    id children[partner_children[i]];
+    acy_compiled_direct_children(
+      partners[i],
+      compiled,
+      children,
+      partner_children[i]
+    );
+    for (id nth = 0; nth < listed_children[i] && listed < cap; ++nth) {
+      id which = partner_num_partners[i] * nth + indices[i];
+      if (which < partner_children[i]) {
+        r_record->children[listed] = children[which];
+      } else {
+        r_record->children[listed] = NONE;
+      }
+      listed += 1;
+    }
+  }
+  for (; listed < cap; ++listed) {
+    r_record->children[listed] = NONE;
+  }
 }
 
-id acy_num_partners(id person, acy_family_info const * const info) {
-  id partner_count = 0;
-  if (acy_is_child_bearer(person)) {
-    id child_count = acy_num_direct_children(person, info);
-    id num_partners = 1;
-    id random = acy_prng(person, info->seed + 48935729874918238);
-    while (
-      random % 100 < info->multiple_partners_percent
-   && num_partners < child_count
+/*****************
+ * Partner Index *
+ *****************/
+
+acy_partner_index * acy_create_partner_index(
+  acy_compiled_family const * const compiled
+) {
+  acy_partner_index *index = (acy_partner_index*) calloc(
+    1,
+    sizeof(acy_partner_index)
+  );
+  if (index == NULL) {
+    return NULL;
+  }
+  index->compiled = compiled;
+  index->bucket_count = ACY_PARTNER_INDEX_INITIAL_BUCKETS;
+  index->buckets = (acy_partner_block**) calloc(
+    index->bucket_count,
+    sizeof(acy_partner_block*)
+  );
+  if (index->buckets == NULL) {
+    free(index);
+    return NULL;
+  }
+  return index;
+}
+
+void acy_destroy_partner_index(acy_partner_index *index) {
+  if (index == NULL) {
+    return;
+  }
+  for (id b = 0; b < index->bucket_count; ++b) {
+    acy_partner_block *block = index->buckets[b];
+    while (block != NULL) {
+      acy_partner_block *next = block->next;
+      free(block->entries);
+      free(block);
+      block = next;
+    }
+  }
+  free(index->buckets);
+  free(index->memo);
+  free(index);
+}
+
+// Returns the block with the given number, or NULL if it hasn't been built.
+static inline acy_partner_block * acy_partner_index_find(
+  acy_partner_index const * const index,
+  id number
+) {
+  acy_partner_block *block = index->buckets[
+    number & (index->bucket_count - 1)
+  ];
+  while (block != NULL && block->number != number) {
+    block = block->next;
+  }
+  return block;
+}
+
+// Doubles the bucket count once there are more blocks than buckets.
+static void acy_partner_index_grow(acy_partner_index *index) {
+  id new_count = index->bucket_count * 2;
+  acy_partner_block **new_buckets = (acy_partner_block**) calloc(
+    new_count,
+    sizeof(acy_partner_block*)
+  );
+  if (new_buckets == NULL) {
+    return; // just keep using longer chains
+  }
+  for (id b = 0; b < index->bucket_count; ++b) {
+    acy_partner_block *block = index->buckets[b];
+    while (block != NULL) {
+      acy_partner_block *next = block->next;
+      acy_partner_block **bucket = &new_buckets[block->number & (new_count-1)];
+      block->next = *bucket;
+      *bucket = block;
+      block = next;
+    }
+  }
+  free(index->buckets);
+  index->buckets = new_buckets;
+  index->bucket_count = new_count;
+}
+
+int acy_partner_index_build(acy_partner_index *index, id person) {
+  id number = (person / 2) / ACY_PARTNER_INDEX_BLOCK;
+  if (acy_partner_index_find(index, number) != NULL) {
+    return 1;
+  }
+  acy_compiled_family const * const compiled = index->compiled;
+  if (index->memo == NULL) {
+    index->memo = (acy_plan_memo*) calloc(1, sizeof(acy_plan_memo));
+    if (index->memo == NULL) {
+      return 0;
+    }
+  }
+  acy_partner_block *block = (acy_partner_block*) malloc(
+    sizeof(acy_partner_block)
+  );
+  if (block == NULL) {
+    return 0;
+  }
+  block->number = number;
+  block->entries = NULL;
+
+  // Find everyone's partners with the forward search (see family.h for why
+  // this doesn't invert child-bearers' choices), sharing shuffle plans
+  // between neighbors:
+  id num_potential = acy_num_potential_partners(&compiled->info);
+  id partners[num_potential];
+  id indices[num_potential];
+  id entry_count = 0;
+  id capacity = 0;
+  for (id i = 0; i < ACY_PARTNER_INDEX_BLOCK; ++i) {
+    block->offsets[i] = entry_count;
+    id nonbearer = acy_sep_non_child_bearer(
+      number * ACY_PARTNER_INDEX_BLOCK + i
+    );
+    id count = acy_compiled_find_partners(
+      nonbearer,
+      compiled,
+      index->memo,
+      partners,
+      indices
+    );
+    if (entry_count + count > capacity) {
+      capacity = acy_max(2 * capacity, entry_count + count);
+      acy_partner_entry *entries = (acy_partner_entry*) realloc(
+        block->entries,
+        capacity * sizeof(acy_partner_entry)
+      );
+      if (entries == NULL) {
+        free(block->entries);
+        free(block);
+        return 0;
+      }
+      block->entries = entries;
+    }
+    for (id j = 0; j < count; ++j) {
+      acy_partner_entry *entry = &block->entries[entry_count + j];
+      entry->partner = partners[j];
+      entry->index = indices[j];
+      entry->child_count = acy_compiled_num_direct_children(
+        partners[j],
+        compiled
+      );
+      entry->num_partners = acy_compiled_bearer_num_partners(
+        partners[j],
+        entry->child_count,
+        compiled
+      );
+    }
+    entry_count += count;
+  }
+  block->offsets[ACY_PARTNER_INDEX_BLOCK] = entry_count;
+
+  if (index->block_count >= index->bucket_count) {
+    acy_partner_index_grow(index);
+  }
+  acy_partner_block **bucket = &index->buckets[
+    number & (index->bucket_count - 1)
+  ];
+  block->next = *bucket;
+  *bucket = block;
+  index->block_count += 1;
+  return 1;
+}
+
+int acy_partner_index_build_range(
+  acy_partner_index *index,
+  id first,
+  id last
+) {
+  for (
+    id number = (first / 2) / ACY_PARTNER_INDEX_BLOCK;
+    number <= (last / 2) / ACY_PARTNER_INDEX_BLOCK;
+    ++number
+  ) {
+    if (
+      !acy_partner_index_build(
+        index,
+        acy_sep_non_child_bearer(number * ACY_PARTNER_INDEX_BLOCK)
+      )
     ) {
-      num_partners += 1;
-      random = acy_prng(random, info->seed + 48935729874918238 + num_partners);
+      return 0;
     }
-    return num_partners;
-  } else {
-    id candidate = NONE;
-    id partner_index = 0;
-    id num_potential = acy_num_potential_partners(info);
-    for (id nth = 0; nth < num_potential; ++nth) {
-      acy_nth_potential_partner_and_index(
-        person,
-        nth,
-        info,
-        &candidate,
-        &partner_index
+  }
+  return 1;
+}
+
+// Finds a non-child-bearer's partners in the index, setting r_entries and
+// r_count and returning 1. Returns 0 for child-bearers and for people whose
+// block hasn't been built.
+static inline int acy_partner_index_entries(
+  id person,
+  acy_partner_index const * const index,
+  acy_partner_entry const **r_entries,
+  id *r_count
+) {
+  if (acy_is_child_bearer(person)) {
+    return 0;
+  }
+  id separated = person / 2;
+  acy_partner_block const *block = acy_partner_index_find(
+    index,
+    separated / ACY_PARTNER_INDEX_BLOCK
+  );
+  if (block == NULL) {
+    return 0;
+  }
+  id i = separated % ACY_PARTNER_INDEX_BLOCK;
+  *r_entries = &block->entries[block->offsets[i]];
+  *r_count = block->offsets[i + 1] - block->offsets[i];
+  return 1;
+}
+
+id acy_indexed_num_partners(
+  id person,
+  acy_partner_index const * const index
+) {
+  acy_partner_entry const *entries;
+  id count;
+  if (!acy_partner_index_entries(person, index, &entries, &count)) {
+    return acy_compiled_num_partners(person, index->compiled);
+  }
+  return count;
+}
+
+id acy_indexed_nth_partner(
+  id person,
+  id nth,
+  acy_partner_index const * const index
+) {
+  acy_partner_entry const *entries;
+  id count;
+  if (!acy_partner_index_entries(person, index, &entries, &count)) {
+    return acy_compiled_nth_partner(person, nth, index->compiled);
+  }
+  // nth counts from 1 here (see acy_compiled_nth_partner):
+  if (nth >= 1 && nth <= count) {
+    return entries[nth - 1].partner;
+  }
+  return NONE;
+}
+
+id acy_indexed_child(
+  id person,
+  id nth,
+  acy_partner_index const * const index
+) {
+  acy_partner_entry const *entries;
+  id count;
+  if (!acy_partner_index_entries(person, index, &entries, &count)) {
+    return acy_compiled_child(person, nth, index->compiled);
+  }
+  for (id i = 0; i < count; ++i) {
+    acy_partner_entry const *entry = &entries[i];
+    // figure out how many children we had with this partner:
+    id children_with_this_partner = entry->child_count / entry->num_partners;
+    // don't forget about leftovers in the mod math:
+    id leftovers = (
+      entry->child_count
+    - entry->num_partners * children_with_this_partner
+    );
+    if (entry->index < leftovers) {
+      children_with_this_partner += 1;
+    }
+    if (nth < children_with_this_partner) { // we've found the right match:
+      return acy_compiled_direct_child(
+        entry->partner,
+        entry->num_partners * nth + entry->index,
+        index->compiled
       );
-      if (candidate == NONE) {
-        continue;
+    }
+    // otherwise there weren't enough children with that partner:
+    nth -= children_with_this_partner;
+  }
+  return NONE;
+}
+
+id acy_indexed_num_children(
+  id person,
+  acy_partner_index const * const index
+) {
+  acy_family_info const * const info = &index->compiled->info;
+  acy_partner_entry const *entries;
+  id count;
+  if (!acy_partner_index_entries(person, index, &entries, &count)) {
+    return acy_compiled_num_children(person, index->compiled);
+  }
+  id total_children = 0;
+  for (id i = 0; i < count; ++i) {
+    acy_partner_entry const *entry = &entries[i];
+    // which nth partner match did this parent start on:
+    id start = (entry->partner + info->seed) % entry->num_partners;
+    // subtract without overflow:
+    id adj_which = (
+      (entry->index + entry->num_partners - start)
+    % entry->num_partners
+    );
+    // figure out how many children we had with this partner:
+    id children_with_this_partner = entry->child_count / entry->num_partners;
+    // don't forget about leftovers in the mod math:
+    id leftovers = (
+      entry->child_count
+    - entry->num_partners * children_with_this_partner
+    );
+    if (adj_which < leftovers) {
+      children_with_this_partner += 1;
+    }
+    total_children += children_with_this_partner;
+  }
+  return total_children;
+}
+
+/********************
+ * Ancestry Queries *
+ ********************/
+
+// Sets up an ancestry walk, recording ancestors into found, which holds
+// capacity ids and is reallocated as needed if growable is set. Without
+// room for a set of found ancestors, the walk searches found instead.
+static void acy_ancestry_init(
+  acy_ancestry *walk,
+  id person,
+  id *found,
+  id capacity,
+  int growable
+) {
+  walk->person = person;
+  walk->found = found;
+  walk->count = 0;
+  walk->capacity = capacity;
+  walk->growable = growable;
+  walk->failed = 0;
+  walk->slot_mask = ACY_ANCESTRY_INITIAL_SLOTS - 1;
+  walk->slots = (id*) calloc(ACY_ANCESTRY_INITIAL_SLOTS, sizeof(id));
+  walk->generation_start = 0;
+  walk->depth = 0;
+}
+
+static void acy_ancestry_cleanup(acy_ancestry *walk) {
+  free(walk->slots);
+  if (walk->growable) {
+    free(walk->found);
+  }
+}
+
+static inline id acy_ancestry_slot(acy_ancestry const * const walk, id person) {
+  id h = person * 0x9e3779b97f4a7c15;
+  h ^= h >> 29;
+  h &= walk->slot_mask;
+  while (walk->slots[h] != NONE && walk->slots[h] != person) {
+    h = (h + 1) & walk->slot_mask;
+  }
+  return h;
+}
+
+// Whether the walk has found the given person (or started from them).
+static int acy_ancestry_has(acy_ancestry const * const walk, id person) {
+  if (person == walk->person) {
+    return 1;
+  }
+  if (walk->slots != NULL) {
+    return walk->slots[acy_ancestry_slot(walk, person)] == person;
+  }
+  for (id i = 0; i < walk->count; ++i) {
+    if (walk->found[i] == person) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Doubles the set of found ancestors, or gives it up if allocation fails.
+static void acy_ancestry_grow_slots(acy_ancestry *walk) {
+  id *old_slots = walk->slots;
+  id old_count = walk->slot_mask + 1;
+  walk->slots = (id*) calloc(2 * old_count, sizeof(id));
+  if (walk->slots != NULL) {
+    walk->slot_mask = 2 * old_count - 1;
+    for (id i = 0; i < old_count; ++i) {
+      if (old_slots[i] != NONE) {
+        walk->slots[acy_ancestry_slot(walk, old_slots[i])] = old_slots[i];
       }
-      id check = acy_nth_partner(candidate, partner_index, info);
-      if (check == person) {
-        partner_count += 1;
+    }
+  }
+  free(old_slots);
+}
+
+// Records an ancestor unless they're NONE or were already found.
+static void acy_ancestry_add(acy_ancestry *walk, id ancestor) {
+  if (ancestor == NONE || acy_ancestry_has(walk, ancestor)) {
+    return;
+  }
+  if (walk->count == walk->capacity) {
+    id *found = NULL;
+    if (walk->growable) {
+      found = (id*) realloc(walk->found, 2 * walk->capacity * sizeof(id));
+    }
+    if (found == NULL) {
+      walk->failed = 1;
+      return;
+    }
+    walk->found = found;
+    walk->capacity *= 2;
+  }
+  walk->found[walk->count] = ancestor;
+  walk->count += 1;
+  if (walk->slots != NULL) {
+    if (2 * walk->count > walk->slot_mask) {
+      acy_ancestry_grow_slots(walk);
+    }
+    if (walk->slots != NULL) {
+      walk->slots[acy_ancestry_slot(walk, ancestor)] = ancestor;
+    }
+  }
+}
+
+// Records both parents of the given person.
+static void acy_ancestry_add_parents(
+  acy_ancestry *walk,
+  id person,
+  acy_compiled_family const * const compiled
+) {
+  id mother, index;
+  acy_compiled_mother_and_index(person, compiled, &mother, &index);
+  if (mother == NONE) {
+    return;
+  }
+  acy_ancestry_add(walk, mother);
+  // The other parent is whichever partner the mother had this child with:
+  acy_ancestry_add(walk, acy_compiled_nth_partner(mother, index, compiled));
+}
+
+// Walks up one more generation, returning the number of new ancestors found.
+static id acy_ancestry_step(
+  acy_ancestry *walk,
+  acy_compiled_family const * const compiled
+) {
+  id start = walk->generation_start;
+  id end = walk->count;
+  if (walk->depth == 0) {
+    acy_ancestry_add_parents(walk, walk->person, compiled);
+  } else {
+    for (id i = start; i < end; ++i) {
+      acy_ancestry_add_parents(walk, walk->found[i], compiled);
+    }
+  }
+  walk->generation_start = end;
+  walk->depth += 1;
+  return walk->count - end;
+}
+
+id acy_compiled_ancestors(
+  id person,
+  id depth,
+  acy_compiled_family const * const compiled,
+  id *r_ancestors
+) {
+  depth = acy_min(depth, ACY_MAX_ANCESTRY_DEPTH);
+  acy_ancestry walk;
+  acy_ancestry_init(&walk, person, r_ancestors, acy_max_ancestors(depth), 0);
+  while (walk.depth < depth && acy_ancestry_step(&walk, compiled) > 0) {}
+  acy_ancestry_cleanup(&walk);
+  return walk.count;
+}
+
+// Checks the latest generation of one walk against everyone found by
+// another, returning the first common ancestor or NONE.
+static id acy_ancestry_meet(
+  acy_ancestry const * const walk,
+  acy_ancestry const * const other
+) {
+  for (id i = walk->generation_start; i < walk->count; ++i) {
+    if (acy_ancestry_has(other, walk->found[i])) {
+      return walk->found[i];
+    }
+  }
+  return NONE;
+}
+
+id acy_compiled_common_ancestor(
+  id a,
+  id b,
+  id max_depth,
+  acy_compiled_family const * const compiled
+) {
+  if (a == b) {
+    return a;
+  }
+  id *found_a = (id*) malloc(ACY_ANCESTRY_INITIAL_SLOTS * sizeof(id));
+  id *found_b = (id*) malloc(ACY_ANCESTRY_INITIAL_SLOTS * sizeof(id));
+  acy_ancestry walk_a, walk_b;
+  acy_ancestry_init(&walk_a, a, found_a, ACY_ANCESTRY_INITIAL_SLOTS, 1);
+  acy_ancestry_init(&walk_b, b, found_b, ACY_ANCESTRY_INITIAL_SLOTS, 1);
+  id result = NONE;
+  if (found_a != NULL && found_b != NULL) {
+    while (walk_a.depth < max_depth) {
+      id new_a = acy_ancestry_step(&walk_a, compiled);
+      result = acy_ancestry_meet(&walk_a, &walk_b);
+      if (result != NONE) {
+        break;
+      }
+      id new_b = acy_ancestry_step(&walk_b, compiled);
+      result = acy_ancestry_meet(&walk_b, &walk_a);
+      if (
+        result != NONE
+     || (new_a == 0 && new_b == 0)
+     || walk_a.failed
+     || walk_b.failed
+      ) {
+        break;
+      }
+    }
+  }
+  acy_ancestry_cleanup(&walk_a);
+  acy_ancestry_cleanup(&walk_b);
+  return result;
+}
+
+/**********************
+ * Descendant Queries *
+ **********************/
+
+// Adds someone to a generation, returning 0 if allocation fails.
+static inline int acy_generation_add(acy_generation *gen, id person) {
+  if (gen->count == gen->capacity) {
+    id *people = (id*) realloc(
+      gen->people,
+      2 * gen->capacity * sizeof(id)
+    );
+    if (people == NULL) {
+      return 0;
+    }
+    gen->people = people;
+    gen->capacity *= 2;
+  }
+  gen->people[gen->count] = person;
+  gen->count += 1;
+  return 1;
+}
+
+static int acy_compare_ids(void const *a, void const *b) {
+  id x = *((id const *) a);
+  id y = *((id const *) b);
+  return (x > y) - (x < y);
+}
+
+// Sorts a generation, which puts people from the same cohorts next to each
+// other, and drops anyone reached through more than one line of descent.
+static void acy_generation_sort(acy_generation *gen) {
+  if (gen->count == 0) {
+    return;
+  }
+  qsort(gen->people, gen->count, sizeof(id), &acy_compare_ids);
+  id kept = 1;
+  for (id i = 1; i < gen->count; ++i) {
+    if (gen->people[i] != gen->people[kept - 1]) {
+      gen->people[kept] = gen->people[i];
+      kept += 1;
+    }
+  }
+  gen->count = kept;
+}
+
+// Writes the children that a non-child-bearer had with one of their
+// partners (who has child_count direct children and chose them as partner
+// number partner_index) into out, in acy_compiled_child order, and returns
+// how many there are. See acy_compiled_person_record.
+static id acy_compiled_children_with(
+  id partner,
+  id partner_index,
+  id child_count,
+  acy_compiled_family const * const compiled,
+  id *out
+) {
+  id num_partners = acy_compiled_bearer_num_partners(
+    partner,
+    child_count,
+    compiled
+  );
+  id leftovers = child_count % num_partners;
+  id listed = child_count / num_partners + (partner_index < leftovers);
+  if (listed == 0) {
+    return 0;
+  }
+  id children[child_count];
+  acy_compiled_direct_children(partner, compiled, children, child_count);
+  id written = 0;
+  for (id nth = 0; nth < listed; ++nth) {
+    id which = num_partners * nth + partner_index;
+    if (which < child_count) {
+      out[written] = children[which];
+      written += 1;
+    }
+  }
+  return written;
+}
+
+// Adds all of someone's children (in acy_compiled_child order) to the next
+// generation. For non-child-bearers, the partner search shares shuffle plans
+// with the rest of the generation through the given memo (which may be
+// NULL). Returns 0 if allocation fails.
+static int acy_add_children(
+  id person,
+  acy_compiled_family const * const compiled,
+  acy_plan_memo *memo,
+  acy_generation *next
+) {
+  if (acy_is_child_bearer(person)) {
+    id child_count = acy_compiled_num_direct_children(person, compiled);
+    id children[child_count + 1]; // never zero-length
+    acy_compiled_direct_children(person, compiled, children, child_count);
+    for (id i = 0; i < child_count; ++i) {
+      if (!acy_generation_add(next, children[i])) {
+        return 0;
+      }
+    }
+    return 1;
+  }
+
+  acy_family_info const * const info = &compiled->info;
+  id num_potential = acy_num_potential_partners(info);
+  id partners[num_potential];
+  id indices[num_potential];
+  id count;
+  if (acy_thread_family_cache != NULL) {
+    count = acy_compiled_partner_list(person, compiled, partners, indices);
+  } else {
+    count = acy_compiled_find_partners(
+      person,
+      compiled,
+      memo,
+      partners,
+      indices
+    );
+  }
+  for (id i = 0; i < count; ++i) {
+    id child_count = acy_compiled_num_direct_children(partners[i], compiled);
+    id children[child_count + 1]; // never zero-length
+    id listed = acy_compiled_children_with(
+      partners[i],
+      indices[i],
+      child_count,
+      compiled,
+      children
+    );
+    for (id c = 0; c < listed; ++c) {
+      if (!acy_generation_add(next, children[c])) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+int acy_compiled_descendants(
+  id person,
+  id depth,
+  acy_compiled_family const * const compiled,
+  acy_descendant_sink sink,
+  void *context
+) {
+  acy_generation current, next;
+  current.capacity = ACY_DESCENDANTS_INITIAL_CAPACITY;
+  current.people = (id*) malloc(current.capacity * sizeof(id));
+  next.capacity = ACY_DESCENDANTS_INITIAL_CAPACITY;
+  next.people = (id*) malloc(next.capacity * sizeof(id));
+  acy_plan_memo *memo = NULL;
+  int success = current.people != NULL && next.people != NULL;
+  if (success) {
+    current.people[0] = person;
+    current.count = 1;
+  }
+  for (id generation = 1; success && generation <= depth; ++generation) {
+    next.count = 0;
+    for (id i = 0; success && i < current.count; ++i) {
+      if (
+        memo == NULL
+     && acy_thread_family_cache == NULL
+     && !acy_is_child_bearer(current.people[i])
+      ) {
+        // (if this fails, partner searches just won't share plans)
+        memo = (acy_plan_memo*) calloc(1, sizeof(acy_plan_memo));
+      }
+      success = acy_add_children(current.people[i], compiled, memo, &next);
+    }
+    if (!success) {
+      break;
+    }
+    acy_generation_sort(&next);
+    for (id i = 0; i < next.count; ++i) {
+      sink(next.people[i], generation, context);
+    }
+    if (next.count == 0) {
+      break;
+    }
+    acy_generation swap = current;
+    current = next;
+    next = swap;
+  }
+  free(memo);
+  free(current.people);
+  free(next.people);
+  return success;
+}
+
+/*******************
+ * Sibling Queries *
+ *******************/
+
+// Sorts siblings by birthdate, then id.
+static int acy_compare_siblings(void const *a, void const *b) {
+  acy_sibling_key const *x = (acy_sibling_key const *) a;
+  acy_sibling_key const *y = (acy_sibling_key const *) b;
+  if (x->birthdate != y->birthdate) {
+    return (x->birthdate > y->birthdate) - (x->birthdate < y->birthdate);
+  }
+  return (x->sibling > y->sibling) - (x->sibling < y->sibling);
+}
+
+id acy_compiled_siblings(
+  id person,
+  id flags,
+  acy_compiled_family const * const compiled,
+  acy_sibling *r_siblings,
+  id cap
+) {
+  acy_family_info const * const info = &compiled->info;
+  id mother, index;
+  acy_compiled_mother_and_index(person, compiled, &mother, &index);
+  if (mother == NONE) {
+    return 0;
+  }
+
+  // The mother's side, once: her children and the partner for each of them.
+  id child_count = acy_compiled_num_direct_children(mother, compiled);
+  if (child_count == 0) {
+    return 0;
+  }
+  id children[child_count];
+  acy_compiled_direct_children(mother, compiled, children, child_count);
+  id num_partners = acy_compiled_bearer_num_partners(
+    mother,
+    child_count,
+    compiled
+  );
+  id mother_partners[num_partners];
+  for (id which = 0; which < num_partners; ++which) {
+    mother_partners[which] = acy_compiled_bearer_partner(
+      mother,
+      which,
+      child_count,
+      num_partners,
+      children,
+      compiled
+    );
+  }
+  // (see acy_compiled_nth_partner)
+  id father = mother_partners[(index + mother + info->seed) % num_partners];
+
+  // The father's side, once: their other partners and children with them.
+  id num_potential = acy_num_potential_partners(info);
+  id partners[num_potential];
+  id indices[num_potential];
+  id partner_children[num_potential];
+  id partner_count = 0;
+  id paternal_total = 0;
+  if ((flags & ACY_SIBLINGS_PATERNAL_HALF) && father != NONE) {
+    partner_count = acy_compiled_partner_list(
+      father,
+      compiled,
+      partners,
+      indices
+    );
+    for (id i = 0; i < partner_count; ++i) {
+      if (partners[i] == mother) {
+        partner_children[i] = 0; // these are already covered above
+      } else {
+        partner_children[i] = acy_compiled_num_direct_children(
+          partners[i],
+          compiled
+        );
       }
+      paternal_total += partner_children[i];
     }
-    return partner_count;
   }
-}
 
-id acy_nth_partner(id person, id nth, acy_family_info const * const info) {
-  if (acy_is_child_bearer(person)) {
-    id child_count = acy_num_direct_children(person, info);
-    if (nth >= child_count) {
-      return NONE;
+  // Gather everyone (including the person) with their relations:
+  acy_sibling_key all[child_count + paternal_total];
+  id count = 0;
+  for (id nth = 0; nth < child_count; ++nth) {
+    id which = (nth + mother + info->seed) % num_partners;
+    id relation = ACY_SIBLINGS_MATERNAL_HALF;
+    if (mother_partners[which] == father) {
+      relation = ACY_SIBLINGS_FULL;
     }
-    id num_partners = acy_num_partners(person, info);
-    // Note: child ages are unrelated to child ordering, so scrambling partners
-    // here won't hurt partner continuity. Actually improving partner
-    // continuity would be a good thing of course :) Also note: adding the
-    // person and seed ensures that non-child-bearers can have multiple single
-    // children with different mothers.
-    id which_partner = (nth + person + info->seed) % num_partners;
-    id candidate;
-    id cohort, inner;
-    for (
-      acy_cohort_case cohort_case = ACY_COHORT_CASE_LIKELY;
-      cohort_case < ACY_COHORT_CASE_MAX;
-      ++cohort_case
-    ) {
-      // Get case parameters:
-      id cohort_size, cohort_adjust, cohort_fraction;
-      acy_get_cohort_case_parameters(
-        cohort_case,
-        info,
-        &cohort_size,
-        &cohort_adjust,
-        &cohort_fraction
-      );
+    if (children[nth] == person || (flags & relation)) {
+      all[count].sibling = children[nth];
+      all[count].relation = relation;
+      count += 1;
+    }
+  }
+  for (id i = 0; i < partner_count; ++i) {
+    if (partner_children[i] == 0) {
+      continue;
+    }
+    id theirs[partner_children[i]];
+    id listed = acy_compiled_children_with(
+      partners[i],
+      indices[i],
+      partner_children[i],
+      compiled,
+      theirs
+    );
+    for (id c = 0; c < listed; ++c) {
+      all[count].sibling = theirs[c];
+      all[count].relation = ACY_SIBLINGS_PATERNAL_HALF;
+      count += 1;
+    }
+  }
 
-      // find match:
-      acy_mixed_cohort_and_inner(
-        acy_separated(person),
-        cohort_size,
-        info->seed + (1827 * which_partner),
-        &cohort,
-        &inner
-      );
-      id shuf = acy_cohort_shuffle(
-        inner,
-        cohort_size,
-        info->seed + (28999 * which_partner)
-      );
-      if (shuf < cohort_fraction) {
-        continue; // look in another cohort case
-      }
+  // Put them in birth order, and then leave out the person:
+  for (id i = 0; i < count; ++i) {
+    all[i].birthdate = acy_compiled_birthdate(all[i].sibling, compiled);
+  }
+  qsort(all, count, sizeof(acy_sibling_key), &acy_compare_siblings);
+  id result = 0;
+  for (id i = 0; i < count; ++i) {
+    if (all[i].sibling == person) {
+      continue;
+    }
+    if (result < cap) {
+      r_siblings[result].sibling = all[i].sibling;
+      r_siblings[result].relation = all[i].relation;
+      r_siblings[result].birth_order = i;
+    }
+    result += 1;
+  }
+  return result;
+}
 
-      // which nth partner match did this parent start on:
-      id start = (person + info->seed) % child_count;
-
-      // consider partner/parent age gap for each child with this partner:
-      id sep_match = acy_mixed_cohort_outer(
-        cohort,
-        shuf,
-        cohort_size,
-        info->seed + (83923 * which_partner)
-      );
-      candidate = acy_sep_non_child_bearer(sep_match);
-      for (
-        id child_index = start;
-        child_index < child_count;
-        child_index += num_partners
-      ) {
-        id child = acy_direct_child(person, child_index, info);
-        if (
-          acy_birthdate(candidate, info) - acy_birthdate(child, info)
-        < info->min_partner_age
-        ) {
-#ifdef DEBUG_FAMILY
-          if (cohort_case == ACY_COHORT_CASE_SHIFTED) {
-            fprintf(
-              stderr,
-              "Error; even shifting wasn't enough to ensure partner age!\n"
-              "  Child-bearer: %lu  Shifted partner: %lu  Child: %lu\n"
-              "  Birthdates:   %lu                   %lu         %lu\n",
-              person, candidate, child,
-              acy_birthdate(person, info),
-              acy_birthdate(candidate, info),
-              acy_birthdate(child, info)
-            );
-          }
-#endif
-          continue; // partner is too young; look in another cohort case
-        }
-      }
+/***********************
+ * Birth Range Queries *
+ ***********************/
+
+// Fills in the ids of a strict birth cohort, in order of their inner index
+// within the mixed cohorts (see acy_compiled_birthdate), so that out[inner]
+// is the person in that strict cohort with that inner index. The birth rate
+// must be at least MIN_COHORT_SIZE (cohort shuffles don't support smaller
+// cohorts).
+static void acy_strict_birth_cohort(
+  id strict_cohort,
+  acy_compiled_family const * const compiled,
+  id *out
+) {
+  id cohort_size = compiled->info.birth_rate_per_day;
+  id seed = compiled->info.seed + 17 + strict_cohort;
+  acy_cohort_inverse_permutation(cohort_size, seed, out);
+  id base = strict_cohort * cohort_size;
+  for (id inner = 0; inner < cohort_size; ++inner) {
+    out[inner] += base;
+  }
+}
+
+int acy_compiled_born_between(
+  id first_day,
+  id last_day,
+  acy_compiled_family const * const compiled,
+  acy_birth_sink sink,
+  void *context
+) {
+  id cohort_size = compiled->info.birth_rate_per_day;
+  if (cohort_size < MIN_COHORT_SIZE) {
+    return 0; // unsupported (see acy_strict_birth_cohort)
+  }
+  id half = cohort_size / 2;
+  id *earlier = (id*) malloc(cohort_size * sizeof(id));
+  id *later = (id*) malloc(cohort_size * sizeof(id));
+  id *born = (id*) malloc(cohort_size * sizeof(id));
+  int success = earlier != NULL && later != NULL && born != NULL;
+  // Each day takes the lower half of its inner indices from the previous
+  // strict cohort and the upper half from its own, so each strict cohort is
+  // worked out once and used for two days:
+  if (success && first_day > 0) {
+    acy_strict_birth_cohort(first_day - 1, compiled, later);
+  }
+  for (id day = first_day; success && day <= last_day; ++day) {
+    id *swap = earlier;
+    earlier = later;
+    later = swap;
+    acy_strict_birth_cohort(day, compiled, later);
+    id count = 0;
+    if (day > 0) {
+      memcpy(born, earlier, half * sizeof(id));
+      count = half;
     }
-    return candidate;
-  } else {
-    id candidate = NONE;
-    id partner_index = 0;
-    id num_potential = acy_num_potential_partners(info);
-    for (id any = 0; any < num_potential; ++any) {
-      acy_nth_potential_partner_and_index(
-        person,
-        any,
-        info,
-        &candidate,
-        &partner_index
-      );
-      if (candidate == NONE) {
-        continue;
-      }
-      id check = acy_nth_partner(candidate, partner_index, info);
-      if (check == person) {
-        nth -= 1;
-        if (nth == 0) {
-          return candidate;
-        }
-      }
+    memcpy(born + count, later + half, (cohort_size - half) * sizeof(id));
+    count += cohort_size - half;
+    sink(day, born, count, context);
+    if (day == (id) -1) {
+      break;
     }
-    // nth is too large or the for loop above failed somehow
+  }
+  free(earlier);
+  free(later);
+  free(born);
+  return success;
+}
+
+/*****************
+ * Batch Queries *
+ *****************/
+
+// Grain for the _batch_pool functions: family queries are slow enough that
+// small grains balance better without handing-out costs showing.
+#define ACY_FAMILY_BATCH_GRAIN 64
+
+// Arguments for the _batch_pool functions below.
+struct acy_family_batch_job_s {
+  id const *people;
+  acy_compiled_family const *compiled;
+  id *first_out;
+  id *second_out;
+};
+typedef struct acy_family_batch_job_s acy_family_batch_job;
+
+void acy_compiled_mother_and_index_batch(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_mothers,
+  id *r_indices
+) {
+  for (id i = 0; i < n; ++i) {
+    acy_compiled_mother_and_index(
+      people[i],
+      compiled,
+      &r_mothers[i],
+      &r_indices[i]
+    );
+  }
+}
+
+void acy_compiled_num_children_batch(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_counts
+) {
+  for (id i = 0; i < n; ++i) {
+    r_counts[i] = acy_compiled_num_children(people[i], compiled);
+  }
+}
+
+static void acy_mother_and_index_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_family_batch_job const *job = (acy_family_batch_job const *) context;
+  acy_compiled_mother_and_index_batch(
+    job->people + start,
+    end - start,
+    job->compiled,
+    job->first_out + start,
+    job->second_out + start
+  );
+}
+
+static void acy_num_children_batch_range(
+  id start,
+  id end,
+  id worker,
+  void *context
+) {
+  acy_family_batch_job const *job = (acy_family_batch_job const *) context;
+  acy_compiled_num_children_batch(
+    job->people + start,
+    end - start,
+    job->compiled,
+    job->first_out + start
+  );
+}
+
+void acy_compiled_mother_and_index_batch_pool(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_mothers,
+  id *r_indices,
+  acy_pool *pool
+) {
+  acy_family_batch_job job = { people, compiled, r_mothers, r_indices };
+  acy_parallel_for(
+    pool,
+    0,
+    n,
+    ACY_FAMILY_BATCH_GRAIN,
+    &acy_mother_and_index_batch_range,
+    &job
+  );
+}
+
+void acy_compiled_num_children_batch_pool(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_counts,
+  acy_pool *pool
+) {
+  acy_family_batch_job job = { people, compiled, r_counts, NULL };
+  acy_parallel_for(
+    pool,
+    0,
+    n,
+    ACY_FAMILY_BATCH_GRAIN,
+    &acy_num_children_batch_range,
+    &job
+  );
+}
+
+/**********************
+ * Uncompiled Queries *
+ **********************/
+
+id acy_birthdate(id person, acy_family_info const * const info) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return NONE;
+  }
+  return acy_compiled_birthdate(person, compiled);
+}
+
+id acy_first_born_on(id day, acy_family_info const * const info) {
+  return acy_mixed_cohort_outer(
+    day,
+    0,
+    info->birth_rate_per_day,
+    info->seed + 17
+  );
+}
+
+id acy_get_birth_rate_per_day(acy_family_info const * const info) {
+  return info->birth_rate_per_day;
+}
+
+id acy_get_child_id_adjust(acy_family_info const * const info) {
+  return info->birth_rate_per_day * info->min_childbearing_age;
+}
+
+id acy_mother(id person, acy_family_info const * const info) {
+  id parent, index;
+  acy_mother_and_index(person, info, &parent, &index);
+  return parent;
+}
+
+void acy_mother_and_index(
+  id person,
+  acy_family_info const * const info,
+  id *r_mother,
+  id *r_index
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    *r_mother = NONE;
+    *r_index = NONE;
+    return;
+  }
+  acy_compiled_mother_and_index(person, compiled, r_mother, r_index);
+}
+
+id acy_direct_child(id person, id nth, acy_family_info const * const info) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return NONE;
+  }
+  return acy_compiled_direct_child(person, nth, compiled);
+}
+
+id acy_num_direct_children(id person, acy_family_info const * const info) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_num_direct_children(person, compiled);
+}
+
+void acy_nth_potential_partner_and_index(
+  id person,
+  id nth,
+  acy_family_info const * const info,
+  id *r_partner,
+  id *r_nth
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    *r_partner = NONE;
+    *r_nth = NONE;
+    return;
+  }
+  acy_compiled_nth_potential_partner_and_index(
+    person,
+    nth,
+    compiled,
+    r_partner,
+    r_nth
+  );
+}
+
+id acy_num_partners(id person, acy_family_info const * const info) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_num_partners(person, compiled);
+}
+
+id acy_nth_partner(id person, id nth, acy_family_info const * const info) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
     return NONE;
   }
+  return acy_compiled_nth_partner(person, nth, compiled);
 }
 
 id acy_child(id person, id nth, acy_family_info const * const info) {
-  if (acy_is_child_bearer(person)) {
-    return acy_direct_child(person, nth, info);
-  } else {
-    id candidate = NONE;
-    id partner_index = 0;
-    id num_potential = acy_num_potential_partners(info);
-    for (id any = 0; any < num_potential; ++any) {
-      acy_nth_potential_partner_and_index(
-        person,
-        any,
-        info,
-        &candidate,
-        &partner_index
-      );
-      if (candidate == NONE) {
-        continue;
-      }
-      id check = acy_nth_partner(candidate, partner_index, info);
-      if (check == person) {
-        id num_partners = acy_num_partners(candidate, info);
-        id child_count = acy_num_direct_children(candidate, info);
-        // figure out how many children we had with this partner:
-        id children_with_this_partner = child_count / num_partners;
-        // don't forget about leftovers in the mod math:
-        id leftovers = child_count - num_partners * children_with_this_partner;
-        if (partner_index < leftovers) {
-          children_with_this_partner += 1;
-        }
-        if (nth < children_with_this_partner) { // we've found the right match:
-          return acy_direct_child(
-            candidate,
-            num_partners * nth + partner_index,
-            info
-          );
-        }
-        // otherwise there weren't enough children with that partner:
-        nth -= children_with_this_partner;
-      }
-    }
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return NONE;
   }
-  // Didn't find anyone who both selected us as their Nth partner and had at
-  // least N partners total (takes O(max_partners_per_mother) iterations).
-  return NONE;
+  return acy_compiled_child(person, nth, compiled);
 }
 
 id acy_num_children(id person, acy_family_info const * const info) {
-  if (acy_is_child_bearer(person)) {
-    return acy_num_direct_children(person, info);
-  } else {
-    id total_children = 0;
-    id candidate = NONE;
-    id partner_index = 0;
-    id num_potential = acy_num_potential_partners(info);
-    for (id any = 0; any < num_potential; ++any) {
-      acy_nth_potential_partner_and_index(
-        person,
-        any,
-        info,
-        &candidate,
-        &partner_index
-      );
-      if (candidate == NONE) {
-        continue;
-      }
-      id check = acy_nth_partner(candidate, partner_index, info);
-      if (check == person) {
-        id child_count = acy_num_direct_children(candidate, info);
-        id num_partners = acy_num_partners(candidate, info);
-        // which nth partner match did this parent start on:
-        id start = (candidate + info->seed) % num_partners;
-        // subtract without overflow:
-        id adj_which = (partner_index + num_partners - start) % num_partners;
-        // figure out how many children we had with this partner:
-        id children_with_this_partner = child_count / num_partners;
-        // don't forget about leftovers in the mod math:
-        id leftovers = child_count - num_partners * children_with_this_partner;
-        if (adj_which < leftovers) {
-          children_with_this_partner += 1;
-        }
-        total_children += children_with_this_partner;
-      }
-    }
-    return total_children;
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_num_children(person, compiled);
+}
+
+void acy_get_person_record(
+  id person,
+  acy_family_info const * const info,
+  acy_person_record *r_record
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    r_record->person = person;
+    r_record->birthdate = NONE;
+    r_record->mother = NONE;
+    r_record->index = NONE;
+    r_record->num_direct_children = 0;
+    r_record->num_partners = 0;
+    r_record->num_children = 0;
+    return;
+  }
+  acy_compiled_person_record(person, compiled, r_record);
+}
+
+id acy_ancestors(
+  id person,
+  id depth,
+  acy_family_info const * const info,
+  id *r_ancestors
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_ancestors(person, depth, compiled, r_ancestors);
+}
+
+id acy_common_ancestor(
+  id a,
+  id b,
+  id max_depth,
+  acy_family_info const * const info
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return NONE;
+  }
+  return acy_compiled_common_ancestor(a, b, max_depth, compiled);
+}
+
+int acy_descendants(
+  id person,
+  id depth,
+  acy_family_info const * const info,
+  acy_descendant_sink sink,
+  void *context
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_descendants(person, depth, compiled, sink, context);
+}
+
+id acy_siblings(
+  id person,
+  id flags,
+  acy_family_info const * const info,
+  acy_sibling *r_siblings,
+  id cap
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
+  }
+  return acy_compiled_siblings(person, flags, compiled, r_siblings, cap);
+}
+
+int acy_born_between(
+  id first_day,
+  id last_day,
+  acy_family_info const * const info,
+  acy_birth_sink sink,
+  void *context
+) {
+  acy_compiled_family const *compiled = acy_family_memo(info);
+  if (compiled == NULL) {
+    return 0;
   }
+  return acy_compiled_born_between(
+    first_day,
+    last_day,
+    compiled,
+    sink,
+    context
+  );
 }
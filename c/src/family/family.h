@@ -12,6 +12,7 @@
 #include "core/unit.h" // for id type
 #include "core/cohort.h" // for acy_mixed_cohort
 #include "core/select.h" // for acy_select_exp_parent_and_index
+#include "core/pool.h" // for acy_pool
 
 /**************************
  * Structure Declarations *
@@ -20,6 +21,79 @@
 struct acy_family_info_s;
 typedef struct acy_family_info_s acy_family_info;
 
+struct acy_compiled_family_s;
+typedef struct acy_compiled_family_s acy_compiled_family;
+
+// Everything acy_get_person_record finds out about a person. The caller
+// provides storage for the partner and child lists by setting partners and
+// partners_cap, and children and children_cap (a list may be NULL with a cap
+// of 0). The counts are always totals; only the first min(count, cap) list
+// entries are written.
+struct acy_person_record_s {
+  id person;
+  id birthdate;
+  id mother;
+  id index; // among the mother's children (see acy_mother_and_index)
+  id num_direct_children;
+  id num_partners; // as acy_num_partners
+  id num_children; // as acy_num_children
+  // For child-bearers, partners[w] is the partner for which_partner value w
+  // (see acy_nth_partner), or NONE for child-bearers without children. For
+  // non-child-bearers, partners[n] == acy_nth_partner(person, n + 1).
+  id *partners;
+  id partners_cap;
+  // children[n] == acy_child(person, n)
+  id *children;
+  id children_cap;
+};
+typedef struct acy_person_record_s acy_person_record;
+
+// Opaque snapshot type (see snapshot.h): precomputed results for a range of
+// people, memory-mapped from a census file.
+struct acy_family_snapshot_s;
+typedef struct acy_family_snapshot_s acy_family_snapshot;
+
+// Opaque partner index type: use acy_create_partner_index and
+// acy_destroy_partner_index. A partner index holds the partners of
+// non-child-bearers in blocks of ACY_PARTNER_INDEX_BLOCK consecutive
+// non-child-bearers, built by explicit calls (see acy_partner_index_build),
+// so that partner and child queries for them become lookups instead of a
+// search through every potential partner. It memoizes that search rather
+// than inverting child-bearers' partner choices (see
+// acy_partner_index_build), so it only pays off for people queried more than
+// once.
+struct acy_partner_index_s;
+typedef struct acy_partner_index_s acy_partner_index;
+
+// Callback for acy_born_between, called with each day and everyone born on
+// it (in birth order), and the context pointer given to acy_born_between. The
+// people array is only valid during the call.
+typedef void (*acy_birth_sink)(
+  id day,
+  id const *people,
+  id count,
+  void *context
+);
+
+// One sibling of someone, as listed by acy_siblings.
+struct acy_sibling_s {
+  id sibling;
+  id relation; // ACY_SIBLINGS_FULL, _MATERNAL_HALF, or _PATERNAL_HALF
+  // Position among the person and their listed siblings when sorted by
+  // birthdate (ties broken by id), counting from 0 for the eldest:
+  id birth_order;
+};
+typedef struct acy_sibling_s acy_sibling;
+
+// Callback for acy_descendants, called with each descendant, their
+// generation (1 for children, 2 for grandchildren, etc.), and the context
+// pointer given to acy_descendants.
+typedef void (*acy_descendant_sink)(
+  id descendant,
+  id generation,
+  void *context
+);
+
 /*************
  * Constants *
  *************/
@@ -27,6 +101,22 @@ typedef struct acy_family_info_s acy_family_info;
 // Days in a year
 #define ONE_EARTH_YEAR 365
 
+// Deepest pedigree that acy_ancestors will walk.
+#define ACY_MAX_ANCESTRY_DEPTH 30
+
+// Flags for which siblings acy_siblings should list (and the relation of
+// each sibling it lists):
+#define ACY_SIBLINGS_FULL 0x1 // same mother and father
+#define ACY_SIBLINGS_MATERNAL_HALF 0x2 // same mother only
+#define ACY_SIBLINGS_PATERNAL_HALF 0x4 // same father only
+#define ACY_SIBLINGS_ALL 0x7
+
+// Number of values filled in by acy_get_family_params.
+#define ACY_FAMILY_PARAM_COUNT 16
+
+// Number of non-child-bearers in each partner index block.
+#define ACY_PARTNER_INDEX_BLOCK 1024
+
 // Default family parameters
 extern acy_family_info const DEFAULT_FAMILY_INFO;
 
@@ -73,6 +163,16 @@ static inline int acy_is_child_bearer(id non_normalized) {
   return non_normalized % 2 == 0;
 }
 
+// The most ancestors someone can have within the given number of generations
+// (2 parents, 4 grandparents, and so on), which is how much room
+// acy_ancestors needs.
+static inline id acy_max_ancestors(id depth) {
+  if (depth > ACY_MAX_ANCESTRY_DEPTH) {
+    depth = ACY_MAX_ANCESTRY_DEPTH;
+  }
+  return (((id) 2) << depth) - 2;
+}
+
 /*************
  * Functions *
  *************/
@@ -96,12 +196,57 @@ void acy_copy_family_info(
 void acy_set_info_seed(acy_family_info *info, id seed);
 id acy_get_info_seed(acy_family_info *info);
 
+// Attaches a snapshot (see snapshot.h) to a family info, or detaches it if
+// snapshot is NULL. All of the queries (compiled or not) made with that info
+// then answer from the snapshot for the people it covers, giving the same
+// results as they would otherwise, and compute as usual for everyone else.
+// The snapshot must have been opened with matching info, must stay open
+// while attached, and is carried along by acy_copy_family_info.
+void acy_set_info_snapshot(
+  acy_family_info *info,
+  acy_family_snapshot const * const snapshot
+);
+
+// Returns the snapshot attached to a family info, or NULL.
+acy_family_snapshot const * acy_get_info_snapshot(
+  acy_family_info const * const info
+);
+
+// Fills in r_params (which must have room for ACY_FAMILY_PARAM_COUNT ids)
+// with every parameter of a family info, in declaration order starting with
+// the seed. The age distribution sum table is represented by its size and a
+// hash of its contents. Two infos that give the same values here give the
+// same results for every query, so this can be used to check that saved
+// results (e.g., a census file) match an info.
+void acy_get_family_params(
+  acy_family_info const * const info,
+  id *r_params
+);
+
 // Returns a person's birth date (in days).
 id acy_birthdate(id person, acy_family_info const * const info);
 
 // Returns the first person born on the given day.
 id acy_first_born_on(id day, acy_family_info const * const info);
 
+// Reports everyone born on each day from first_day to last_day (inclusive) to
+// the sink, one day at a time, in birth order (so the first person reported
+// for each day is acy_first_born_on that day). Works out each strict birth
+// cohort's shuffle once as a whole permutation, which is much faster than
+// checking people one by one. Returns 1 on success, or 0 if memory runs out
+// or the info's birth rate is below MIN_COHORT_SIZE, which isn't supported
+// (in either case nothing is reported).
+int acy_born_between(
+  id first_day,
+  id last_day,
+  acy_family_info const * const info,
+  acy_birth_sink sink,
+  void *context
+);
+
+// Returns the number of people born each day.
+id acy_get_birth_rate_per_day(acy_family_info const * const info);
+
 // Returns a number used to adjust child IDs to correct age discrepancies.
 id acy_get_child_id_adjust(acy_family_info const * const info);
 
@@ -164,4 +309,321 @@ id acy_child(id person, id nth, acy_family_info const * const info);
 // by partners.
 id acy_num_children(id person, acy_family_info const * const info);
 
+// Fills in a person record (see acy_person_record above) in one pass, sharing
+// the partner search and child lists between all of the fields. Gives the
+// same results as calling the individual queries, and doesn't allocate
+// (beyond compiling the info, as those queries do).
+void acy_get_person_record(
+  id person,
+  acy_family_info const * const info,
+  acy_person_record *r_record
+);
+
+// Finds everyone among a person's ancestors up to the given number of
+// generations back (1 for just parents, 2 to include grandparents, etc.),
+// writing them into r_ancestors, which must have room for
+// acy_max_ancestors(depth) ids. Ancestors are listed a generation at a time,
+// mother before father, and someone reachable through several lines of
+// descent is listed (and has their own parents looked up) only once, at the
+// closest generation. Returns the number of ancestors found. Depths beyond
+// ACY_MAX_ANCESTRY_DEPTH are treated as ACY_MAX_ANCESTRY_DEPTH.
+id acy_ancestors(
+  id person,
+  id depth,
+  acy_family_info const * const info,
+  id *r_ancestors
+);
+
+// Returns a closest common ancestor of two people within max_depth
+// generations of each, or NONE if there isn't one. Walks both pedigrees a
+// generation at a time, so no other common ancestor is fewer generations back
+// from both people. If one person is an ancestor of the other, returns them.
+// Also returns NONE if memory runs out.
+id acy_common_ancestor(
+  id a,
+  id b,
+  id max_depth,
+  acy_family_info const * const info
+);
+
+// Reports each of a person's descendants up to the given number of
+// generations down to the sink, a generation at a time. Each generation is
+// gathered from the whole previous one at once and sorted by id (and so by
+// cohort) so that neighboring searches share their work; within a
+// generation, descendants are reported in id order and only once each. Only
+// two generations are held in memory at a time. Returns 1 on success, or 0
+// if memory runs out (in which case the walk stops after the last complete
+// generation).
+int acy_descendants(
+  id person,
+  id depth,
+  acy_family_info const * const info,
+  acy_descendant_sink sink,
+  void *context
+);
+
+// Lists a person's siblings of the kinds named by flags (a combination of the
+// ACY_SIBLINGS_* flags), writing up to cap of them into r_siblings in birth
+// order, and returns how many there are in total. Full and maternal
+// half-siblings are the mother's other direct children (told apart by which
+// partner she had each with), and paternal half-siblings are the father's
+// children with other partners. The mother's children and partners and the
+// father's partner list are each worked out just once, so this is much
+// faster than finding the same siblings with the individual queries.
+id acy_siblings(
+  id person,
+  id flags,
+  acy_family_info const * const info,
+  acy_sibling *r_siblings,
+  id cap
+);
+
+/**********************
+ * Compiled Functions *
+ **********************/
+
+// Compiles family info into an immutable form holding all of the values that
+// the queries above would otherwise re-derive on every call: the birth age
+// table multiplier, divisors for the birth rate and partner cohort sizes, a
+// selection context for mother/child relationships, and shuffle plans for
+// each partner cohort. The info is copied, but the age distribution sum table
+// is not, so it must outlive the result. Returns NULL if allocation fails.
+// The queries above keep per-thread compiled copies of the few infos they
+// were most recently called with, so call these directly when cycling through
+// more infos than that. If those queries can't compile their info, they
+// return NONE (or 0 for counts and success flags) instead.
+acy_compiled_family * acy_compile_family_info(
+  acy_family_info const * const info
+);
+
+// Frees the compiled infos that the calling thread's uncompiled queries have
+// kept (see acy_compile_family_info above). This happens automatically when
+// a thread exits, but not when the process exits from main, so call this
+// from the main thread when using a leak checker, or from any thread to free
+// memory early. Later queries just compile their infos again.
+void acy_release_thread_family_memo(void);
+
+// Destroys a compiled family info.
+void acy_destroy_compiled_family(acy_compiled_family *compiled);
+
+// Returns the info that was compiled.
+acy_family_info const * acy_compiled_family_info(
+  acy_compiled_family const * const compiled
+);
+
+// Compiled versions of the queries above; each returns the same results as
+// its uncompiled counterpart.
+id acy_compiled_birthdate(
+  id person,
+  acy_compiled_family const * const compiled
+);
+
+id acy_compiled_first_born_on(
+  id day,
+  acy_compiled_family const * const compiled
+);
+
+int acy_compiled_born_between(
+  id first_day,
+  id last_day,
+  acy_compiled_family const * const compiled,
+  acy_birth_sink sink,
+  void *context
+);
+
+id acy_compiled_mother(id person, acy_compiled_family const * const compiled);
+
+void acy_compiled_mother_and_index(
+  id person,
+  acy_compiled_family const * const compiled,
+  id *r_mother,
+  id *r_index
+);
+
+id acy_compiled_direct_child(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+);
+
+id acy_compiled_num_direct_children(
+  id person,
+  acy_compiled_family const * const compiled
+);
+
+void acy_compiled_nth_potential_partner_and_index(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled,
+  id *r_partner,
+  id *r_nth
+);
+
+id acy_compiled_num_partners(
+  id person,
+  acy_compiled_family const * const compiled
+);
+
+id acy_compiled_nth_partner(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+);
+
+id acy_compiled_child(
+  id person,
+  id nth,
+  acy_compiled_family const * const compiled
+);
+
+id acy_compiled_num_children(
+  id person,
+  acy_compiled_family const * const compiled
+);
+
+void acy_compiled_person_record(
+  id person,
+  acy_compiled_family const * const compiled,
+  acy_person_record *r_record
+);
+
+id acy_compiled_ancestors(
+  id person,
+  id depth,
+  acy_compiled_family const * const compiled,
+  id *r_ancestors
+);
+
+id acy_compiled_common_ancestor(
+  id a,
+  id b,
+  id max_depth,
+  acy_compiled_family const * const compiled
+);
+
+int acy_compiled_descendants(
+  id person,
+  id depth,
+  acy_compiled_family const * const compiled,
+  acy_descendant_sink sink,
+  void *context
+);
+
+id acy_compiled_siblings(
+  id person,
+  id flags,
+  acy_compiled_family const * const compiled,
+  acy_sibling *r_siblings,
+  id cap
+);
+
+/*******************
+ * Batch Functions *
+ *******************/
+
+// Run acy_compiled_mother_and_index or acy_compiled_num_children for each of
+// n people, writing the results to the given arrays.
+void acy_compiled_mother_and_index_batch(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_mothers,
+  id *r_indices
+);
+
+void acy_compiled_num_children_batch(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_counts
+);
+
+// Versions of the batch functions above that split the people among the
+// threads of a pool (see pool.h), with the same results. Shares are small
+// and get stolen, so runs of slow non-child-bearers don't hold up the rest.
+// Pool threads don't have family caches installed (see famcache.h). A NULL
+// pool runs on the calling thread.
+void acy_compiled_mother_and_index_batch_pool(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_mothers,
+  id *r_indices,
+  acy_pool *pool
+);
+
+void acy_compiled_num_children_batch_pool(
+  id const * const people,
+  id n,
+  acy_compiled_family const * const compiled,
+  id *r_counts,
+  acy_pool *pool
+);
+
+/***************************
+ * Partner Index Functions *
+ ***************************/
+
+// Creates an empty partner index for the given compiled info, which must
+// outlive it. Returns NULL if allocation fails.
+acy_partner_index * acy_create_partner_index(
+  acy_compiled_family const * const compiled
+);
+
+// Destroys a partner index and all of its blocks.
+void acy_destroy_partner_index(acy_partner_index *index);
+
+// Builds the index block containing the given person (if it hasn't been built
+// yet), by running the usual forward partner search for each
+// non-child-bearer in it. Returns 1 on success and 0 if allocation fails.
+// Blocks aren't built by the indexed queries themselves, and building must
+// not happen while other threads use the same index.
+//
+// This isn't a reverse index: building a block costs about as much as
+// ACY_PARTNER_INDEX_BLOCK calls to acy_num_partners (less the savings from
+// sharing shuffle plans between neighbors), so the index only saves time
+// when each person is queried more than once. Inverting child-bearers'
+// choices would need a block to cover every child-bearer who could pick
+// one of its members, which spans about four likely-partner cohorts (several
+// million people each with the default info) for any block, and would
+// still have to check each match against the forward search to give the
+// same results.
+int acy_partner_index_build(acy_partner_index *index, id person);
+
+// Builds every block needed for people between first and last (inclusive).
+// Returns 0 if any block couldn't be built.
+int acy_partner_index_build_range(
+  acy_partner_index *index,
+  id first,
+  id last
+);
+
+// Versions of acy_num_partners, acy_nth_partner, acy_child, and
+// acy_num_children that use a partner index. These give the same results as
+// the compiled queries, answering from the index for non-child-bearers in
+// built blocks and falling back to the compiled queries otherwise. They don't
+// modify the index, so once blocks are built, any number of threads can use
+// it at once.
+id acy_indexed_num_partners(
+  id person,
+  acy_partner_index const * const index
+);
+
+id acy_indexed_nth_partner(
+  id person,
+  id nth,
+  acy_partner_index const * const index
+);
+
+id acy_indexed_child(
+  id person,
+  id nth,
+  acy_partner_index const * const index
+);
+
+id acy_indexed_num_children(
+  id person,
+  acy_partner_index const * const index
+);
+
 #endif // INCLUDE_FAMILY_H
@@ -0,0 +1,259 @@
+/**
+ * @file: snapshot.c
+ *
+ * @description: Read-only, memory-mapped access to census files (see
+ * census.h), so that family queries for the people a census covers can be
+ * answered by looking them up instead of computing them.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <fcntl.h> // for open
+#include <stdlib.h>
+#include <string.h> // for memcmp
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h> // for close
+
+#include "snapshot.h"
+#include "census.h"
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+struct acy_family_snapshot_s {
+  void *map;
+  size_t size;
+  id first;
+  id count;
+  id const *columns[ACY_CENSUS_COLUMNS];
+  id num_partner_entries;
+  id num_child_entries;
+};
+
+/*********************
+ * Private Functions *
+ *********************/
+
+// Checks a mapped file's header and layout against an info. Returns 1 if
+// everything matches.
+static int acy_snapshot_check(
+  acy_census_header const * const header,
+  size_t size,
+  acy_family_info const * const info
+) {
+  if (
+    size < sizeof(acy_census_header)
+ || memcmp(header->magic, ACY_CENSUS_MAGIC, sizeof(header->magic)) != 0
+ || header->byte_order != ACY_CENSUS_BYTE_ORDER
+ || header->version != ACY_CENSUS_VERSION
+ || header->file_size != size
+  ) {
+    return 0;
+  }
+  id params[ACY_FAMILY_PARAM_COUNT];
+  acy_get_family_params(info, params);
+  if (memcmp(params, header->params, sizeof(params)) != 0) {
+    return 0;
+  }
+  // The columns must be where the layout puts them (which also checks that
+  // the file is big enough for all of them):
+  acy_census_header expected = *header;
+  acy_census_layout(&expected);
+  if (
+    expected.file_size != header->file_size
+ || memcmp(expected.columns, header->columns, sizeof(expected.columns)) != 0
+  ) {
+    return 0;
+  }
+  // And the lists must end where their offsets say they do:
+  char const *base = (char const *) header;
+  id const *partner_offsets = (id const *) (
+    base + header->columns[ACY_CENSUS_PARTNER_OFFSETS]
+  );
+  id const *child_offsets = (id const *) (
+    base + header->columns[ACY_CENSUS_CHILD_OFFSETS]
+  );
+  return (
+    partner_offsets[header->count] == header->num_partner_entries
+ && child_offsets[header->count] == header->num_child_entries
+  );
+}
+
+// Finds a person's row, returning 0 if they aren't covered.
+static inline int acy_snapshot_row(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_row
+) {
+  id row = person - snapshot->first; // wraps around for earlier people
+  if (row >= snapshot->count) {
+    return 0;
+  }
+  *r_row = row;
+  return 1;
+}
+
+// Looks up a person's entries in one of the lists, returning 0 if they
+// aren't covered or their offsets are out of bounds.
+static inline int acy_snapshot_list(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  acy_census_column offsets_column,
+  id num_entries,
+  id const **r_list,
+  id *r_count
+) {
+  id row;
+  if (!acy_snapshot_row(snapshot, person, &row)) {
+    return 0;
+  }
+  id const *offsets = snapshot->columns[offsets_column];
+  id start = offsets[row];
+  id end = offsets[row + 1];
+  if (start > end || end > num_entries) {
+    return 0; // corrupt
+  }
+  *r_list = snapshot->columns[offsets_column + 1] + start;
+  *r_count = end - start;
+  return 1;
+}
+
+/*************
+ * Functions *
+ *************/
+
+acy_family_snapshot * acy_open_family_snapshot(
+  char const *path,
+  acy_family_info const * const info
+) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(acy_census_header)) {
+    close(fd);
+    return NULL;
+  }
+  size_t size = (size_t) st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping stays valid
+  if (map == MAP_FAILED) {
+    return NULL;
+  }
+  acy_census_header const *header = (acy_census_header const *) map;
+  acy_family_snapshot *snapshot = NULL;
+  if (acy_snapshot_check(header, size, info)) {
+    snapshot = (acy_family_snapshot*) malloc(sizeof(acy_family_snapshot));
+  }
+  if (snapshot == NULL) {
+    munmap(map, size);
+    return NULL;
+  }
+#ifdef MADV_RANDOM
+  madvise(map, size, MADV_RANDOM); // lookups rarely touch neighboring pages
+#endif
+  snapshot->map = map;
+  snapshot->size = size;
+  snapshot->first = header->first;
+  snapshot->count = header->count;
+  for (id c = 0; c < ACY_CENSUS_COLUMNS; ++c) {
+    snapshot->columns[c] = (id const *) (
+      ((char const *) map) + header->columns[c]
+    );
+  }
+  snapshot->num_partner_entries = header->num_partner_entries;
+  snapshot->num_child_entries = header->num_child_entries;
+  return snapshot;
+}
+
+void acy_close_family_snapshot(acy_family_snapshot *snapshot) {
+  if (snapshot == NULL) {
+    return;
+  }
+  munmap(snapshot->map, snapshot->size);
+  free(snapshot);
+}
+
+id acy_snapshot_first(acy_family_snapshot const * const snapshot) {
+  return snapshot->first;
+}
+
+id acy_snapshot_count(acy_family_snapshot const * const snapshot) {
+  return snapshot->count;
+}
+
+int acy_snapshot_birthdate(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_birthdate
+) {
+  id row;
+  if (!acy_snapshot_row(snapshot, person, &row)) {
+    return 0;
+  }
+  *r_birthdate = snapshot->columns[ACY_CENSUS_BIRTHDATE][row];
+  return 1;
+}
+
+int acy_snapshot_mother_and_index(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_mother,
+  id *r_index
+) {
+  id row;
+  if (!acy_snapshot_row(snapshot, person, &row)) {
+    return 0;
+  }
+  *r_mother = snapshot->columns[ACY_CENSUS_MOTHER][row];
+  *r_index = snapshot->columns[ACY_CENSUS_MOTHER_INDEX][row];
+  return 1;
+}
+
+int acy_snapshot_num_direct_children(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_count
+) {
+  id row;
+  if (!acy_snapshot_row(snapshot, person, &row)) {
+    return 0;
+  }
+  *r_count = snapshot->columns[ACY_CENSUS_NUM_DIRECT_CHILDREN][row];
+  return 1;
+}
+
+int acy_snapshot_partners(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id const **r_partners,
+  id *r_count
+) {
+  return acy_snapshot_list(
+    snapshot,
+    person,
+    ACY_CENSUS_PARTNER_OFFSETS,
+    snapshot->num_partner_entries,
+    r_partners,
+    r_count
+  );
+}
+
+int acy_snapshot_children(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id const **r_children,
+  id *r_count
+) {
+  return acy_snapshot_list(
+    snapshot,
+    person,
+    ACY_CENSUS_CHILD_OFFSETS,
+    snapshot->num_child_entries,
+    r_children,
+    r_count
+  );
+}
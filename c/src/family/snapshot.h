@@ -0,0 +1,81 @@
+/**
+ * @file: snapshot.h
+ *
+ * @description: Read-only, memory-mapped access to census files (see
+ * census.h), so that family queries for the people a census covers can be
+ * answered by looking them up instead of computing them.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#ifndef INCLUDE_SNAPSHOT_H
+#define INCLUDE_SNAPSHOT_H
+
+#include "core/unit.h" // for "id"
+#include "family.h" // for acy_family_info and acy_family_snapshot
+
+/*************
+ * Functions *
+ *************/
+
+// The acy_family_snapshot type is declared in family.h. Use
+// acy_open_family_snapshot and acy_close_family_snapshot to create and
+// destroy snapshots. A snapshot never changes once opened, so any number of
+// threads can use it at once.
+
+// Memory-maps the census file at the given path, checking that it's intact
+// and that it was made with the same parameters (including the seed) as the
+// given info. Returns NULL if the file can't be opened or mapped, or if any
+// of the checks fail. To have the family queries use a snapshot, attach it to
+// an info with acy_set_info_snapshot.
+acy_family_snapshot * acy_open_family_snapshot(
+  char const *path,
+  acy_family_info const * const info
+);
+
+// Unmaps a snapshot. Detach it from any infos first.
+void acy_close_family_snapshot(acy_family_snapshot *snapshot);
+
+// Returns the first person covered by a snapshot, and the number of people
+// covered.
+id acy_snapshot_first(acy_family_snapshot const * const snapshot);
+id acy_snapshot_count(acy_family_snapshot const * const snapshot);
+
+// Lookups for a single person. Each returns 0 (without touching the return
+// parameters) if the snapshot doesn't cover that person, and 1 otherwise.
+// See census.h for what each value means.
+int acy_snapshot_birthdate(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_birthdate
+);
+
+int acy_snapshot_mother_and_index(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_mother,
+  id *r_index
+);
+
+int acy_snapshot_num_direct_children(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id *r_count
+);
+
+// The partner and children lists point into the mapped file.
+int acy_snapshot_partners(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id const **r_partners,
+  id *r_count
+);
+
+int acy_snapshot_children(
+  acy_family_snapshot const * const snapshot,
+  id person,
+  id const **r_children,
+  id *r_count
+);
+
+#endif // INCLUDE_SNAPSHOT_H
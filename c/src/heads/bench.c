@@ -0,0 +1,1008 @@
+/**
+ * @file: bench.c
+ *
+ * @description: Runs micro- and macro-benchmarks for the core operations and
+ * family queries, reporting time (and TSC cycles where available) per
+ * operation as JSON. Built against separately-optimized objects (see the
+ * bin/bench target in the Makefile).
+ *
+ * Each benchmark runs over an array of ids drawn from a range that suits it,
+ * in four configurations: with warm or cold caches (cold runs evict the data
+ * caches by sweeping a large buffer before each timed pass), and with a
+ * sequential or random id stream. Options:
+ *
+ *   --list        List benchmark names and exit.
+ *   --filter S    Only run benchmarks whose name or group contains S.
+ *   --ops N       Operations per timed pass (default 65536; heavier
+ *                 benchmarks cap this lower).
+ *   --reps N      Timed passes per configuration (default 5); the fastest
+ *                 pass is reported.
+ *   --out FILE    Write JSON to FILE instead of stdout.
+ *
+ * e.g.,
+ *
+ *   bench --filter select --out select.json
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+  #define BENCH_RDTSC
+  #include <x86intrin.h>
+#endif
+
+#include "core/unit.h"
+#include "core/batch.h"
+#include "core/divide.h"
+#include "core/cohort.h"
+#include "core/select.h"
+#include "family/family.h"
+#include "family/famcache.h"
+
+/*************
+ * Constants *
+ *************/
+
+#ifndef ACY_BENCH_CFLAGS
+  #define ACY_BENCH_CFLAGS "unknown"
+#endif
+
+#define DEFAULT_OPS 65536
+#define DEFAULT_REPS 5
+#define EVICT_BYTES (64 * 1024 * 1024)
+
+#define BENCH_SEED 1092809123
+#define BENCH_COHORT_SIZE 9984
+#define BENCH_PERMUTATION_SIZE 1024
+#define BENCH_TABLE_SIZE 16
+#define BENCH_TABLE_MULTIPLIER 312
+#define BENCH_FAMILY_BASE 448781327578432
+#define BENCH_INDEX_RANGE (4 * ACY_PARTNER_INDEX_BLOCK)
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// Shared setup for all benchmarks.
+struct bench_env_s {
+  id *sumtable;
+  acy_tabulated_ctx tabulated;
+  acy_shuffle_plan plan;
+  acy_select_ctx *select; // for table selection
+  acy_family_cache *family_cache;
+  acy_compiled_family *compiled; // for the partner index
+  acy_partner_index *partner_index; // built for the indexed_* benchmarks
+  acy_divisor upper_div;
+  acy_divisor max_div;
+  id cohort_size; // BENCH_COHORT_SIZE, loaded at run time
+  acy_divisor cohort_div; // for cohort_size
+  id *scratch; // DEFAULT_OPS or more ids
+  id *scratch2;
+  id scratch_size;
+  id seed; // BENCH_SEED, loaded at run time (see bench_seed)
+};
+typedef struct bench_env_s bench_env;
+
+// A benchmark processes n ids and returns a value that depends on all of the
+// results, so that nothing gets optimized away.
+typedef id (*bench_fn)(bench_env *env, id const *ids, id n);
+
+struct bench_case_s {
+  char const *name;
+  char const *group;
+  bench_fn fn;
+  id base; // ids are drawn from [base, base + range)
+  id range;
+  id max_ops; // 0 for no cap beyond --ops
+};
+typedef struct bench_case_s bench_case;
+
+/***********
+ * Globals *
+ ***********/
+
+// Benchmarks read the seed and divmod cohort size from here (via bench_env)
+// rather than using the constants directly, so that the compiler can't fold
+// arithmetic that depends on them (like the modulus reductions in acy_prng)
+// into constant-divisor code for the plain functions while their precomputed
+// counterparts pay the real costs.
+static volatile id bench_seed = BENCH_SEED;
+static volatile id bench_cohort_size = BENCH_COHORT_SIZE;
+
+/*********************
+ * Timing Functions *
+ *********************/
+
+static double bench_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static unsigned long long bench_cycles(void) {
+#ifdef BENCH_RDTSC
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// Sweeps a large buffer to push benchmark data out of the caches.
+static id bench_evict(void) {
+  static volatile char *buffer = NULL;
+  if (buffer == NULL) {
+    buffer = (volatile char *) malloc(EVICT_BYTES);
+    if (buffer == NULL) {
+      return 0;
+    }
+  }
+  id sum = 0;
+  for (id i = 0; i < EVICT_BYTES; i += 64) {
+    buffer[i] += 1;
+    sum += buffer[i];
+  }
+  return sum;
+}
+
+/***************************
+ * Benchmarks: Unit & Core *
+ ***************************/
+
+static id bench_prng(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_prng(ids[i], env->seed);
+  }
+  return sink;
+}
+
+static id bench_rev_prng(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_rev_prng(ids[i], env->seed);
+  }
+  return sink;
+}
+
+static id bench_prng_keyed(bench_env *env, id const *ids, id n) {
+  acy_prng_key key;
+  acy_prng_key_init(&key, env->seed);
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_prng_keyed(ids[i], &key);
+  }
+  return sink;
+}
+
+static id bench_prng_batch(bench_env *env, id const *ids, id n) {
+  acy_prng_batch(ids, env->scratch, n, env->seed);
+  return env->scratch[n / 2];
+}
+
+static id bench_divmod(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink += ids[i] / env->cohort_size + ids[i] % env->cohort_size;
+  }
+  return sink;
+}
+
+static id bench_divmod_precomputed(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    id q, r;
+    acy_divmod(ids[i], &env->cohort_div, &q, &r);
+    sink += q + r;
+  }
+  return sink;
+}
+
+static id bench_cohort_shuffle(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_cohort_shuffle(ids[i], BENCH_COHORT_SIZE, env->seed);
+  }
+  return sink;
+}
+
+static id bench_rev_cohort_shuffle(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_rev_cohort_shuffle(ids[i], BENCH_COHORT_SIZE, env->seed);
+  }
+  return sink;
+}
+
+static id bench_planned_cohort_shuffle(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_planned_cohort_shuffle(ids[i], &env->plan);
+  }
+  return sink;
+}
+
+// Counts one op per permuted item.
+static id bench_cohort_permutation(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id done = 0; done < n; done += BENCH_PERMUTATION_SIZE) {
+    acy_cohort_permutation(BENCH_PERMUTATION_SIZE, ids[done], env->scratch);
+    sink ^= env->scratch[ids[done] % BENCH_PERMUTATION_SIZE];
+  }
+  return sink;
+}
+
+static id bench_mixed_cohort(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_mixed_cohort_and_inner(
+      ids[i],
+      BENCH_COHORT_SIZE,
+      env->seed,
+      &cohort,
+      &inner
+    );
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_exp_cohort(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_exp_cohort_and_inner(ids[i], 5, 10000, env->seed, &cohort, &inner);
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_multiexp_cohort(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_multiexp_cohort_and_inner(
+      ids[i],
+      5,
+      10000,
+      8,
+      env->seed,
+      &cohort,
+      &inner
+    );
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_multipoly_cohort(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_multipoly_cohort_and_inner(
+      ids[i],
+      32,
+      3,
+      env->seed,
+      &cohort,
+      &inner
+    );
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_tabulated_cohort(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_tabulated_cohort_and_inner(
+      ids[i],
+      env->sumtable,
+      BENCH_TABLE_SIZE,
+      BENCH_TABLE_MULTIPLIER,
+      env->seed,
+      &cohort,
+      &inner
+    );
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_tabulated_cohort_ctx(bench_env *env, id const *ids, id n) {
+  id sink = 0, cohort, inner;
+  for (id i = 0; i < n; ++i) {
+    acy_tabulated_cohort_and_inner_ctx(
+      ids[i],
+      &env->tabulated,
+      &cohort,
+      &inner
+    );
+    sink ^= cohort + inner;
+  }
+  return sink;
+}
+
+static id bench_tabulated_cohort_batch(bench_env *env, id const *ids, id n) {
+  acy_tabulated_cohort_and_inner_batch(
+    ids,
+    n,
+    &env->tabulated,
+    env->scratch,
+    env->scratch2
+  );
+  return env->scratch[n / 2] + env->scratch2[n / 2];
+}
+
+static id bench_inv_tablesum(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_inv_tablesum(
+      ids[i],
+      env->sumtable,
+      BENCH_TABLE_SIZE,
+      BENCH_TABLE_MULTIPLIER
+    );
+  }
+  return sink;
+}
+
+static id bench_indexed_inv_tablesum(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_indexed_inv_tablesum(ids[i], &env->tabulated.index);
+  }
+  return sink;
+}
+
+/**********************
+ * Benchmarks: Select *
+ **********************/
+
+static id bench_select_parent(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_parent_and_index(ids[i], 4, 16, env->seed, &parent, &index);
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_parent_div(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_parent_and_index_div(
+      ids[i],
+      &env->upper_div,
+      &env->max_div,
+      env->seed,
+      &parent,
+      &index
+    );
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_nth_child(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_select_nth_child(ids[i], i % 4, 4, 16, env->seed);
+  }
+  return sink;
+}
+
+// Counts one op per parent.
+static id bench_select_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    id count = acy_select_children(ids[i], 4, 16, env->seed, env->scratch, 16);
+    sink ^= count + env->scratch[0];
+  }
+  return sink;
+}
+
+// Counts one op per parent: each id names a whole cohort of 16 parents.
+static id bench_select_cohort_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  id offsets[17];
+  for (id i = 0; i < n; i += 16) {
+    acy_select_cohort_children(
+      ids[i],
+      4,
+      64,
+      env->seed,
+      env->scratch,
+      offsets,
+      env->scratch2
+    );
+    sink ^= env->scratch[offsets[3]] + env->scratch2[offsets[15]];
+  }
+  return sink;
+}
+
+static id bench_count_select_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_count_select_children(ids[i], 4, 16, env->seed);
+  }
+  return sink;
+}
+
+static id bench_select_exp_parent(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_exp_parent_and_index(
+      ids[i],
+      1,
+      32,
+      2,
+      1024,
+      4,
+      env->seed,
+      &parent,
+      &index
+    );
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_poly_parent(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_poly_parent_and_index(
+      ids[i],
+      32,
+      32,
+      32,
+      8,
+      env->seed,
+      &parent,
+      &index
+    );
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_table_parent(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_table_parent_and_index(
+      ids[i],
+      32,
+      32,
+      env->sumtable,
+      BENCH_TABLE_SIZE,
+      32 * BENCH_COHORT_SIZE,
+      env->seed,
+      &parent,
+      &index
+    );
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_table_nth_child(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_select_table_nth_child(
+      ids[i],
+      i % 8,
+      32,
+      32,
+      env->sumtable,
+      BENCH_TABLE_SIZE,
+      32 * BENCH_COHORT_SIZE,
+      env->seed
+    );
+  }
+  return sink;
+}
+
+static id bench_select_table_parent_ctx(bench_env *env, id const *ids, id n) {
+  id sink = 0, parent, index;
+  for (id i = 0; i < n; ++i) {
+    acy_select_table_parent_and_index_ctx(ids[i], env->select, &parent, &index);
+    sink ^= parent + index;
+  }
+  return sink;
+}
+
+static id bench_select_table_parent_batch(
+  bench_env *env,
+  id const *ids,
+  id n
+) {
+  acy_select_table_parent_and_index_batch(
+    ids,
+    n,
+    env->select,
+    env->scratch,
+    env->scratch2
+  );
+  return env->scratch[n / 2] + env->scratch2[n / 2];
+}
+
+static id bench_select_table_nth_child_ctx(
+  bench_env *env,
+  id const *ids,
+  id n
+) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_select_table_nth_child_ctx(ids[i], i % 8, env->select);
+  }
+  return sink;
+}
+
+// Counts one op per parent.
+static id bench_select_table_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    id count = acy_select_table_children(
+      ids[i],
+      32,
+      32,
+      env->sumtable,
+      BENCH_TABLE_SIZE,
+      32 * BENCH_COHORT_SIZE,
+      env->seed,
+      env->scratch,
+      32
+    );
+    sink ^= count + env->scratch[0];
+  }
+  return sink;
+}
+
+/**********************
+ * Benchmarks: Family *
+ **********************/
+
+static id bench_birthdate(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_birthdate(ids[i], &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_mother_and_index(bench_env *env, id const *ids, id n) {
+  id sink = 0, mother, index;
+  for (id i = 0; i < n; ++i) {
+    acy_mother_and_index(ids[i], &DEFAULT_FAMILY_INFO, &mother, &index);
+    sink ^= mother + index;
+  }
+  return sink;
+}
+
+static id bench_num_direct_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_num_direct_children(ids[i], &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_direct_child(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_direct_child(ids[i], 0, &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_num_partners(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_num_partners(ids[i], &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_nth_partner(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_nth_partner(ids[i], 1, &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_num_children(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_num_children(ids[i], &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+static id bench_child(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_child(ids[i], 0, &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+// All four partner-derived queries for each person, as a typical
+// relationship lookup would make them.
+static id bench_partner_queries(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_num_partners(ids[i], &DEFAULT_FAMILY_INFO);
+    sink ^= acy_nth_partner(ids[i], 1, &DEFAULT_FAMILY_INFO);
+    sink ^= acy_num_children(ids[i], &DEFAULT_FAMILY_INFO);
+    sink ^= acy_child(ids[i], 0, &DEFAULT_FAMILY_INFO);
+  }
+  return sink;
+}
+
+// As above, starting from an empty family cache.
+static id bench_partner_queries_cached(bench_env *env, id const *ids, id n) {
+  acy_clear_family_cache(env->family_cache);
+  acy_set_thread_family_cache(env->family_cache);
+  id sink = bench_partner_queries(env, ids, n);
+  acy_set_thread_family_cache(NULL);
+  return sink;
+}
+
+// The same information as bench_partner_queries and more, in one query.
+static id bench_person_record(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  id partners[64], children[64];
+  acy_person_record record;
+  record.partners = partners;
+  record.partners_cap = 64;
+  record.children = children;
+  record.children_cap = 64;
+  for (id i = 0; i < n; ++i) {
+    acy_get_person_record(ids[i], &DEFAULT_FAMILY_INFO, &record);
+    sink ^= record.mother + record.num_partners + record.num_children;
+  }
+  return sink;
+}
+
+// As bench_partner_queries, using a partner index that covers the ids.
+static id bench_indexed_partner_queries(bench_env *env, id const *ids, id n) {
+  id sink = 0;
+  for (id i = 0; i < n; ++i) {
+    sink ^= acy_indexed_num_partners(ids[i], env->partner_index);
+    sink ^= acy_indexed_nth_partner(ids[i], 1, env->partner_index);
+    sink ^= acy_indexed_num_children(ids[i], env->partner_index);
+    sink ^= acy_indexed_child(ids[i], 0, env->partner_index);
+  }
+  return sink;
+}
+
+/************
+ * Registry *
+ ************/
+
+#define CHILD_BASE (((id) 2) << 50)
+
+static bench_case const BENCHES[] = {
+  // name, group, function, base, range, max_ops
+  { "prng", "unit", &bench_prng, 0, (id) -1, 0 },
+  { "rev_prng", "unit", &bench_rev_prng, 0, (id) -1, 0 },
+  { "prng_keyed", "unit", &bench_prng_keyed, 0, (id) -1, 0 },
+  { "prng_batch", "unit", &bench_prng_batch, 0, (id) -1, 0 },
+  { "divmod", "unit", &bench_divmod, 0, (id) -1, 0 },
+  { "divmod_precomputed", "unit", &bench_divmod_precomputed, 0, (id) -1, 0 },
+
+  { "cohort_shuffle", "cohort", &bench_cohort_shuffle,
+    0, BENCH_COHORT_SIZE, 0 },
+  { "rev_cohort_shuffle", "cohort", &bench_rev_cohort_shuffle,
+    0, BENCH_COHORT_SIZE, 0 },
+  { "planned_cohort_shuffle", "cohort", &bench_planned_cohort_shuffle,
+    0, BENCH_COHORT_SIZE, 0 },
+  { "cohort_permutation", "cohort", &bench_cohort_permutation,
+    0, (id) -1, 0 },
+  { "mixed_cohort", "cohort", &bench_mixed_cohort, 0, ((id) 1) << 40, 0 },
+  { "exp_cohort", "cohort", &bench_exp_cohort, 0, ((id) 1) << 40, 0 },
+  { "multiexp_cohort", "cohort", &bench_multiexp_cohort,
+    0, ((id) 1) << 40, 0 },
+  { "multipoly_cohort", "cohort", &bench_multipoly_cohort,
+    0, ((id) 1) << 40, 0 },
+  { "tabulated_cohort", "cohort", &bench_tabulated_cohort,
+    0, ((id) 1) << 40, 0 },
+  { "tabulated_cohort_ctx", "cohort", &bench_tabulated_cohort_ctx,
+    0, ((id) 1) << 40, 0 },
+  { "tabulated_cohort_batch", "cohort", &bench_tabulated_cohort_batch,
+    0, ((id) 1) << 40, 0 },
+  { "inv_tablesum", "cohort", &bench_inv_tablesum,
+    0, 66 * BENCH_TABLE_MULTIPLIER, 0 },
+  { "indexed_inv_tablesum", "cohort", &bench_indexed_inv_tablesum,
+    0, 66 * BENCH_TABLE_MULTIPLIER, 0 },
+
+  { "select_parent", "select", &bench_select_parent,
+    16, ((id) 1) << 40, 0 },
+  { "select_parent_div", "select", &bench_select_parent_div,
+    16, ((id) 1) << 40, 0 },
+  { "select_nth_child", "select", &bench_select_nth_child,
+    0, ((id) 1) << 40, 0 },
+  { "select_children", "select", &bench_select_children,
+    0, ((id) 1) << 40, 0 },
+  { "select_cohort_children", "select", &bench_select_cohort_children,
+    0, ((id) 1) << 36, 0 },
+  { "count_select_children", "select", &bench_count_select_children,
+    0, ((id) 1) << 40, 0 },
+  { "select_exp_parent", "select", &bench_select_exp_parent,
+    1 << 20, ((id) 1) << 40, 16384 },
+  { "select_poly_parent", "select", &bench_select_poly_parent,
+    1 << 20, ((id) 1) << 40, 16384 },
+  { "select_table_parent", "select", &bench_select_table_parent,
+    CHILD_BASE, ((id) 1) << 40, 16384 },
+  { "select_table_nth_child", "select", &bench_select_table_nth_child,
+    CHILD_BASE, ((id) 1) << 40, 16384 },
+  { "select_table_parent_ctx", "select", &bench_select_table_parent_ctx,
+    CHILD_BASE, ((id) 1) << 40, 16384 },
+  { "select_table_parent_batch", "select", &bench_select_table_parent_batch,
+    CHILD_BASE, ((id) 1) << 40, 16384 },
+  { "select_table_nth_child_ctx", "select", &bench_select_table_nth_child_ctx,
+    CHILD_BASE, ((id) 1) << 40, 16384 },
+  { "select_table_children", "select", &bench_select_table_children,
+    CHILD_BASE, ((id) 1) << 40, 4096 },
+
+  { "birthdate", "family", &bench_birthdate,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 0 },
+  { "mother_and_index", "family", &bench_mother_and_index,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 8192 },
+  { "num_direct_children", "family", &bench_num_direct_children,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 8192 },
+  { "direct_child", "family", &bench_direct_child,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 8192 },
+  { "num_partners", "family", &bench_num_partners,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 1024 },
+  { "nth_partner", "family", &bench_nth_partner,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "num_children", "family", &bench_num_children,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "child", "family", &bench_child,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "partner_queries", "family", &bench_partner_queries,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "partner_queries_cached", "family", &bench_partner_queries_cached,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "person_record", "family", &bench_person_record,
+    BENCH_FAMILY_BASE, ((id) 1) << 30, 256 },
+  { "indexed_partner_queries", "family", &bench_indexed_partner_queries,
+    BENCH_FAMILY_BASE, BENCH_INDEX_RANGE, 8192 },
+};
+
+#define N_BENCHES (sizeof(BENCHES) / sizeof(bench_case))
+
+/*************
+ * Functions *
+ *************/
+
+// Fills ids with a sequential or random stream for the given benchmark.
+static void bench_fill_ids(
+  bench_case const * const bench,
+  int random,
+  id *ids,
+  id n
+) {
+  id start = acy_prng(17, BENCH_SEED) % bench->range;
+  for (id i = 0; i < n; ++i) {
+    id offset = random ? acy_prng(i, BENCH_SEED) : start + i;
+    if (bench->range != (id) -1) {
+      offset %= bench->range;
+    }
+    ids[i] = bench->base + offset;
+  }
+}
+
+// Runs one configuration of one benchmark, returning the fastest pass via
+// r_seconds and r_cycles (per op).
+static id bench_run(
+  bench_env *env,
+  bench_case const * const bench,
+  id const *ids,
+  id n,
+  int cold,
+  id reps,
+  double *r_seconds,
+  double *r_cycles
+) {
+  id sink = 0;
+  double best_seconds = -1;
+  double best_cycles = -1;
+  if (!cold) {
+    sink ^= bench->fn(env, ids, n); // warm-up pass
+  }
+  for (id rep = 0; rep < reps; ++rep) {
+    if (cold) {
+      sink ^= bench_evict();
+    }
+    double start = bench_now();
+    unsigned long long start_cycles = bench_cycles();
+    sink ^= bench->fn(env, ids, n);
+    unsigned long long cycles = bench_cycles() - start_cycles;
+    double seconds = bench_now() - start;
+    if (best_seconds < 0 || seconds < best_seconds) {
+      best_seconds = seconds;
+      best_cycles = (double) cycles;
+    }
+  }
+  *r_seconds = best_seconds / n;
+  *r_cycles = best_cycles / n;
+  return sink;
+}
+
+static int bench_parse_size(char const *arg, id *r_value) {
+  if (arg == NULL || sscanf(arg, "%lu", r_value) != 1 || *r_value == 0) {
+    fprintf(stderr, "Error: couldn't parse '%s' as a positive number.\n", arg);
+    return 0;
+  }
+  return 1;
+}
+
+static void bench_setup(bench_env *env, id ops) {
+  env->seed = bench_seed;
+  env->cohort_size = bench_cohort_size;
+  acy_divisor_init(&env->cohort_div, env->cohort_size);
+  id disttable[BENCH_TABLE_SIZE] = {
+    1, 1, 1, 2, 2, 3, 4, 5, 6, 8, 12, 9, 6, 3, 2, 1
+  };
+  acy_create_sumtable(disttable, BENCH_TABLE_SIZE, &env->sumtable);
+  acy_create_tabulated_ctx(
+    env->sumtable,
+    BENCH_TABLE_SIZE,
+    BENCH_TABLE_MULTIPLIER,
+    env->seed,
+    &env->tabulated
+  );
+  acy_shuffle_plan_init(&env->plan, BENCH_COHORT_SIZE, env->seed);
+  env->select = acy_create_select_ctx(
+    32,
+    32,
+    env->sumtable,
+    BENCH_TABLE_SIZE,
+    32 * BENCH_COHORT_SIZE,
+    env->seed
+  );
+  acy_select_init_divisors(4, 16, &env->upper_div, &env->max_div);
+  env->family_cache = acy_create_family_cache(ACY_FAMILY_CACHE_DEFAULT_BUDGET);
+  env->compiled = acy_compile_family_info(&DEFAULT_FAMILY_INFO);
+  env->partner_index = acy_create_partner_index(env->compiled);
+  acy_partner_index_build_range(
+    env->partner_index,
+    BENCH_FAMILY_BASE,
+    BENCH_FAMILY_BASE + BENCH_INDEX_RANGE - 1
+  );
+  env->scratch_size = acy_max(ops, BENCH_PERMUTATION_SIZE);
+  env->scratch = (id*) malloc(sizeof(id) * env->scratch_size);
+  env->scratch2 = (id*) malloc(sizeof(id) * env->scratch_size);
+}
+
+static void bench_cleanup(bench_env *env) {
+  acy_cleanup_tabulated_ctx(&env->tabulated);
+  acy_destroy_select_ctx(env->select);
+  acy_destroy_family_cache(env->family_cache);
+  acy_destroy_partner_index(env->partner_index);
+  acy_destroy_compiled_family(env->compiled);
+  acy_cleanup_sumtable(env->sumtable);
+  free(env->scratch);
+  free(env->scratch2);
+}
+
+int main(int argc, char** argv) {
+  char const *filter = NULL;
+  char const *out_path = NULL;
+  id ops = DEFAULT_OPS;
+  id reps = DEFAULT_REPS;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--list") == 0) {
+      for (id b = 0; b < N_BENCHES; ++b) {
+        fprintf(stdout, "%s/%s\n", BENCHES[b].group, BENCHES[b].name);
+      }
+      return EXIT_SUCCESS;
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "--ops") == 0) {
+      if (!bench_parse_size(i + 1 < argc ? argv[++i] : NULL, &ops)) {
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--reps") == 0) {
+      if (!bench_parse_size(i + 1 < argc ? argv[++i] : NULL, &reps)) {
+        return EXIT_FAILURE;
+      }
+    } else {
+      fprintf(stderr, "Error: unknown argument '%s'.\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  FILE *out = stdout;
+  if (out_path != NULL) {
+    out = fopen(out_path, "w");
+    if (out == NULL) {
+      fprintf(stderr, "Error: couldn't open '%s' for writing.\n", out_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  bench_env env;
+  bench_setup(&env, ops);
+  id *ids = (id*) malloc(sizeof(id) * ops);
+  if (
+    ids == NULL
+ || env.scratch == NULL
+ || env.scratch2 == NULL
+ || env.select == NULL
+  ) {
+    fprintf(stderr, "Error: couldn't allocate benchmark arrays.\n");
+    return EXIT_FAILURE;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"compiler\": \"%s\",\n", __VERSION__);
+  fprintf(out, "  \"cflags\": \"%s\",\n", ACY_BENCH_CFLAGS);
+  fprintf(
+    out,
+    "  \"batch_kernel\": \"%s\",\n",
+    acy_batch_kernel_name(acy_get_batch_kernel())
+  );
+#ifdef BENCH_RDTSC
+  fprintf(out, "  \"cycle_counter\": \"rdtsc\",\n");
+#else
+  fprintf(out, "  \"cycle_counter\": null,\n");
+#endif
+  fprintf(out, "  \"reps\": %lu,\n", reps);
+  fprintf(out, "  \"results\": [");
+
+  id sink = 0;
+  int first = 1;
+  for (id b = 0; b < N_BENCHES; ++b) {
+    bench_case const * const bench = &BENCHES[b];
+    if (
+      filter != NULL
+   && strstr(bench->name, filter) == NULL
+   && strstr(bench->group, filter) == NULL
+    ) {
+      continue;
+    }
+    id n = ops;
+    if (bench->max_ops != 0 && n > bench->max_ops) {
+      n = bench->max_ops;
+    }
+    for (int cold = 0; cold < 2; ++cold) {
+      for (int random = 0; random < 2; ++random) {
+        double seconds, cycles;
+        bench_fill_ids(bench, random, ids, n);
+        sink ^= bench_run(&env, bench, ids, n, cold, reps, &seconds, &cycles);
+        fprintf(out, "%s\n    {", first ? "" : ",");
+        first = 0;
+        fprintf(out, "\"name\": \"%s\", ", bench->name);
+        fprintf(out, "\"group\": \"%s\", ", bench->group);
+        fprintf(out, "\"cache\": \"%s\", ", cold ? "cold" : "warm");
+        fprintf(out, "\"stream\": \"%s\", ", random ? "random" : "sequential");
+        fprintf(out, "\"ops\": %lu, ", n);
+        fprintf(out, "\"ns_per_op\": %.3f, ", seconds * 1e9);
+#ifdef BENCH_RDTSC
+        fprintf(out, "\"cycles_per_op\": %.2f}", cycles);
+#else
+        fprintf(out, "\"cycles_per_op\": null}");
+#endif
+        fflush(out);
+      }
+    }
+  }
+  fprintf(out, "\n  ],\n");
+  fprintf(out, "  \"checksum\": %lu\n", sink);
+  fprintf(out, "}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+  free(ids);
+  bench_cleanup(&env);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,456 @@
+/**
+ * @file: census.c
+ *
+ * @description: Computes the family information for a range of people using
+ * a thread pool (see src/core/pool.h) and writes it out as a census file (see
+ * src/family/census.h for the layout), which can be memory-mapped for
+ * offline analysis. Usage:
+ *
+ *   census [options] --out FILE FIRST COUNT
+ *
+ * to cover COUNT people starting with person FIRST. Options:
+ *
+ *   --threads N   Use N worker threads (default: one per online CPU).
+ *   --chunk N     Hand out N people at a time to each worker (default 4096).
+ *                 The output doesn't depend on the thread count or chunk
+ *                 size.
+ *   --seed S      Use seed S instead of the default family info's seed.
+ *
+ * e.g.,
+ *
+ *   census --threads 8 --out census.acy 448781327578432 10000000
+ *
+ * Everything is held in memory until all of the people are done, so this
+ * needs about as much memory as the output file.
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "core/unit.h"
+#include "core/pool.h"
+#include "family/family.h"
+#include "family/famcache.h"
+#include "family/census.h"
+
+/*************
+ * Constants *
+ *************/
+
+#define DEFAULT_CHUNK 4096
+#define MAX_THREADS 256
+
+// Initial room for partners or children in a person record.
+#define INITIAL_RECORD_CAP 256
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// The partners and children of the people in one chunk, concatenated.
+struct census_chunk_s {
+  id *partners;
+  id num_partners;
+  id partners_cap;
+  id *children;
+  id num_children;
+  id children_cap;
+};
+typedef struct census_chunk_s census_chunk;
+
+// Per-thread scratch space.
+struct census_worker_s {
+  acy_family_cache *cache;
+  acy_person_record record;
+  int failed;
+};
+typedef struct census_worker_s census_worker;
+
+// Shared state: the pool hands out chunks to workers, which fill in the
+// fixed-width columns directly, along with per-person child counts (which
+// become the child offsets once everyone is done).
+struct census_state_s {
+  acy_compiled_family const *compiled;
+  id first;
+  id count;
+  id chunk_size;
+  id n_chunks;
+  census_chunk *chunks;
+  census_worker *workers; // one per pool thread
+  id *columns[ACY_CENSUS_COLUMNS]; // fixed-width columns and child counts
+};
+typedef struct census_state_s census_state;
+
+/*************
+ * Functions *
+ *************/
+
+// Appends n ids to a growable list, returning 0 if allocation fails.
+static int census_append(
+  id **list,
+  id *length,
+  id *capacity,
+  id const *values,
+  id n
+) {
+  if (*length + n > *capacity) {
+    id new_capacity = *capacity * 2;
+    if (new_capacity < *length + n) {
+      new_capacity = *length + n;
+    }
+    id *grown = (id*) realloc(*list, new_capacity * sizeof(id));
+    if (grown == NULL) {
+      return 0;
+    }
+    *list = grown;
+    *capacity = new_capacity;
+  }
+  memcpy(*list + *length, values, n * sizeof(id));
+  *length += n;
+  return 1;
+}
+
+// Computes one chunk, returning 0 if allocation fails.
+static int census_do_chunk(
+  census_state *state,
+  id chunk_index,
+  acy_person_record *record
+) {
+  census_chunk *chunk = &state->chunks[chunk_index];
+  id start = chunk_index * state->chunk_size;
+  id end = start + state->chunk_size;
+  if (end > state->count) {
+    end = state->count;
+  }
+  for (id i = start; i < end; ++i) {
+    id person = state->first + i;
+    acy_compiled_person_record(person, state->compiled, record);
+    id cap = record->num_partners;
+    if (record->num_children > cap) {
+      cap = record->num_children;
+    }
+    if (cap > record->partners_cap) {
+      // Grow the record and try again:
+      id *partners = (id*) realloc(record->partners, cap * sizeof(id));
+      if (partners != NULL) {
+        record->partners = partners;
+        record->partners_cap = cap;
+      }
+      id *children = (id*) realloc(record->children, cap * sizeof(id));
+      if (children != NULL) {
+        record->children = children;
+        record->children_cap = cap;
+      }
+      if (partners == NULL || children == NULL) {
+        return 0;
+      }
+      acy_compiled_person_record(person, state->compiled, record);
+    }
+    state->columns[ACY_CENSUS_BIRTHDATE][i] = record->birthdate;
+    state->columns[ACY_CENSUS_MOTHER][i] = record->mother;
+    state->columns[ACY_CENSUS_MOTHER_INDEX][i] = record->index;
+    state->columns[ACY_CENSUS_NUM_DIRECT_CHILDREN][i] = (
+      record->num_direct_children
+    );
+    state->columns[ACY_CENSUS_NUM_PARTNERS][i] = record->num_partners;
+    state->columns[ACY_CENSUS_CHILD_OFFSETS][i] = record->num_children;
+    if (
+      !census_append(
+        &chunk->partners,
+        &chunk->num_partners,
+        &chunk->partners_cap,
+        record->partners,
+        record->num_partners
+      )
+   || !census_append(
+        &chunk->children,
+        &chunk->num_children,
+        &chunk->children_cap,
+        record->children,
+        record->num_children
+      )
+    ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// Pool body: computes a range of chunks.
+static void census_do_chunks(id start, id end, id worker, void *context) {
+  census_state *state = (census_state*) context;
+  census_worker *self = &state->workers[worker];
+  acy_set_thread_family_cache(self->cache);
+  for (id chunk = start; chunk < end && !self->failed; ++chunk) {
+    self->failed = !census_do_chunk(state, chunk, &self->record);
+  }
+  acy_set_thread_family_cache(NULL);
+}
+
+// Sets up scratch space for each worker. Returns 0 if allocation fails.
+static int census_create_workers(census_state *state, id n_workers) {
+  state->workers = (census_worker*) calloc(n_workers, sizeof(census_worker));
+  if (state->workers == NULL) {
+    return 0;
+  }
+  for (id i = 0; i < n_workers; ++i) {
+    census_worker *worker = &state->workers[i];
+    worker->cache = acy_create_family_cache(ACY_FAMILY_CACHE_DEFAULT_BUDGET);
+    worker->record.partners = (id*) malloc(INITIAL_RECORD_CAP * sizeof(id));
+    worker->record.partners_cap = INITIAL_RECORD_CAP;
+    worker->record.children = (id*) malloc(INITIAL_RECORD_CAP * sizeof(id));
+    worker->record.children_cap = INITIAL_RECORD_CAP;
+    if (
+      worker->cache == NULL
+   || worker->record.partners == NULL
+   || worker->record.children == NULL
+    ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static void census_destroy_workers(census_state *state, id n_workers) {
+  if (state->workers == NULL) {
+    return;
+  }
+  for (id i = 0; i < n_workers; ++i) {
+    acy_destroy_family_cache(state->workers[i].cache);
+    free(state->workers[i].record.partners);
+    free(state->workers[i].record.children);
+  }
+  free(state->workers);
+}
+
+// Writes n ids followed by padding up to the next column. Returns 0 on
+// error.
+static int census_write(FILE *out, id const *values, id n, id *r_offset) {
+  if (n > 0 && fwrite(values, sizeof(id), n, out) != n) {
+    return 0;
+  }
+  *r_offset += n * sizeof(id);
+  static char const padding[ACY_CENSUS_ALIGNMENT] = { 0 };
+  id pad = (ACY_CENSUS_ALIGNMENT - *r_offset % ACY_CENSUS_ALIGNMENT)
+    % ACY_CENSUS_ALIGNMENT;
+  if (pad > 0 && fwrite(padding, 1, pad, out) != pad) {
+    return 0;
+  }
+  *r_offset += pad;
+  return 1;
+}
+
+// Turns per-person counts into count + 1 offsets, in place (counts must have
+// room for one more entry).
+static void census_prefix_sums(id *counts, id count) {
+  id total = 0;
+  for (id i = 0; i < count; ++i) {
+    id here = counts[i];
+    counts[i] = total;
+    total += here;
+  }
+  counts[count] = total;
+}
+
+// Writes the finished census to the given file. Returns 0 on error.
+static int census_write_file(census_state *state, char const *path) {
+  acy_census_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, ACY_CENSUS_MAGIC, sizeof(header.magic));
+  header.byte_order = ACY_CENSUS_BYTE_ORDER;
+  header.version = ACY_CENSUS_VERSION;
+  header.first = state->first;
+  header.count = state->count;
+  acy_get_family_params(
+    acy_compiled_family_info(state->compiled),
+    header.params
+  );
+  for (id c = 0; c < state->n_chunks; ++c) {
+    header.num_partner_entries += state->chunks[c].num_partners;
+    header.num_child_entries += state->chunks[c].num_children;
+  }
+  acy_census_layout(&header);
+
+  // Partner offsets come from the partner counts:
+  memcpy(
+    state->columns[ACY_CENSUS_PARTNER_OFFSETS],
+    state->columns[ACY_CENSUS_NUM_PARTNERS],
+    state->count * sizeof(id)
+  );
+  census_prefix_sums(state->columns[ACY_CENSUS_PARTNER_OFFSETS], state->count);
+  census_prefix_sums(state->columns[ACY_CENSUS_CHILD_OFFSETS], state->count);
+
+  FILE *out = fopen(path, "wb");
+  if (out == NULL) {
+    return 0;
+  }
+  id offset = 0;
+  int ok = fwrite(&header, sizeof(header), 1, out) == 1;
+  offset += sizeof(header);
+  ok = ok && census_write(out, NULL, 0, &offset); // pad to the first column
+  for (id c = 0; ok && c < ACY_CENSUS_COLUMNS; ++c) {
+    if (c == ACY_CENSUS_PARTNERS || c == ACY_CENSUS_CHILDREN) {
+      for (id k = 0; ok && k < state->n_chunks; ++k) {
+        census_chunk *chunk = &state->chunks[k];
+        id n = chunk->num_partners;
+        id const *values = chunk->partners;
+        if (c == ACY_CENSUS_CHILDREN) {
+          n = chunk->num_children;
+          values = chunk->children;
+        }
+        ok = n == 0 || fwrite(values, sizeof(id), n, out) == n;
+        offset += n * sizeof(id);
+      }
+      ok = ok && census_write(out, NULL, 0, &offset);
+    } else {
+      ok = census_write(
+        out,
+        state->columns[c],
+        acy_census_column_length(&header, c),
+        &offset
+      );
+    }
+  }
+  ok = fclose(out) == 0 && ok;
+  return ok && offset == header.file_size;
+}
+
+static int census_parse_id(char const *arg, id *r_value) {
+  unsigned long long value;
+  if (arg == NULL || sscanf(arg, "%llu", &value) != 1) {
+    fprintf(stderr, "Error: couldn't parse '%s' as a number.\n", arg);
+    return 0;
+  }
+  *r_value = (id) value;
+  return 1;
+}
+
+int main(int argc, char** argv) {
+  char const *out_path = NULL;
+  id n_threads = 0;
+  id chunk_size = DEFAULT_CHUNK;
+  id seed = 0;
+  int have_seed = 0;
+  id positional[2];
+  int n_positional = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    char const *next = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(argv[i], "--out") == 0 && next != NULL) {
+      out_path = argv[++i];
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      if (!census_parse_id(next, &n_threads)) {
+        return EXIT_FAILURE;
+      }
+      ++i;
+    } else if (strcmp(argv[i], "--chunk") == 0) {
+      if (!census_parse_id(next, &chunk_size)) {
+        return EXIT_FAILURE;
+      }
+      ++i;
+    } else if (strcmp(argv[i], "--seed") == 0) {
+      if (!census_parse_id(next, &seed)) {
+        return EXIT_FAILURE;
+      }
+      have_seed = 1;
+      ++i;
+    } else if (n_positional < 2) {
+      if (!census_parse_id(argv[i], &positional[n_positional])) {
+        return EXIT_FAILURE;
+      }
+      n_positional += 1;
+    } else {
+      fprintf(stderr, "Error: unknown argument '%s'.\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (out_path == NULL || n_positional != 2) {
+    fprintf(stderr, "Usage: census [options] --out FILE FIRST COUNT\n");
+    return EXIT_FAILURE;
+  }
+  if (n_threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = online > 0 ? (id) online : 1;
+  }
+  if (n_threads > MAX_THREADS) {
+    n_threads = MAX_THREADS;
+  }
+  if (chunk_size == 0) {
+    fprintf(stderr, "Error: chunk size must be positive.\n");
+    return EXIT_FAILURE;
+  }
+
+  acy_family_info *info = acy_create_family_info();
+  if (info == NULL) {
+    fprintf(stderr, "Error: out of memory.\n");
+    return EXIT_FAILURE;
+  }
+  acy_copy_family_info(&DEFAULT_FAMILY_INFO, info);
+  if (have_seed) {
+    acy_set_info_seed(info, seed);
+  }
+
+  census_state state;
+  memset(&state, 0, sizeof(state));
+  state.compiled = acy_compile_family_info(info);
+  state.first = positional[0];
+  state.count = positional[1];
+  state.chunk_size = chunk_size;
+  state.n_chunks = (state.count + chunk_size - 1) / chunk_size;
+  state.chunks = (census_chunk*) calloc(
+    state.n_chunks + 1, // never zero
+    sizeof(census_chunk)
+  );
+  acy_pool *pool = acy_create_pool(n_threads);
+  int ok = (
+    state.compiled != NULL
+ && state.chunks != NULL
+ && pool != NULL
+ && census_create_workers(&state, n_threads)
+  );
+  for (id c = 0; c < ACY_CENSUS_COLUMNS; ++c) {
+    if (c != ACY_CENSUS_PARTNERS && c != ACY_CENSUS_CHILDREN) {
+      // (room for the extra offset, in all of them)
+      state.columns[c] = (id*) malloc((state.count + 1) * sizeof(id));
+      ok = ok && state.columns[c] != NULL;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Error: out of memory.\n");
+    return EXIT_FAILURE;
+  }
+
+  // Chunks are handed out one at a time, since they're already big:
+  acy_parallel_for(pool, 0, state.n_chunks, 1, &census_do_chunks, &state);
+  acy_destroy_pool(pool);
+  int failed = 0;
+  for (id i = 0; i < n_threads; ++i) {
+    failed = failed || state.workers[i].failed;
+  }
+
+  int result = EXIT_SUCCESS;
+  if (failed) {
+    fprintf(stderr, "Error: out of memory.\n");
+    result = EXIT_FAILURE;
+  } else if (!census_write_file(&state, out_path)) {
+    fprintf(stderr, "Error: couldn't write '%s'.\n", out_path);
+    result = EXIT_FAILURE;
+  }
+
+  for (id c = 0; c < state.n_chunks; ++c) {
+    free(state.chunks[c].partners);
+    free(state.chunks[c].children);
+  }
+  free(state.chunks);
+  census_destroy_workers(&state, n_threads);
+  for (id c = 0; c < ACY_CENSUS_COLUMNS; ++c) {
+    free(state.columns[c]);
+  }
+  acy_destroy_compiled_family((acy_compiled_family*) state.compiled);
+  acy_destroy_family_info(info);
+  return result;
+}
@@ -6,41 +6,404 @@
  * bytes (it generates that many ids, and each id is 8 bytes).
  *
  * Suitable for piping into dieharder -g200, e.g.,
- * 
+ *
  *   rng 10000000000 | dieharder -g200 -a
  *
+ * Output is generated in large aligned blocks which are written using
+ * write(2). Options:
+ *
+ *   --counter     Output acy_prng(start + i) for i = 0, 1, 2, ... instead of
+ *                 chaining each output into the next input. This lets whole
+ *                 blocks be generated with the batch PRNG.
+ *   --threads N   Use N worker threads to fill blocks (implies --counter).
+ *                 Each worker handles every Nth block of the counter space,
+ *                 and blocks are always written in order, so the byte stream
+ *                 doesn't depend on N.
+ *   --block N     Generate N ids per block (default 65536).
+ *   --vmsplice    When stdout is a pipe, hand blocks to the pipe with
+ *                 vmsplice(2) instead of copying them (Linux only). The pipe
+ *                 is resized to one block, so that a block is only reused
+ *                 once the following block has been fully accepted by the
+ *                 pipe (and thus the reader has consumed the earlier one).
+ *                 Falls back to write(2) if stdout isn't a pipe.
+ *
+ * e.g.,
+ *
+ *   rng --threads 4 --vmsplice | RNG_test stdin64
+ *
  * @author: Peter Mawhorter (pmawhorter@gmail.com)
  */
 
+#ifdef __linux__
+  #define _GNU_SOURCE // for vmsplice and F_SETPIPE_SZ
+  #include <fcntl.h>
+  #include <sys/uio.h>
+#endif
+
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "core/unit.h"
+#include "core/batch.h"
+
+/*************
+ * Constants *
+ *************/
+
+#define RNG_START 7817298123
+#define RNG_SEED 1092809123
+
+#define DEFAULT_BLOCK_IDS 65536
+#define BLOCK_ALIGNMENT 4096
+#define MAX_THREADS 256
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// Shared state for the threaded counter mode. Block k is generated by worker
+// k % n_threads into slot k % n_slots, and written by the main thread. Each
+// slot records which block it's currently free for (ready_for) and which block
+// it currently holds (holds).
+struct rng_state_s {
+  size_t block_ids;
+  size_t limit; // in ids; 0 for unlimited
+  size_t n_threads;
+  size_t n_slots;
+  id **slots;
+  size_t *ready_for;
+  size_t *holds;
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t slot_freed;
+  pthread_cond_t slot_filled;
+};
+typedef struct rng_state_s rng_state;
+
+struct rng_worker_s {
+  rng_state *state;
+  size_t index;
+};
+typedef struct rng_worker_s rng_worker;
+
+// Output mode: vmsplice requires that a block stays untouched until the
+// following block has been fully spliced.
+struct rng_output_s {
+  int fd;
+  int use_vmsplice;
+};
+typedef struct rng_output_s rng_output;
+
+/*************
+ * Functions *
+ *************/
+
+static id *rng_alloc_block(size_t block_ids) {
+  void *result = NULL;
+  if (posix_memalign(&result, BLOCK_ALIGNMENT, block_ids * sizeof(id))) {
+    return NULL;
+  }
+  return (id*) result;
+}
+
+// Returns the number of ids in the given block, which is only less than a
+// full block at the very end of a limited run.
+static size_t rng_block_length(size_t block, size_t block_ids, size_t limit) {
+  if (limit == 0) {
+    return block_ids;
+  }
+  size_t start = block * block_ids;
+  if (start >= limit) {
+    return 0;
+  }
+  return (limit - start < block_ids) ? limit - start : block_ids;
+}
+
+// Fills a block with counter-mode output.
+static void rng_fill_counter_block(id *block, size_t block_index, size_t n) {
+  id base = RNG_START + ((id) block_index) * ((id) n);
+  for (size_t i = 0; i < n; ++i) {
+    block[i] = base + i;
+  }
+  acy_prng_batch(block, block, n, RNG_SEED);
+}
+
+// Writes or splices a full buffer. Returns 0 on success or -1 on error.
+static int rng_emit(rng_output *out, id const *block, size_t n) {
+  char const *bytes = (char const *) block;
+  size_t remaining = n * sizeof(id);
+  while (remaining > 0) {
+    ssize_t done;
+#ifdef __linux__
+    if (out->use_vmsplice) {
+      struct iovec iov = { .iov_base = (void *) bytes, .iov_len = remaining };
+      done = vmsplice(out->fd, &iov, 1, 0);
+    } else {
+      done = write(out->fd, bytes, remaining);
+    }
+#else
+    done = write(out->fd, bytes, remaining);
+#endif
+    if (done < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    bytes += done;
+    remaining -= done;
+  }
+  return 0;
+}
+
+// Sets up vmsplice output if possible, adjusting the block size to match the
+// pipe's capacity. Returns the (possibly adjusted) block size in ids.
+static size_t rng_setup_vmsplice(rng_output *out, size_t block_ids) {
+#ifdef __linux__
+  int capacity = fcntl(out->fd, F_SETPIPE_SZ, (int) (block_ids * sizeof(id)));
+  if (capacity < 0) {
+    capacity = fcntl(out->fd, F_GETPIPE_SZ);
+  }
+  if (capacity <= 0 || capacity % sizeof(id) != 0) {
+    fprintf(stderr, "Note: stdout isn't a pipe; not using vmsplice.\n");
+    out->use_vmsplice = 0;
+    return block_ids;
+  }
+  out->use_vmsplice = 1;
+  return capacity / sizeof(id);
+#else
+  fprintf(stderr, "Note: vmsplice isn't available on this platform.\n");
+  out->use_vmsplice = 0;
+  return block_ids;
+#endif
+}
+
+// Generates chained output (each id is the PRNG of the previous one) in a
+// single thread, alternating between two blocks.
+static int rng_run_chained(rng_output *out, size_t block_ids, size_t limit) {
+  id *blocks[2];
+  blocks[0] = rng_alloc_block(block_ids);
+  blocks[1] = rng_alloc_block(block_ids);
+  if (blocks[0] == NULL || blocks[1] == NULL) {
+    fprintf(stderr, "Error: couldn't allocate output blocks.\n");
+    return EXIT_FAILURE;
+  }
+  acy_prng_key key;
+  acy_prng_key_init(&key, RNG_SEED);
+  id x = RNG_START;
+  for (size_t block = 0; ; ++block) {
+    size_t n = rng_block_length(block, block_ids, limit);
+    if (n == 0) {
+      break;
+    }
+    id *buf = blocks[block % 2];
+    for (size_t i = 0; i < n; ++i) {
+      x = acy_prng_keyed(x, &key);
+      buf[i] = x;
+    }
+    if (rng_emit(out, buf, n)) {
+      break; // reader went away
+    }
+  }
+  free(blocks[0]);
+  free(blocks[1]);
+  return EXIT_SUCCESS;
+}
+
+static void *rng_worker_main(void *arg) {
+  rng_worker *worker = (rng_worker*) arg;
+  rng_state *state = worker->state;
+  for (
+    size_t block = worker->index;
+    ;
+    block += state->n_threads
+  ) {
+    size_t n = rng_block_length(block, state->block_ids, state->limit);
+    if (n == 0) {
+      break;
+    }
+    size_t slot = block % state->n_slots;
+    pthread_mutex_lock(&state->lock);
+    while (state->ready_for[slot] != block && !state->stop) {
+      pthread_cond_wait(&state->slot_freed, &state->lock);
+    }
+    int stop = state->stop;
+    pthread_mutex_unlock(&state->lock);
+    if (stop) {
+      break;
+    }
+
+    rng_fill_counter_block(state->slots[slot], block, state->block_ids);
+
+    pthread_mutex_lock(&state->lock);
+    state->holds[slot] = block;
+    pthread_cond_broadcast(&state->slot_filled);
+    pthread_mutex_unlock(&state->lock);
+  }
+  return NULL;
+}
+
+// Marks the slot holding the given block as free for the block n_slots later.
+static void rng_release_block(rng_state *state, size_t block) {
+  size_t slot = block % state->n_slots;
+  pthread_mutex_lock(&state->lock);
+  state->ready_for[slot] = block + state->n_slots;
+  pthread_cond_broadcast(&state->slot_freed);
+  pthread_mutex_unlock(&state->lock);
+}
+
+// Generates counter-mode output using the given number of worker threads
+// (zero means generate in the main thread).
+static int rng_run_counter(
+  rng_output *out,
+  size_t block_ids,
+  size_t limit,
+  size_t n_threads
+) {
+  rng_state state;
+  state.block_ids = block_ids;
+  state.limit = limit;
+  state.n_threads = n_threads;
+  // vmsplice holds on to one extra block, and each worker can work ahead by
+  // one block:
+  state.n_slots = (n_threads > 0 ? 2 * n_threads : 1) + 2;
+  state.stop = 0;
+  state.slots = (id**) calloc(state.n_slots, sizeof(id*));
+  state.ready_for = (size_t*) calloc(state.n_slots, sizeof(size_t));
+  state.holds = (size_t*) calloc(state.n_slots, sizeof(size_t));
+  if (state.slots == NULL || state.ready_for == NULL || state.holds == NULL) {
+    fprintf(stderr, "Error: couldn't allocate output blocks.\n");
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < state.n_slots; ++i) {
+    state.slots[i] = rng_alloc_block(block_ids);
+    if (state.slots[i] == NULL) {
+      fprintf(stderr, "Error: couldn't allocate output blocks.\n");
+      return EXIT_FAILURE;
+    }
+    state.ready_for[i] = i;
+    state.holds[i] = (size_t) -1;
+  }
+  pthread_mutex_init(&state.lock, NULL);
+  pthread_cond_init(&state.slot_freed, NULL);
+  pthread_cond_init(&state.slot_filled, NULL);
+
+  pthread_t threads[MAX_THREADS];
+  rng_worker workers[MAX_THREADS];
+  for (size_t i = 0; i < n_threads; ++i) {
+    workers[i].state = &state;
+    workers[i].index = i;
+    pthread_create(&threads[i], NULL, &rng_worker_main, &workers[i]);
+  }
+
+  for (size_t block = 0; ; ++block) {
+    size_t n = rng_block_length(block, block_ids, limit);
+    if (n == 0) {
+      break;
+    }
+    size_t slot = block % state.n_slots;
+    if (n_threads == 0) {
+      rng_fill_counter_block(state.slots[slot], block, block_ids);
+    } else {
+      pthread_mutex_lock(&state.lock);
+      while (state.holds[slot] != block) {
+        pthread_cond_wait(&state.slot_filled, &state.lock);
+      }
+      pthread_mutex_unlock(&state.lock);
+    }
+    if (rng_emit(out, state.slots[slot], n)) {
+      break; // reader went away
+    }
+    // With vmsplice, the previous block is only safe to reuse once this one
+    // has been fully spliced:
+    if (out->use_vmsplice) {
+      if (block > 0) {
+        rng_release_block(&state, block - 1);
+      }
+    } else {
+      rng_release_block(&state, block);
+    }
+  }
+
+  pthread_mutex_lock(&state.lock);
+  state.stop = 1;
+  pthread_cond_broadcast(&state.slot_freed);
+  pthread_mutex_unlock(&state.lock);
+  for (size_t i = 0; i < n_threads; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+
+  pthread_mutex_destroy(&state.lock);
+  pthread_cond_destroy(&state.slot_freed);
+  pthread_cond_destroy(&state.slot_filled);
+  for (size_t i = 0; i < state.n_slots; ++i) {
+    free(state.slots[i]);
+  }
+  free(state.slots);
+  free(state.ready_for);
+  free(state.holds);
+  return EXIT_SUCCESS;
+}
+
+static int rng_parse_size(char const *arg, size_t *r_value) {
+  if (arg == NULL || sscanf(arg, "%zu", r_value) != 1) {
+    fprintf(stderr, "Error: couldn't parse '%s' as a number.\n", arg);
+    return 0;
+  }
+  return 1;
+}
 
 int main(int argc, char** argv) {
   size_t limit = 0;
-  if (argc > 1) {
-    if (sscanf(argv[1], "%zu", &limit) == EOF) {
+  size_t block_ids = DEFAULT_BLOCK_IDS;
+  size_t n_threads = 0;
+  int counter = 0;
+  rng_output out = { .fd = STDOUT_FILENO, .use_vmsplice = 0 };
+  int want_vmsplice = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--counter") == 0) {
+      counter = 1;
+    } else if (strcmp(argv[i], "--vmsplice") == 0) {
+      want_vmsplice = 1;
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      if (!rng_parse_size(i + 1 < argc ? argv[++i] : NULL, &n_threads)) {
+        return EXIT_FAILURE;
+      }
+      if (n_threads > MAX_THREADS) {
+        fprintf(stderr, "Error: at most %d threads.\n", MAX_THREADS);
+        return EXIT_FAILURE;
+      }
+      counter = 1;
+    } else if (strcmp(argv[i], "--block") == 0) {
+      if (!rng_parse_size(i + 1 < argc ? argv[++i] : NULL, &block_ids)) {
+        return EXIT_FAILURE;
+      }
+      if (block_ids == 0) {
+        fprintf(stderr, "Error: block size must be positive.\n");
+        return EXIT_FAILURE;
+      }
+    } else if (sscanf(argv[i], "%zu", &limit) != 1) {
       fprintf(
-        stdout,
+        stderr,
         "Error: couldn't parse '%s' as an output limit.\n",
-        argv[1]
+        argv[i]
       );
       return EXIT_FAILURE;
     }
   }
-  id x = 7817298123;
-  id seed = 1092809123;
-  size_t count = 0;
-  while (limit == 0 || count < limit) {
-    x = acy_prng(x, seed);
-    char * byte = (char*) &x;
-    for (size_t i = 0; i < sizeof(id); ++i) {
-      fputc(*byte, stdout);
-      byte += 1;
-    }
-    // fprintf(stdout, "%20lu\n", x);
-    count += 1;
+
+  if (want_vmsplice) {
+    block_ids = rng_setup_vmsplice(&out, block_ids);
+  }
+
+  if (counter) {
+    return rng_run_counter(&out, block_ids, limit, n_threads);
+  } else {
+    return rng_run_chained(&out, block_ids, limit);
   }
-  return EXIT_SUCCESS;
 }
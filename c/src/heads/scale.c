@@ -0,0 +1,336 @@
+/**
+ * @file: scale.c
+ *
+ * @description: Shows how the _batch_pool functions scale with the number of
+ * threads on this machine. Each workload runs on pools of 1, 2, 4, ... threads
+ * up to the maximum, and the fastest of several passes is reported along with
+ * its speedup over one thread. Results are checked against a run without a
+ * pool, so this also works as a local test that scheduling doesn't change
+ * results (it exits with a failure status if anything differs). Options:
+ *
+ *   --threads N   Go up to N threads (default: one per online CPU).
+ *   --size N      Ids per pass (default 1048576; the family workload uses
+ *                 1/64th as many).
+ *   --reps N      Timed passes per thread count (default 3).
+ *   --filter S    Only run workloads whose name contains S.
+ *
+ * e.g.,
+ *
+ *   scale --threads 16 --filter family
+ *
+ * @author: Peter Mawhorter (pmawhorter@gmail.com)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core/unit.h"
+#include "core/pool.h"
+#include "core/batch.h"
+#include "core/cohort.h"
+#include "core/select.h"
+#include "family/family.h"
+
+/*************
+ * Constants *
+ *************/
+
+#define DEFAULT_SIZE 1048576
+#define DEFAULT_REPS 3
+
+#define SCALE_SEED 1092809123
+#define SCALE_TABLE_SIZE 16
+#define SCALE_TABLE_MULTIPLIER 312
+#define SCALE_COHORT_SIZE 9984
+#define SCALE_BASE 3298019
+#define SCALE_FAMILY_BASE 448781327578432
+#define SCALE_FAMILY_DIVISOR 64
+
+/*************************
+ * Structure Definitions *
+ *************************/
+
+// Shared setup for all workloads.
+struct scale_env_s {
+  id *sumtable;
+  acy_tabulated_ctx tabulated;
+  acy_select_ctx *select;
+  acy_compiled_family *compiled;
+};
+typedef struct scale_env_s scale_env;
+
+// A workload maps n ids to one or two arrays of results.
+typedef void (*scale_fn)(
+  scale_env *env,
+  id const *ids,
+  id n,
+  id *out,
+  id *out2,
+  acy_pool *pool
+);
+
+struct scale_case_s {
+  char const *name;
+  scale_fn fn;
+  id base; // ids are base, base + 1, ...
+  id divisor; // of the size
+};
+typedef struct scale_case_s scale_case;
+
+/*************
+ * Workloads *
+ *************/
+
+static void scale_prng(
+  scale_env *env,
+  id const *ids,
+  id n,
+  id *out,
+  id *out2,
+  acy_pool *pool
+) {
+  acy_prng_batch_pool(ids, out, n, SCALE_SEED, pool);
+}
+
+static void scale_tabulated(
+  scale_env *env,
+  id const *ids,
+  id n,
+  id *out,
+  id *out2,
+  acy_pool *pool
+) {
+  acy_tabulated_cohort_and_inner_batch_pool(
+    ids,
+    n,
+    &env->tabulated,
+    out,
+    out2,
+    pool
+  );
+}
+
+static void scale_select(
+  scale_env *env,
+  id const *ids,
+  id n,
+  id *out,
+  id *out2,
+  acy_pool *pool
+) {
+  acy_select_table_parent_and_index_batch_pool(
+    ids,
+    n,
+    env->select,
+    out,
+    out2,
+    pool
+  );
+}
+
+static void scale_family(
+  scale_env *env,
+  id const *ids,
+  id n,
+  id *out,
+  id *out2,
+  acy_pool *pool
+) {
+  acy_compiled_num_children_batch_pool(ids, n, env->compiled, out, pool);
+}
+
+static scale_case const CASES[] = {
+  { "prng", &scale_prng, SCALE_BASE, 1 },
+  { "tabulated", &scale_tabulated, SCALE_BASE, 1 },
+  { "select", &scale_select, SCALE_BASE, 1 },
+  { "family", &scale_family, SCALE_FAMILY_BASE, SCALE_FAMILY_DIVISOR },
+};
+
+/*************
+ * Functions *
+ *************/
+
+static double scale_now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int scale_parse_size(char const *arg, id *r_value) {
+  if (arg == NULL || sscanf(arg, "%lu", r_value) != 1 || *r_value == 0) {
+    fprintf(stderr, "Error: couldn't parse '%s' as a positive number.\n", arg);
+    return 0;
+  }
+  return 1;
+}
+
+// Runs one workload at each thread count, returning 0 if any results differ
+// from the reference run.
+static int scale_run(
+  scale_env *env,
+  scale_case const *c,
+  id size,
+  id max_threads,
+  id reps
+) {
+  id n = acy_max(size / c->divisor, 1);
+  id *ids = (id*) malloc(n * sizeof(id));
+  id *expected = (id*) calloc(n, sizeof(id));
+  id *expected2 = (id*) calloc(n, sizeof(id));
+  id *out = (id*) calloc(n, sizeof(id));
+  id *out2 = (id*) calloc(n, sizeof(id));
+  if (
+    ids == NULL || expected == NULL || expected2 == NULL
+ || out == NULL || out2 == NULL
+  ) {
+    fprintf(stderr, "Error: out of memory.\n");
+    return 0;
+  }
+  for (id i = 0; i < n; ++i) {
+    ids[i] = c->base + i;
+  }
+  c->fn(env, ids, n, expected, expected2, NULL);
+
+  int ok = 1;
+  double single = 0;
+  for (id threads = 1; ok && threads <= max_threads; ) {
+    acy_pool *pool = acy_create_pool(threads);
+    if (pool == NULL) {
+      fprintf(stderr, "Error: couldn't start %lu threads.\n", threads);
+      ok = 0;
+      break;
+    }
+    double best = 0;
+    for (id r = 0; r < reps; ++r) {
+      double start = scale_now();
+      c->fn(env, ids, n, out, out2, pool);
+      double elapsed = scale_now() - start;
+      if (r == 0 || elapsed < best) {
+        best = elapsed;
+      }
+      if (
+        memcmp(out, expected, n * sizeof(id)) != 0
+     || memcmp(out2, expected2, n * sizeof(id)) != 0
+      ) {
+        fprintf(
+          stderr,
+          "Error: %s results differ with %lu threads.\n",
+          c->name,
+          threads
+        );
+        ok = 0;
+        break;
+      }
+    }
+    acy_destroy_pool(pool);
+    if (threads == 1) {
+      single = best;
+    }
+    fprintf(
+      stdout,
+      "%-10s %4lu threads %10.2f ns/id %8.2fx\n",
+      c->name,
+      threads,
+      best * 1e9 / n,
+      best > 0 ? single / best : 0
+    );
+    // Powers of two, then the maximum:
+    if (threads < max_threads && threads * 2 > max_threads) {
+      threads = max_threads;
+    } else {
+      threads *= 2;
+    }
+  }
+
+  free(ids);
+  free(expected);
+  free(expected2);
+  free(out);
+  free(out2);
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  char const *filter = NULL;
+  id max_threads = 0;
+  id size = DEFAULT_SIZE;
+  id reps = DEFAULT_REPS;
+
+  for (int i = 1; i < argc; ++i) {
+    char const *next = i + 1 < argc ? argv[i + 1] : NULL;
+    if (strcmp(argv[i], "--filter") == 0 && next != NULL) {
+      filter = argv[++i];
+    } else if (strcmp(argv[i], "--threads") == 0) {
+      if (!scale_parse_size(next, &max_threads)) {
+        return EXIT_FAILURE;
+      }
+      ++i;
+    } else if (strcmp(argv[i], "--size") == 0) {
+      if (!scale_parse_size(next, &size)) {
+        return EXIT_FAILURE;
+      }
+      ++i;
+    } else if (strcmp(argv[i], "--reps") == 0) {
+      if (!scale_parse_size(next, &reps)) {
+        return EXIT_FAILURE;
+      }
+      ++i;
+    } else {
+      fprintf(stderr, "Error: unknown argument '%s'.\n", argv[i]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (max_threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    max_threads = online > 0 ? (id) online : 1;
+  }
+  fprintf(
+    stdout,
+    "Up to %lu threads on %ld online CPUs.\n",
+    max_threads,
+    sysconf(_SC_NPROCESSORS_ONLN)
+  );
+
+  scale_env env;
+  id disttable[SCALE_TABLE_SIZE] = {
+    1, 1, 1, 2, 2, 3, 4, 5, 6, 8, 12, 9, 6, 3, 2, 1
+  };
+  acy_create_sumtable(disttable, SCALE_TABLE_SIZE, &env.sumtable);
+  int have_tabulated = acy_create_tabulated_ctx(
+    env.sumtable,
+    SCALE_TABLE_SIZE,
+    SCALE_TABLE_MULTIPLIER,
+    SCALE_SEED,
+    &env.tabulated
+  );
+  env.select = acy_create_select_ctx(
+    32,
+    32,
+    env.sumtable,
+    SCALE_TABLE_SIZE,
+    32 * SCALE_COHORT_SIZE,
+    SCALE_SEED
+  );
+  env.compiled = acy_compile_family_info(&DEFAULT_FAMILY_INFO);
+  if (!have_tabulated || env.select == NULL || env.compiled == NULL) {
+    fprintf(stderr, "Error: out of memory.\n");
+    return EXIT_FAILURE;
+  }
+
+  int ok = 1;
+  for (id c = 0; c < sizeof(CASES) / sizeof(scale_case); ++c) {
+    if (filter != NULL && strstr(CASES[c].name, filter) == NULL) {
+      continue;
+    }
+    ok = scale_run(&env, &CASES[c], size, max_threads, reps) && ok;
+  }
+
+  acy_cleanup_tabulated_ctx(&env.tabulated);
+  acy_destroy_select_ctx(env.select);
+  acy_destroy_compiled_family(env.compiled);
+  acy_cleanup_sumtable(env.sumtable);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}